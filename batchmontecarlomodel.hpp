@@ -0,0 +1,97 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file batchmontecarlomodel.hpp
+    \brief Monte Carlo model pricing blocks of paths
+*/
+
+#ifndef montecarlo_batch_montecarlo_model_hpp
+#define montecarlo_batch_montecarlo_model_hpp
+
+#include "batchpathgenerator.hpp"
+
+namespace QuantLib {
+
+    //! base class for path pricers working on blocks of paths
+    /*! The value of the \f$ j \f$-th path of the block must be written
+        into the \f$ j \f$-th element of the output array.
+    */
+    class BatchPathPricer {
+      public:
+        virtual ~BatchPathPricer() = default;
+        virtual void operator()(const PathBlock& paths, Real* values) const = 0;
+    };
+
+
+    //! Monte Carlo model working on blocks of paths
+    /*! Same interface and same sequence of samples as MonteCarloModel,
+        including the antithetic-variate average; the path generator
+        and pricer are called once per block instead of once per path.
+        Priced samples not requested yet are kept for the next call.
+    */
+    template <class GSG, class S>
+    class BatchMonteCarloModel {
+      public:
+        typedef BatchPathGenerator<GSG> path_generator_type;
+        typedef BatchPathPricer path_pricer_type;
+        typedef S stats_type;
+        BatchMonteCarloModel(ext::shared_ptr<path_generator_type> pathGenerator,
+                             ext::shared_ptr<path_pricer_type> pathPricer,
+                             stats_type sampleAccumulator,
+                             bool antitheticVariate)
+        : pathGenerator_(std::move(pathGenerator)), pathPricer_(std::move(pathPricer)),
+          sampleAccumulator_(std::move(sampleAccumulator)),
+          isAntitheticVariate_(antitheticVariate), next_(batchLanes) {}
+        void addSamples(Size samples);
+        const stats_type& sampleAccumulator() const { return sampleAccumulator_; }
+      private:
+        ext::shared_ptr<path_generator_type> pathGenerator_;
+        ext::shared_ptr<path_pricer_type> pathPricer_;
+        stats_type sampleAccumulator_;
+        bool isAntitheticVariate_;
+        Real values_[batchLanes], antitheticValues_[batchLanes], weights_[batchLanes];
+        Size next_;
+    };
+
+
+    // template definitions
+
+    template <class GSG, class S>
+    inline void BatchMonteCarloModel<GSG,S>::addSamples(Size samples) {
+        for (Size k=0; k<samples; ++k) {
+            if (next_ == batchLanes) {
+                MONTECARLO_PHASE(Payoff);
+                const PathBlock& paths = pathGenerator_->next();
+                std::copy(paths.weights(), paths.weights() + batchLanes, weights_);
+                (*pathPricer_)(paths, values_);
+                if (isAntitheticVariate_) {
+                    (*pathPricer_)(pathGenerator_->antithetic(), antitheticValues_);
+                    for (Size j=0; j<batchLanes; ++j)
+                        values_[j] = (values_[j] + antitheticValues_[j]) / 2.0;
+                }
+                next_ = 0;
+            }
+            MONTECARLO_PHASE(Statistics);
+            sampleAccumulator_.add(values_[next_], weights_[next_]);
+            ++next_;
+        }
+    }
+
+}
+
+
+#endif
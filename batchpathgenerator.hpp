@@ -0,0 +1,290 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file batchpathgenerator.hpp
+    \brief Generation of blocks of paths in structure-of-arrays layout
+*/
+
+#ifndef montecarlo_batch_path_generator_hpp
+#define montecarlo_batch_path_generator_hpp
+
+#include <ql/methods/montecarlo/brownianbridge.hpp>
+#include <ql/timegrid.hpp>
+#include "pathgenerator.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace QuantLib {
+
+    //! number of paths evolved together by the batch generators
+    const Size batchLanes = 8;
+
+    namespace detail {
+
+        /* Element-wise kernels on one row of batchLanes values.  With
+           GCC and Clang they are written on vector types, which the
+           compiler maps onto the widest registers enabled by the target
+           flags (AVX-512 with -mavx512f, AVX2 with -mavx2, NEON on
+           ARM); elsewhere they fall back to the standard library. */
+
+        #if defined(__GNUC__)
+
+        typedef double batch_real
+            __attribute__((vector_size(batchLanes*sizeof(double))));
+        typedef std::int64_t batch_int
+            __attribute__((vector_size(batchLanes*sizeof(std::int64_t))));
+
+        /* exp(x) for |x| < 700: reduction to r = x - n log(2) with
+           |r| <= log(2)/2, degree-12 Taylor polynomial for exp(r), and
+           scaling by 2^n through the exponent bits. */
+        inline void batchExp(Real* values) {
+            const double magic = 6755399441055744.0;  // 1.5 * 2^52
+            batch_real x, zero = {};
+            std::memcpy(&x, values, sizeof(x));
+            batch_int over = x > zero + 700.0, under = x < zero - 700.0;
+            x = (batch_real)(((batch_int)x & ~(over | under))
+                             | ((batch_int)(zero + 700.0) & over)
+                             | ((batch_int)(zero - 700.0) & under));
+            batch_real t = x * 1.4426950408889634 + magic;
+            batch_real n = t - magic;
+            batch_real r = x - n * 6.93147180369123816490e-01
+                             - n * 1.90821492927058770002e-10;
+            batch_real p = zero + 1.0/479001600.0;
+            p = p * r + 1.0/39916800.0;
+            p = p * r + 1.0/3628800.0;
+            p = p * r + 1.0/362880.0;
+            p = p * r + 1.0/40320.0;
+            p = p * r + 1.0/5040.0;
+            p = p * r + 1.0/720.0;
+            p = p * r + 1.0/120.0;
+            p = p * r + 1.0/24.0;
+            p = p * r + 1.0/6.0;
+            p = p * r + 0.5;
+            p = p * r + 1.0;
+            p = p * r + 1.0;
+            batch_int k = (batch_int)t - (batch_int)(zero + magic);
+            p = (batch_real)((batch_int)p + (k << 52));
+            std::memcpy(values, &p, sizeof(p));
+        }
+
+        /* log(x) for positive normal x: x = 2^e m with m in
+           [sqrt(2)/2, sqrt(2)), and log(m) = 2 atanh((m-1)/(m+1))
+           summed up to the 21st power. */
+        inline void batchLog(Real* values) {
+            batch_real x, zero = {};
+            std::memcpy(&x, values, sizeof(x));
+            batch_int bits = (batch_int)x;
+            batch_int e = ((bits >> 52) & 0x7ff) - 1023;
+            batch_real m = (batch_real)((bits & 0x000fffffffffffffLL)
+                                        | 0x3ff0000000000000LL);
+            batch_int big = m > zero + 1.4142135623730951;
+            m = (batch_real)(((batch_int)(m * 0.5) & big) | ((batch_int)m & ~big));
+            e -= big;  // the mask is -1 where true
+            batch_real f = (m - 1.0) / (m + 1.0);
+            batch_real f2 = f * f;
+            batch_real s = zero + 1.0/21.0;
+            s = s * f2 + 1.0/19.0;
+            s = s * f2 + 1.0/17.0;
+            s = s * f2 + 1.0/15.0;
+            s = s * f2 + 1.0/13.0;
+            s = s * f2 + 1.0/11.0;
+            s = s * f2 + 1.0/9.0;
+            s = s * f2 + 1.0/7.0;
+            s = s * f2 + 1.0/5.0;
+            s = s * f2 + 1.0/3.0;
+            s = s * f2;
+            batch_real n = __builtin_convertvector(e, batch_real);
+            x = n * 6.93147180369123816490e-01
+                + (2.0 * f + 2.0 * f * s + n * 1.90821492927058770002e-10);
+            std::memcpy(values, &x, sizeof(x));
+        }
+
+        #else
+
+        inline void batchExp(Real* x) {
+            for (Size j=0; j<batchLanes; ++j)
+                x[j] = std::exp(x[j]);
+        }
+
+        inline void batchLog(Real* x) {
+            for (Size j=0; j<batchLanes; ++j)
+                x[j] = std::log(x[j]);
+        }
+
+        #endif
+
+    }
+
+
+    //! block of batchLanes paths on the same time grid
+    /*! Values are stored time-major: the values of all paths at the
+        \f$ i \f$-th node of the grid are contiguous and can be
+        processed together.
+    */
+    class PathBlock {
+      public:
+        explicit PathBlock(TimeGrid timeGrid)
+        : timeGrid_(std::move(timeGrid)),
+          values_(timeGrid_.size() * batchLanes), weights_(batchLanes, 1.0) {}
+        //! \name inspectors
+        //@{
+        Size length() const { return timeGrid_.size(); }
+        static Size lanes() { return batchLanes; }
+        //! values of the paths at the i-th node of the grid
+        const Real* operator[](Size i) const { return &values_[i * batchLanes]; }
+        const Real* front() const { return &values_[0]; }
+        const Real* back() const { return &values_[(length()-1) * batchLanes]; }
+        const Real* weights() const { return &weights_[0]; }
+        const TimeGrid& timeGrid() const { return timeGrid_; }
+        //@}
+        //! \name modifiers
+        //@{
+        Real* operator[](Size i) { return &values_[i * batchLanes]; }
+        Real* weights() { return &weights_[0]; }
+        //@}
+      private:
+        TimeGrid timeGrid_;
+        std::vector<Real> values_, weights_;
+    };
+
+
+    //! Generates blocks of paths of a Black-Scholes process with deterministic parameters
+    /*! batchLanes sequences are drawn from the generator, in the same
+        order as PathGenerator_2 would draw them, and the resulting
+        paths are evolved together as
+        \f[
+            S_{i+1} = S_i \exp(\mu_i + \nu_i w_i)
+        \f]
+        with the per-step log-drift \f$ \mu_i \f$ and log-diffusion
+        \f$ \nu_i \f$ computed once.  The antithetic block reuses the
+        last Gaussian variates with the opposite sign.
+
+        \ingroup mcarlo
+    */
+    template <class GSG>
+    class BatchPathGenerator {
+      public:
+        typedef PathBlock sample_type;
+        BatchPathGenerator(const ext::shared_ptr<StochasticProcess>& process,
+                           TimeGrid timeGrid,
+                           GSG generator,
+                           bool brownianBridge);
+        //! \name inspectors
+        //@{
+        const sample_type& next() const;
+        const sample_type& antithetic() const;
+        Size size() const { return dimension_; }
+        const TimeGrid& timeGrid() const { return timeGrid_; }
+        //@}
+      private:
+        const sample_type& evolve(Real sign) const;
+        bool brownianBridge_;
+        mutable GSG generator_;
+        Size dimension_;
+        TimeGrid timeGrid_;
+        Real x0_;
+        std::vector<Real> drift_, diffusion_;
+        mutable sample_type next_;
+        // Gaussian variates of the last block, time-major
+        mutable std::vector<Real> variates_;
+        mutable std::vector<Real> temp_;
+        BrownianBridge bb_;
+    };
+
+
+    // template definitions
+
+    template <class GSG>
+    BatchPathGenerator<GSG>::BatchPathGenerator(
+                      const ext::shared_ptr<StochasticProcess>& process,
+                      TimeGrid timeGrid,
+                      GSG generator,
+                      bool brownianBridge)
+    : brownianBridge_(brownianBridge), generator_(std::move(generator)),
+      dimension_(generator_.dimension()), timeGrid_(std::move(timeGrid)),
+      next_(timeGrid_), variates_(dimension_ * batchLanes), temp_(dimension_),
+      bb_(timeGrid_) {
+        ext::shared_ptr<StochasticProcess1D> process1D =
+            ext::dynamic_pointer_cast<StochasticProcess1D>(process);
+        QL_REQUIRE(process1D, "1-D process required");
+        x0_ = process1D->x0();
+        QL_REQUIRE(dimension_==timeGrid_.size()-1,
+                   "sequence generator dimensionality (" << dimension_
+                   << ") != timeSteps (" << timeGrid_.size()-1 << ")");
+        QL_REQUIRE(detail::logNormalSteps(process, timeGrid_, drift_, diffusion_),
+                   "constant, piecewise-constant or tabulated Black-Scholes process required");
+    }
+
+    template <class GSG>
+    const typename BatchPathGenerator<GSG>::sample_type&
+    BatchPathGenerator<GSG>::next() const {
+        MONTECARLO_PHASE(Rng);
+        MONTECARLO_COUNT(RngDraws, dimension_ * batchLanes);
+        Real* weights = next_.weights();
+        for (Size j=0; j<batchLanes; ++j) {
+            typedef typename GSG::sample_type sequence_type;
+            const sequence_type& sequence_ = generator_.nextSequence();
+            if (brownianBridge_) {
+                bb_.transform(sequence_.value.begin(),
+                              sequence_.value.end(),
+                              temp_.begin());
+            } else {
+                std::copy(sequence_.value.begin(),
+                          sequence_.value.end(),
+                          temp_.begin());
+            }
+            for (Size i=0; i<dimension_; ++i)
+                variates_[i * batchLanes + j] = temp_[i];
+            weights[j] = sequence_.weight;
+        }
+        return evolve(1.0);
+    }
+
+    template <class GSG>
+    const typename BatchPathGenerator<GSG>::sample_type&
+    BatchPathGenerator<GSG>::antithetic() const {
+        return evolve(-1.0);
+    }
+
+    template <class GSG>
+    const typename BatchPathGenerator<GSG>::sample_type&
+    BatchPathGenerator<GSG>::evolve(Real sign) const {
+        MONTECARLO_PHASE(Path);
+        MONTECARLO_COUNT(Paths, batchLanes);
+        Real* x = next_[0];
+        for (Size j=0; j<batchLanes; ++j)
+            x[j] = x0_;
+        for (Size i=0; i<dimension_; ++i) {
+            const Real* w = &variates_[i * batchLanes];
+            Real* y = next_[i+1];
+            Real mu = drift_[i], nu = sign * diffusion_[i];
+            for (Size j=0; j<batchLanes; ++j)
+                y[j] = mu + nu * w[j];
+            detail::batchExp(y);
+            for (Size j=0; j<batchLanes; ++j)
+                y[j] *= x[j];
+            x = y;
+        }
+        return next_;
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,469 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*  Benchmark of the Monte Carlo engines.
+
+    Every combination of instrument (European, Asian, barrier), engine
+    (QuantLib original, _2 with non-constant, tabulated and constant
+    parameters, and with constant parameters in single precision),
+    number of time steps and number of samples is priced a few times
+    for warm-up and then timed over a number of repetitions.  The
+    median time and its dispersion are reported, together with the
+    cost per path, the heap allocations per path and the error against
+    an analytic price where one is available.  The single-precision
+    cases also report their bias and speedup with respect to the
+    double-precision ones, which draw the same paths.
+
+    Usage:
+
+        benchmark [--format=json|csv] [--output=file]
+                  [--steps=10,100] [--samples=10000,100000]
+                  [--warmup=1] [--repetitions=5] [--seed=42]
+
+    Results are written to the standard output unless a file is given;
+    progress is reported on the standard error.
+*/
+
+#include <ql/qldefines.hpp>
+#ifdef BOOST_MSVC
+#  include <ql/auto_link.hpp>
+#endif
+#include "constantblackscholesprocess.hpp"
+#include "mceuropeanengine.hpp"
+#include "mc_discr_arith_av_strike.hpp"
+#include "mcbarrierengine.hpp"
+#include <ql/instruments/europeanoption.hpp>
+#include <ql/instruments/asianoption.hpp>
+#include <ql/instruments/barrieroption.hpp>
+#include <ql/instruments/payoffs.hpp>
+#include <ql/exercise.hpp>
+#include <ql/pricingengines/vanilla/analyticeuropeanengine.hpp>
+#include <ql/pricingengines/vanilla/mceuropeanengine.hpp>
+#include <ql/pricingengines/asian/mc_discr_arith_av_strike.hpp>
+#include <ql/pricingengines/barrier/analyticbarrierengine.hpp>
+#include <ql/pricingengines/barrier/mcbarrierengine.hpp>
+#include <ql/termstructures/yield/zerocurve.hpp>
+#include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace QuantLib;
+
+
+// allocation counting
+
+namespace {
+
+    std::atomic<std::size_t> allocations(0);
+
+}
+
+void* operator new(std::size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+
+namespace {
+
+    struct BenchmarkSettings {
+        std::string format = "json";
+        std::string output;
+        std::vector<Size> steps = {10, 100};
+        std::vector<Size> samples = {10000, 100000};
+        Size warmup = 1;
+        Size repetitions = 5;
+        BigNatural seed = 42;
+    };
+
+    std::vector<Size> parseList(const std::string& s) {
+        std::vector<Size> result;
+        std::istringstream in(s);
+        std::string item;
+        while (std::getline(in, item, ','))
+            result.push_back(std::stoul(item));
+        QL_REQUIRE(!result.empty(), "empty list: " << s);
+        return result;
+    }
+
+    BenchmarkSettings parseArguments(int argc, char* argv[]) {
+        BenchmarkSettings settings;
+        for (int i=1; i<argc; ++i) {
+            std::string arg = argv[i];
+            std::string::size_type eq = arg.find('=');
+            QL_REQUIRE(arg.compare(0, 2, "--") == 0 && eq != std::string::npos,
+                       "unrecognized argument: " << arg);
+            std::string key = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+            if (key == "format") {
+                QL_REQUIRE(value == "json" || value == "csv",
+                           "unknown format: " << value);
+                settings.format = value;
+            } else if (key == "output") {
+                settings.output = value;
+            } else if (key == "steps") {
+                settings.steps = parseList(value);
+            } else if (key == "samples") {
+                settings.samples = parseList(value);
+            } else if (key == "warmup") {
+                settings.warmup = std::stoul(value);
+            } else if (key == "repetitions") {
+                settings.repetitions = std::stoul(value);
+            } else if (key == "seed") {
+                settings.seed = std::stoul(value);
+            } else {
+                QL_FAIL("unrecognized argument: " << arg);
+            }
+        }
+        QL_REQUIRE(settings.repetitions > 0, "at least one repetition required");
+        return settings;
+    }
+
+
+    struct Case {
+        std::string instrument;
+        std::string engine;
+        Size steps;
+        Size samples;
+        Instrument* option;
+        ext::shared_ptr<PricingEngine> pricingEngine;
+        Real reference;
+        // index of the double-precision case to compare with, if any
+        Size baseline = Null<Size>();
+    };
+
+    struct Result {
+        Case benchmark;
+        Real npv;
+        Real errorEstimate;
+        double median, deviation, minimum, maximum;  // seconds
+        double allocationsPerPath;
+        // with respect to the baseline case, if any
+        Real bias = Null<Real>();
+        Real speedup = Null<Real>();
+    };
+
+    double median(std::vector<double> x) {
+        std::sort(x.begin(), x.end());
+        Size n = x.size();
+        return n % 2 == 1 ? x[n/2] : 0.5 * (x[n/2 - 1] + x[n/2]);
+    }
+
+    // median absolute deviation
+    double deviation(const std::vector<double>& x, double m) {
+        std::vector<double> d(x.size());
+        for (Size i=0; i<x.size(); ++i)
+            d[i] = std::fabs(x[i] - m);
+        return median(d);
+    }
+
+    Result run(const Case& c, const BenchmarkSettings& settings) {
+        std::vector<double> seconds, allocated;
+        for (Size i=0; i<settings.warmup + settings.repetitions; ++i) {
+            // setting the engine again forces the instrument to recalculate
+            c.option->setPricingEngine(c.pricingEngine);
+            std::size_t startAllocations = allocations;
+            auto startTime = std::chrono::steady_clock::now();
+            c.option->NPV();
+            auto endTime = std::chrono::steady_clock::now();
+            std::size_t endAllocations = allocations;
+            if (i >= settings.warmup) {
+                seconds.push_back(std::chrono::duration<double>(endTime - startTime).count());
+                allocated.push_back(double(endAllocations - startAllocations));
+            }
+        }
+
+        Result r;
+        r.benchmark = c;
+        r.npv = c.option->NPV();
+        r.errorEstimate = c.option->errorEstimate();
+        r.median = median(seconds);
+        r.deviation = deviation(seconds, r.median);
+        r.minimum = *std::min_element(seconds.begin(), seconds.end());
+        r.maximum = *std::max_element(seconds.begin(), seconds.end());
+        r.allocationsPerPath = median(allocated) / c.samples;
+        return r;
+    }
+
+
+    std::string number(Real x) {
+        if (x == Null<Real>())
+            return "";
+        std::ostringstream out;
+        out << std::setprecision(10) << x;
+        return out.str();
+    }
+
+    void writeCsv(std::ostream& out, const std::vector<Result>& results) {
+        out << "instrument,engine,steps,samples,npv,error_estimate,reference,error,"
+            << "time_median_s,time_mad_s,time_min_s,time_max_s,"
+            << "ns_per_path,paths_per_s,allocations_per_path,"
+            << "bias_vs_double,speedup_vs_double\n";
+        for (const Result& r : results) {
+            const Case& c = r.benchmark;
+            Real error = c.reference == Null<Real>() ? Null<Real>() : r.npv - c.reference;
+            out << c.instrument << ',' << c.engine << ','
+                << c.steps << ',' << c.samples << ','
+                << number(r.npv) << ',' << number(r.errorEstimate) << ','
+                << number(c.reference) << ',' << number(error) << ','
+                << number(r.median) << ',' << number(r.deviation) << ','
+                << number(r.minimum) << ',' << number(r.maximum) << ','
+                << number(1.0e9 * r.median / c.samples) << ','
+                << number(c.samples / r.median) << ','
+                << number(r.allocationsPerPath) << ','
+                << number(r.bias) << ',' << number(r.speedup) << '\n';
+        }
+    }
+
+    std::string jsonNumber(Real x) {
+        return x == Null<Real>() ? "null" : number(x);
+    }
+
+    void writeJson(std::ostream& out, const std::vector<Result>& results,
+                   const BenchmarkSettings& settings) {
+        out << "{\n"
+            << "  \"warmup\": " << settings.warmup << ",\n"
+            << "  \"repetitions\": " << settings.repetitions << ",\n"
+            << "  \"seed\": " << settings.seed << ",\n"
+            << "  \"results\": [\n";
+        for (Size i=0; i<results.size(); ++i) {
+            const Result& r = results[i];
+            const Case& c = r.benchmark;
+            Real error = c.reference == Null<Real>() ? Null<Real>() : r.npv - c.reference;
+            out << "    {"
+                << "\"instrument\": \"" << c.instrument << "\", "
+                << "\"engine\": \"" << c.engine << "\", "
+                << "\"steps\": " << c.steps << ", "
+                << "\"samples\": " << c.samples << ", "
+                << "\"npv\": " << jsonNumber(r.npv) << ", "
+                << "\"error_estimate\": " << jsonNumber(r.errorEstimate) << ", "
+                << "\"reference\": " << jsonNumber(c.reference) << ", "
+                << "\"error\": " << jsonNumber(error) << ", "
+                << "\"time_median_s\": " << jsonNumber(r.median) << ", "
+                << "\"time_mad_s\": " << jsonNumber(r.deviation) << ", "
+                << "\"time_min_s\": " << jsonNumber(r.minimum) << ", "
+                << "\"time_max_s\": " << jsonNumber(r.maximum) << ", "
+                << "\"ns_per_path\": " << jsonNumber(1.0e9 * r.median / c.samples) << ", "
+                << "\"paths_per_s\": " << jsonNumber(c.samples / r.median) << ", "
+                << "\"allocations_per_path\": " << jsonNumber(r.allocationsPerPath) << ", "
+                << "\"bias_vs_double\": " << jsonNumber(r.bias) << ", "
+                << "\"speedup_vs_double\": " << jsonNumber(r.speedup)
+                << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n"
+            << "}\n";
+    }
+
+}
+
+
+int main(int argc, char* argv[]) {
+
+    try {
+
+        BenchmarkSettings settings = parseArguments(argc, argv);
+
+        // same market and options as in main.cpp
+
+        Date today = Date(24, February, 2022);
+        Settings::instance().evaluationDate() = today;
+
+        Real underlying = 36;
+
+        Handle<Quote> underlyingH(ext::make_shared<SimpleQuote>(underlying));
+
+        DayCounter dayCounter = Actual365Fixed();
+        Handle<YieldTermStructure> riskFreeRate(
+            ext::make_shared<ZeroCurve>(std::vector<Date>{today, today + 6*Months},
+                                        std::vector<Rate>{0.01, 0.015},
+                                        dayCounter));
+        Handle<BlackVolTermStructure> volatility(
+            ext::make_shared<BlackVarianceCurve>(today,
+                                                 std::vector<Date>{today+3*Months, today+6*Months},
+                                                 std::vector<Volatility>{0.20, 0.25},
+                                                 dayCounter));
+
+        auto bsmProcess = ext::make_shared<BlackScholesProcess>(underlyingH, riskFreeRate, volatility);
+
+        Real strike = 40;
+        Date maturity(24, May, 2022);
+
+        Option::Type type(Option::Put);
+        auto exercise = ext::make_shared<EuropeanExercise>(maturity);
+        auto payoff = ext::make_shared<PlainVanillaPayoff>(type, strike);
+
+        EuropeanOption europeanOption(payoff, exercise);
+
+        std::vector<Date> fixingDates = {
+            Date(4, March, 2022), Date(14, March, 2022), Date(24, March, 2022),
+            Date(4, April, 2022), Date(14, April, 2022), Date(24, April, 2022),
+            Date(4, May, 2022), Date(14, May, 2022), Date(24, May, 2022)
+        };
+        DiscreteAveragingAsianOption asianOption(Average::Arithmetic, fixingDates,
+                                                 payoff, exercise);
+
+        BarrierOption barrierOption(Barrier::UpIn, 40, 0, payoff, exercise);
+
+        // analytic references; none is available for the
+        // arithmetic average-strike option
+
+        europeanOption.setPricingEngine(ext::make_shared<AnalyticEuropeanEngine>(bsmProcess));
+        Real europeanReference = europeanOption.NPV();
+
+        barrierOption.setPricingEngine(ext::make_shared<AnalyticBarrierEngine>(bsmProcess));
+        Real barrierReference = barrierOption.NPV();
+
+        // benchmark cases
+
+        std::vector<Case> cases;
+        const Size nEngines = 5;
+        const std::string engines[nEngines] = {
+            "original", "non-constant", "tabulated", "constant", "constant-float"
+        };
+        const ProcessParameters::Mode modes[nEngines] = {
+            ProcessParameters::Full, ProcessParameters::Full,
+            ProcessParameters::Tabulated, ProcessParameters::Constant,
+            ProcessParameters::Constant
+        };
+        // the single-precision engine is compared with the previous case
+        const bool singlePrecision[nEngines] = { false, false, false, false, true };
+        auto baseline = [&](Size k) {
+            return singlePrecision[k] ? cases.size() - 1 : Null<Size>();
+        };
+        BigNatural seed = settings.seed;
+
+        for (Size samples : settings.samples) {
+            for (Size steps : settings.steps) {
+                for (Size k=0; k<nEngines; ++k) {
+                    ext::shared_ptr<PricingEngine> engine;
+                    if (k == 0)
+                        engine = MakeMCEuropeanEngine<PseudoRandom>(bsmProcess)
+                            .withSteps(steps).withSamples(samples).withSeed(seed);
+                    else
+                        engine = MakeMCEuropeanEngine_2<PseudoRandom>(bsmProcess)
+                            .withSteps(steps).withSamples(samples).withSeed(seed)
+                            .withParameterMode(modes[k])
+                            .withSinglePrecision(singlePrecision[k]);
+                    cases.push_back({"European", engines[k], steps, samples,
+                                     &europeanOption, engine, europeanReference,
+                                     baseline(k)});
+                }
+            }
+
+            // the time grid of the Asian engines is given by the fixings
+            for (Size k=0; k<nEngines; ++k) {
+                ext::shared_ptr<PricingEngine> engine;
+                if (k == 0)
+                    engine = MakeMCDiscreteArithmeticASEngine<PseudoRandom>(bsmProcess)
+                        .withSamples(samples).withSeed(seed);
+                else
+                    engine = MakeMCDiscreteArithmeticASEngine_2<PseudoRandom>(bsmProcess)
+                        .withSamples(samples).withSeed(seed)
+                        .withParameterMode(modes[k])
+                        .withSinglePrecision(singlePrecision[k]);
+                cases.push_back({"Asian", engines[k], fixingDates.size(), samples,
+                                 &asianOption, engine, Null<Real>(), baseline(k)});
+            }
+
+            for (Size steps : settings.steps) {
+                for (Size k=0; k<nEngines; ++k) {
+                    ext::shared_ptr<PricingEngine> engine;
+                    if (k == 0)
+                        engine = MakeMCBarrierEngine<PseudoRandom>(bsmProcess)
+                            .withSteps(steps).withSamples(samples).withSeed(seed);
+                    else
+                        engine = MakeMCBarrierEngine_2<PseudoRandom>(bsmProcess)
+                            .withSteps(steps).withSamples(samples).withSeed(seed)
+                            .withParameterMode(modes[k])
+                            .withSinglePrecision(singlePrecision[k]);
+                    cases.push_back({"Barrier", engines[k], steps, samples,
+                                     &barrierOption, engine, barrierReference,
+                                     baseline(k)});
+                }
+            }
+        }
+
+        // run
+
+        std::vector<Result> results;
+        for (Size i=0; i<cases.size(); ++i) {
+            const Case& c = cases[i];
+            std::cerr << "[" << i+1 << "/" << cases.size() << "] "
+                      << c.instrument << ", " << c.engine << ", "
+                      << c.steps << " steps, " << c.samples << " samples"
+                      << std::endl;
+            results.push_back(run(c, settings));
+            if (c.baseline != Null<Size>()) {
+                const Result& b = results[c.baseline];
+                results.back().bias = results.back().npv - b.npv;
+                results.back().speedup = b.median / results.back().median;
+            }
+        }
+
+        std::ofstream file;
+        if (!settings.output.empty()) {
+            file.open(settings.output.c_str());
+            QL_REQUIRE(file, "cannot open " << settings.output);
+        }
+        std::ostream& out = settings.output.empty() ? std::cout : file;
+
+        if (settings.format == "csv")
+            writeCsv(out, results);
+        else
+            writeJson(out, results, settings);
+
+        return 0;
+
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
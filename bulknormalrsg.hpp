@@ -0,0 +1,175 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file bulknormalrsg.hpp
+    \brief Gaussian sequences transformed in blocks of several paths
+*/
+
+#ifndef montecarlo_bulk_normal_rsg_hpp
+#define montecarlo_bulk_normal_rsg_hpp
+
+#include <ql/math/distributions/normaldistribution.hpp>
+#include <ql/math/randomnumbers/rngtraits.hpp>
+#include "philoxrsg.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace QuantLib {
+
+    //! inverse cumulative normal of whole arrays
+    /*! Same approximation as InverseCumulativeNormal (P. J. Acklam's
+        rational functions) for the standard normal, applied to \c n
+        values at a time.  The central region, which holds about 95%
+        of the values, is computed for all of them by a loop without
+        branches that the compiler vectorizes; the values in the tails
+        are then replaced one by one by the scalar inverse cumulative.
+
+        The results are those of InverseCumulativeNormal up to the
+        rounding of the vectorized arithmetic.
+    */
+    class BulkInverseCumulativeNormal {
+      public:
+        //! sets z[i] to the inverse cumulative normal of x[i], for i < n
+        /*! \pre \c x and \c z do not overlap. */
+        static void apply(const Real* x, Real* z, Size n);
+    };
+
+
+    //! Gaussian sequence generator transforming blocks of sequences
+    /*! The uniform sequences of \c USG are drawn a few at a time and
+        transformed together by BulkInverseCumulativeNormal, so that
+        each call of the inverse cumulative fills the vector units
+        even when the dimensionality is low.  The sequences are the
+        ones InverseCumulativeRsg_2 returns for the same uniform
+        generator, in the same order, up to the rounding noted above.
+
+        \ingroup mcarlo
+    */
+    template <class USG>
+    class BulkNormalRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        explicit BulkNormalRsg(USG uniformSequenceGenerator);
+        const sample_type& nextSequence() const;
+        const sample_type& lastSequence() const { return x_; }
+        Size dimension() const { return dimension_; }
+      private:
+        USG uniformSequenceGenerator_;
+        Size dimension_, blockSize_;
+        // uniforms, normals and weights of the current block
+        mutable std::vector<Real> uniforms_, normals_, weights_;
+        mutable Size next_;
+        mutable sample_type x_;
+    };
+
+
+    //! random-number traits with bulk Gaussian transformation
+    /*! The uniform sequences of \c URSG are turned into Gaussian ones
+        by BulkNormalRsg.  The traits can be given as the \c RNG
+        argument of the _2 engines in place of their pseudo-random
+        counterparts, e.g., BulkPseudoRandom for PseudoRandom, and
+        give the same paths up to rounding.
+    */
+    template <class URSG>
+    struct GenericBulkRandom {
+        typedef URSG ursg_type;
+        typedef BulkNormalRsg<ursg_type> rsg_type;
+        enum { allowsErrorEstimate = 1 };
+        static rsg_type make_sequence_generator(Size dimension, BigNatural seed) {
+            return rsg_type(ursg_type(dimension, seed));
+        }
+    };
+
+    //! Mersenne-Twister uniforms, transformed in bulk
+    typedef GenericBulkRandom<RandomSequenceGenerator<MersenneTwisterUniformRng> > BulkPseudoRandom;
+
+    //! Philox uniforms, transformed in bulk
+    typedef GenericBulkRandom<PhiloxUniformRsg> BulkPhiloxRandom;
+
+
+    // inline definitions
+
+    inline void BulkInverseCumulativeNormal::apply(const Real* x, Real* z, Size n) {
+        // coefficients of the central region, as in InverseCumulativeNormal
+        const Real a1 = -3.969683028665376e+01, a2 = 2.209460984245205e+02,
+                   a3 = -2.759285104469687e+02, a4 = 1.383577518672690e+02,
+                   a5 = -3.066479806614716e+01, a6 = 2.506628277459239e+00;
+        const Real b1 = -5.447609879822406e+01, b2 = 1.615858368580409e+02,
+                   b3 = -1.556989798598866e+02, b4 = 6.680131188771972e+01,
+                   b5 = -1.328068155288572e+01;
+        const Real xLow = 0.02425, xHigh = 1.0 - xLow;
+
+        // central formula for all the values, in tiles of fixed size
+        // in local arrays so that the loop is vectorized; the values
+        // in the tails give finite garbage at this stage
+        const Size tile = 16;
+        for (Size start = 0; start < n; start += tile) {
+            Size m = std::min(tile, n - start);
+            Real q[tile] = {}, y[tile];
+            for (Size i = 0; i < m; ++i)
+                q[i] = x[start + i] - 0.5;
+            for (Size i = 0; i < tile; ++i) {
+                Real r = q[i] * q[i];
+                y[i] = (((((a1*r+a2)*r+a3)*r+a4)*r+a5)*r+a6)*q[i] /
+                       (((((b1*r+b2)*r+b3)*r+b4)*r+b5)*r+1.0);
+            }
+            std::copy(y, y + m, z + start);
+        }
+        // tails, fixed one at a time
+        for (Size i = 0; i < n; ++i) {
+            if (x[i] < xLow || x[i] > xHigh)
+                z[i] = InverseCumulativeNormal::standard_value(x[i]);
+        }
+    }
+
+
+    template <class USG>
+    inline BulkNormalRsg<USG>::BulkNormalRsg(USG uniformSequenceGenerator)
+    : uniformSequenceGenerator_(std::move(uniformSequenceGenerator)),
+      dimension_(uniformSequenceGenerator_.dimension()),
+      // at least 256 values per block
+      blockSize_(dimension_ > 0 ? (256 + dimension_ - 1) / dimension_ : 1),
+      uniforms_(blockSize_ * dimension_), normals_(blockSize_ * dimension_),
+      weights_(blockSize_), next_(blockSize_),
+      x_(std::vector<Real>(dimension_), 1.0) {}
+
+    template <class USG>
+    inline const typename BulkNormalRsg<USG>::sample_type&
+    BulkNormalRsg<USG>::nextSequence() const {
+        if (next_ == blockSize_) {
+            for (Size i = 0; i < blockSize_; ++i) {
+                const typename USG::sample_type& sample =
+                    uniformSequenceGenerator_.nextSequence();
+                std::copy(sample.value.begin(), sample.value.end(),
+                          uniforms_.begin() + i * dimension_);
+                weights_[i] = sample.weight;
+            }
+            BulkInverseCumulativeNormal::apply(uniforms_.data(), normals_.data(),
+                                               uniforms_.size());
+            next_ = 0;
+        }
+        std::vector<Real>::const_iterator first = normals_.begin() + next_ * dimension_;
+        std::copy(first, first + dimension_, x_.value.begin());
+        x_.weight = weights_[next_];
+        ++next_;
+        return x_;
+    }
+
+}
+
+
+#endif
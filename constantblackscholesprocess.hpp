@@ -16,6 +16,12 @@ namespace QuantLib {
         Real drift(Time t, Real x) const override;
         Real diffusion(Time t, Real x) const override;
         Real apply(Real x0, Real dx) const override;
+        //! \name Inspectors
+        //@{
+        double riskFreeRate() const { return riskFreeRate_; }
+        double volatility() const { return volatility_; }
+        double dividend() const { return dividend_; }
+        //@}
       private:
         double underlyingValue_;
         double riskFreeRate_;
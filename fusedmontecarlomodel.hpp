@@ -0,0 +1,264 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file fusedmontecarlomodel.hpp
+    \brief Monte Carlo model pricing the paths while they are generated
+*/
+
+#ifndef montecarlo_fused_montecarlo_model_hpp
+#define montecarlo_fused_montecarlo_model_hpp
+
+#include <ql/methods/montecarlo/brownianbridge.hpp>
+#include <ql/methods/montecarlo/path.hpp>
+#include "mcinstrumentation.hpp"
+#include "pathgenerator.hpp"
+
+namespace QuantLib {
+
+    //! Monte Carlo model pricing the paths while they are generated
+    /*! Same samples as MonteCarloModel_2 with PathGenerator_2 and a
+        path pricer computing the same payoff, for processes with
+        deterministic parameters (see PathGenerator_2), but the path
+        is never stored: each node is passed to a kernel as soon as it
+        is computed, and the kernel keeps the little state its payoff
+        needs (e.g., the last value, a running sum or a hit flag).
+        The memory used per path does not depend on the number of
+        steps.
+
+        The kernel is a template parameter, so that its calls are
+        inlined and its state can be kept in registers.  It must
+        provide:
+        - a \c real_type, the precision in which the path is evolved
+          and passed to the kernel;
+        - a \c state_type;
+        - <tt>state_type initialState(real_type x0) const</tt>, called
+          once per path with the initial value;
+        - <tt>bool update(state_type&, Size i, real_type x) const</tt>,
+          called with the value at the \f$ i \f$-th node for
+          \f$ i = 1, \dots, n \f$; returning false stops the path
+          once its payoff is known;
+        - <tt>Real value(const state_type&) const</tt>, returning
+          the discounted payoff.
+
+        With \c real_type as \c float, the paths and payoffs are
+        computed in single precision; the variates, the likelihood
+        ratio and the accumulated samples stay in double precision.
+        The paths are those of the double-precision kernel up to the
+        rounding of each step, i.e., a relative error of about
+        \f$ 10^{-7} \f$ per step.
+
+        The random numbers of a path are drawn in full even if the
+        kernel stops early, so that the following paths are the same.
+
+        With a non-null drift \f$ \theta \f$, the paths are sampled
+        by importance: the Brownian motion driving them gets the drift
+        \f$ \theta \f$, i.e., the variate of the \f$ i \f$-th step is
+        shifted by \f$ \theta_i = \theta \sqrt{\Delta t_i} \f$, and
+        each payoff is multiplied by the likelihood ratio
+        \f[
+            \exp\left(-\sum_i \theta_i w_i - \frac{1}{2} \sum_i \theta_i^2\right)
+        \f]
+        of the unshifted variates \f$ w_i \f$, which keeps the
+        estimate unbiased (Girsanov).  A drift pushing the paths
+        towards the region where the payoff is not null reduces the
+        variance of rare-event payoffs; see girsanovDrift.
+    */
+    template <class GSG, class Kernel, class S>
+    class FusedMonteCarloModel {
+      public:
+        typedef Kernel kernel_type;
+        typedef typename kernel_type::real_type real_type;
+        typedef typename kernel_type::state_type state_type;
+        typedef S stats_type;
+        FusedMonteCarloModel(const ext::shared_ptr<StochasticProcess>& process,
+                             const TimeGrid& timeGrid,
+                             GSG generator,
+                             bool brownianBridge,
+                             kernel_type kernel,
+                             stats_type sampleAccumulator,
+                             bool antitheticVariate,
+                             Real drift = 0.0);
+        void addSamples(Size samples);
+        const stats_type& sampleAccumulator() const { return sampleAccumulator_; }
+      private:
+        Real value(const Real* variates, Real sign) const;
+        GSG generator_;
+        bool brownianBridge_;
+        kernel_type kernel_;
+        stats_type sampleAccumulator_;
+        bool isAntitheticVariate_;
+        Real x0_;
+        // per-step log-drift and log-diffusion
+        std::vector<real_type> drift_, diffusion_;
+        // per-step shifts of the variates and half their squared norm
+        std::vector<Real> shift_;
+        Real halfShiftNorm_ = 0.0;
+        std::vector<Real> temp_;
+        BrownianBridge bb_;
+    };
+
+
+    //! Brownian drift taking the median of the paths to the target at time t
+    /*! Drift \f$ \theta \f$ for the importance sampling of
+        FusedMonteCarloModel such that the median
+        \f$ S_0 \exp((r-q-\sigma^2/2)t + \sigma\theta t) \f$ of the
+        value at time \f$ t \f$ is the target.
+    */
+    inline Real girsanovDrift(const ConstantBlackScholesProcess& process, Time t, Real target) {
+        QL_REQUIRE(t > 0.0, "positive time required");
+        QL_REQUIRE(target > 0.0, "positive target required");
+        Volatility sigma = process.volatility();
+        Real mu = process.riskFreeRate() - process.dividend() - 0.5 * sigma * sigma;
+        return (std::log(target / process.x0()) - mu * t) / (sigma * t);
+    }
+
+
+    //! candidate drift with the smallest variance on a pilot run
+    /*! The factory returns the model sampling with a given drift; it
+        should draw the same pilot paths for all candidates.  The
+        candidates whose pilot gives no non-null payoff are skipped,
+        since their variance is not estimated; if all of them are,
+        the last candidate is returned.
+    */
+    template <class Factory>
+    inline Real pilotDrift(const Factory& factory,
+                           const std::vector<Real>& candidates,
+                           Size samples) {
+        QL_REQUIRE(!candidates.empty(), "no candidate drifts given");
+        Real result = candidates.back(), minVariance = QL_MAX_REAL;
+        for (Real drift : candidates) {
+            auto model = factory(drift);
+            model->addSamples(samples);
+            const auto& stats = model->sampleAccumulator();
+            if (stats.mean() == 0.0)
+                continue;
+            Real variance = stats.variance();
+            if (variance < minVariance) {
+                minVariance = variance;
+                result = drift;
+            }
+        }
+        return result;
+    }
+
+
+    //! discounted payoff of a stored path, computed by a kernel of FusedMonteCarloModel
+    template <class Kernel>
+    inline Real kernelValue(const Kernel& kernel, const Path& path) {
+        typename Kernel::state_type state = kernel.initialState(path.front());
+        for (Size i=1; i<path.length(); ++i) {
+            if (!kernel.update(state, i, path[i]))
+                break;
+        }
+        return kernel.value(state);
+    }
+
+
+    // template definitions
+
+    template <class GSG, class Kernel, class S>
+    inline FusedMonteCarloModel<GSG,Kernel,S>::FusedMonteCarloModel(
+                                      const ext::shared_ptr<StochasticProcess>& process,
+                                      const TimeGrid& timeGrid,
+                                      GSG generator,
+                                      bool brownianBridge,
+                                      kernel_type kernel,
+                                      stats_type sampleAccumulator,
+                                      bool antitheticVariate,
+                                      Real drift)
+    : generator_(std::move(generator)), brownianBridge_(brownianBridge),
+      kernel_(std::move(kernel)), sampleAccumulator_(std::move(sampleAccumulator)),
+      isAntitheticVariate_(antitheticVariate),
+      temp_(timeGrid.size() - 1), bb_(timeGrid) {
+        ext::shared_ptr<StochasticProcess1D> process1D =
+            ext::dynamic_pointer_cast<StochasticProcess1D>(process);
+        QL_REQUIRE(process1D, "1-D process required");
+        x0_ = process1D->x0();
+        QL_REQUIRE(generator_.dimension() == timeGrid.size() - 1,
+                   "sequence generator dimensionality (" << generator_.dimension()
+                   << ") != timeSteps (" << timeGrid.size() - 1 << ")");
+        std::vector<Real> stepDrift, stepDiffusion;
+        QL_REQUIRE(detail::logNormalSteps(process, timeGrid, stepDrift, stepDiffusion),
+                   "process with deterministic parameters required");
+        if (drift != 0.0) {
+            const Size n = stepDrift.size();
+            shift_.resize(n);
+            for (Size i=0; i<n; ++i) {
+                shift_[i] = drift * std::sqrt(timeGrid.dt(i));
+                stepDrift[i] += stepDiffusion[i] * shift_[i];
+                halfShiftNorm_ += 0.5 * shift_[i] * shift_[i];
+            }
+        }
+        drift_.assign(stepDrift.begin(), stepDrift.end());
+        diffusion_.assign(stepDiffusion.begin(), stepDiffusion.end());
+    }
+
+    template <class GSG, class Kernel, class S>
+    inline Real FusedMonteCarloModel<GSG,Kernel,S>::value(const Real* variates,
+                                                          Real sign) const {
+        // same arithmetic as PathGenerator_2, in the precision of the kernel
+        real_type x = static_cast<real_type>(x0_);
+        state_type state = kernel_.initialState(x);
+        const Size n = drift_.size();
+        for (Size i=0; i<n; ++i) {
+            real_type w = static_cast<real_type>(sign * variates[i]);
+            x *= std::exp(drift_[i] + diffusion_[i] * w);
+            if (!kernel_.update(state, i+1, x))
+                break;
+        }
+        if (shift_.empty())
+            return kernel_.value(state);
+
+        // likelihood ratio of the shifted variates
+        Real projection = 0.0;
+        for (Size i=0; i<n; ++i)
+            projection += shift_[i] * variates[i];
+        return std::exp(-sign * projection - halfShiftNorm_) * kernel_.value(state);
+    }
+
+    template <class GSG, class Kernel, class S>
+    inline void FusedMonteCarloModel<GSG,Kernel,S>::addSamples(Size samples) {
+        for (Size j = 1; j <= samples; j++) {
+            MONTECARLO_PHASE(Rng);
+            const typename GSG::sample_type& sequence = generator_.nextSequence();
+            MONTECARLO_COUNT(RngDraws, sequence.value.size());
+            const Real* variates = &sequence.value[0];
+            if (brownianBridge_) {
+                bb_.transform(sequence.value.begin(), sequence.value.end(), temp_.begin());
+                variates = &temp_[0];
+            }
+            Real price, price2 = 0.0;
+            {
+                MONTECARLO_PHASE(Path);
+                MONTECARLO_COUNT(Paths, isAntitheticVariate_ ? 2 : 1);
+                price = value(variates, 1.0);
+                // the antithetic path uses the opposite variates
+                if (isAntitheticVariate_)
+                    price2 = value(variates, -1.0);
+            }
+            MONTECARLO_PHASE(Statistics);
+            if (isAntitheticVariate_)
+                sampleAccumulator_.add((price+price2)/2.0, sequence.weight);
+            else
+                sampleAccumulator_.add(price, sequence.weight);
+        }
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,126 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ Copyright (C) 2003 Ferdinando Ametrano
+ Copyright (C) 2000, 2001, 2002, 2003 RiskMap srl
+
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file inversecumulativersg.hpp
+    \brief Inverse-cumulative random sequence generator without copies
+*/
+
+#ifndef montecarlo_inverse_cumulative_rsg_2_hpp
+#define montecarlo_inverse_cumulative_rsg_2_hpp
+
+#include <ql/math/randomnumbers/inversecumulativersg.hpp>
+#include <ql/math/randomnumbers/rngtraits.hpp>
+
+namespace QuantLib {
+
+    //! Inverse cumulative random sequence generator
+    /*! Same as InverseCumulativeRsg, except that the uniform sequence
+        is read in place instead of being copied, so that drawing a
+        sequence does not allocate memory.
+
+        \ingroup mcarlo
+    */
+    template <class USG, class IC>
+    class InverseCumulativeRsg_2 {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        explicit InverseCumulativeRsg_2(USG uniformSequenceGenerator)
+        : uniformSequenceGenerator_(std::move(uniformSequenceGenerator)),
+          dimension_(uniformSequenceGenerator_.dimension()),
+          x_(std::vector<Real>(dimension_), 1.0) {}
+        InverseCumulativeRsg_2(USG uniformSequenceGenerator,
+                               const IC& inverseCumulative)
+        : uniformSequenceGenerator_(std::move(uniformSequenceGenerator)),
+          dimension_(uniformSequenceGenerator_.dimension()),
+          x_(std::vector<Real>(dimension_), 1.0), ICD_(inverseCumulative) {}
+        //! returns next sample from the inverse cumulative distribution
+        const sample_type& nextSequence() const {
+            const typename USG::sample_type& sample =
+                uniformSequenceGenerator_.nextSequence();
+            x_.weight = sample.weight;
+            for (Size i = 0; i < dimension_; i++)
+                x_.value[i] = ICD_(sample.value[i]);
+            return x_;
+        }
+        const sample_type& lastSequence() const { return x_; }
+        Size dimension() const { return dimension_; }
+      private:
+        USG uniformSequenceGenerator_;
+        Size dimension_;
+        mutable sample_type x_;
+        IC ICD_;
+    };
+
+
+    //! sequence generator used by the _2 engines for the given RNG traits
+    /*! The generator is the one of the traits, except for the
+        inverse-cumulative generators of GenericPseudoRandom and
+        GenericLowDiscrepancy which are replaced by
+        InverseCumulativeRsg_2; the sequences are the same.
+    */
+    template <class RNG>
+    struct SequenceGenerator_2 {
+        typedef typename RNG::rsg_type rsg_type;
+        static rsg_type make(Size dimension, BigNatural seed) {
+            return RNG::make_sequence_generator(dimension, seed);
+        }
+    };
+
+    template <class URNG, class IC>
+    struct SequenceGenerator_2<GenericPseudoRandom<URNG,IC> > {
+        typedef typename GenericPseudoRandom<URNG,IC>::ursg_type ursg_type;
+        typedef InverseCumulativeRsg_2<ursg_type,IC> rsg_type;
+        static rsg_type make(Size dimension, BigNatural seed) {
+            ursg_type g(dimension, seed);
+            const ext::shared_ptr<IC>& ic = GenericPseudoRandom<URNG,IC>::icInstance;
+            return (ic != nullptr ? rsg_type(g, *ic) : rsg_type(g));
+        }
+    };
+
+    template <class URSG, class IC>
+    struct SequenceGenerator_2<GenericLowDiscrepancy<URSG,IC> > {
+        typedef URSG ursg_type;
+        typedef InverseCumulativeRsg_2<ursg_type,IC> rsg_type;
+        static rsg_type make(Size dimension, BigNatural seed) {
+            ursg_type g(dimension, seed);
+            const ext::shared_ptr<IC>& ic = GenericLowDiscrepancy<URSG,IC>::icInstance;
+            return (ic != nullptr ? rsg_type(g, *ic) : rsg_type(g));
+        }
+    };
+
+
+    //! RNG traits drawing the sequences of SequenceGenerator_2
+    /*! The _2 engines give them to the QuantLib engine base classes
+        in place of \c RNG, so that the path generators built by the
+        base classes are the ones of SingleVariate_2<RNG>.
+    */
+    template <class RNG>
+    struct RngTraits_2 {
+        typedef typename SequenceGenerator_2<RNG>::rsg_type rsg_type;
+        enum { allowsErrorEstimate = RNG::allowsErrorEstimate };
+        static rsg_type make_sequence_generator(Size dimension, BigNatural seed) {
+            return SequenceGenerator_2<RNG>::make(dimension, seed);
+        }
+    };
+
+}
+
+
+#endif
@@ -25,23 +25,121 @@
 #define mc_discrete_arithmetic_average_strike_asian_engine_hpp
 
 #include <ql/exercise.hpp>
+#include <ql/pricingengines/asian/analytic_discr_geom_av_strike.hpp>
 #include <ql/pricingengines/asian/mcdiscreteasianenginebase.hpp>
 #include <ql/pricingengines/asian/mc_discr_arith_av_strike.hpp>
 #include <ql/processes/blackscholesprocess.hpp>
+#include "mcparallelsimulation.hpp"
+#include "pathgenerator.hpp"
+#include "processparameters.hpp"
+#include "batchmontecarlomodel.hpp"
+#include "fusedmontecarlomodel.hpp"
+#include "rqmcsimulation.hpp"
+#include "multiinstrumentsimulation.hpp"
+#include "mcgreeks.hpp"
+#include "mcinstrumentation.hpp"
+#include "mcpartialresults.hpp"
+#include "streamingstatistics.hpp"
+#include "payoffdispatch.hpp"
+#include <chrono>
+#include <numeric>
 #include <utility>
 
 namespace QuantLib {
 
+    //! arithmetic average-strike payoff as a kernel of FusedMonteCarloModel
+    /*! Same fixings as ArithmeticASOPathPricer on a path over the
+        given time grid; only the running sum and the last value of
+        the path are kept.  The option type is a template argument, so
+        that the payoff does not test it.  The path is evolved in the
+        precision \c T, while the running sum and the payoff are
+        computed in double precision, so that the rounding of the
+        average does not grow with the number of fixings.
+    */
+    template <Option::Type Type, class T = Real>
+    class ArithmeticASOPathKernel_2 {
+      public:
+        typedef T real_type;
+        struct state_type {
+            Real sum;
+            T last;
+        };
+        ArithmeticASOPathKernel_2(DiscountFactor discount,
+                                  const TimeGrid& timeGrid,
+                                  Real runningSum = 0.0,
+                                  Size pastFixings = 0);
+        state_type initialState(T x0) const {
+            return { fixingAtStart_ ? runningSum_ + x0 : runningSum_, x0 };
+        }
+        bool update(state_type& state, Size, T x) const {
+            state.sum += x;
+            state.last = x;
+            return true;
+        }
+        Real value(const state_type& state) const {
+            return discount_ * vanillaPayoff<Type,Real>(state.last, state.sum / fixings_);
+        }
+      private:
+        DiscountFactor discount_;
+        Real runningSum_;
+        bool fixingAtStart_;
+        Real fixings_;
+    };
+
+
     //!  Monte Carlo pricing engine for discrete arithmetic average-strike Asian
-    /*!  \ingroup asianengines */
-    template <class RNG = PseudoRandom, class S = Statistics>
+    /*!  With a time budget, samples are added in batches until the
+         budget is spent, or until the tolerance or the number of
+         samples, if also given, is reached; the number of samples
+         used is returned as the "samples" additional result.
+
+         With constant parameters, delta, gamma and vega can be
+         computed on the same paths as the value, together with their
+         error estimates ("deltaErrorEstimate", "gammaErrorEstimate"
+         and "vegaErrorEstimate" additional results).  Delta and vega
+         are pathwise estimates; gamma differentiates the pathwise
+         delta through the likelihood ratio of the first fixing, which
+         must therefore come after the evaluation date.
+
+         With a control variate, the geometric average-strike option
+         on the same fixings is priced on paths of the process with the
+         extracted constant parameters, drawn from the same random
+         numbers, and corrected by its analytic price.  Past fixings
+         are not supported by the analytic engine.
+
+         Unless a control variate, the Greeks or batch simulation are
+         required, the simulations with constant, piecewise-constant
+         or tabulated parameters price each path while it is
+         generated, keeping only the running sum instead of the whole
+         fixing schedule (see FusedMonteCarloModel); the results are
+         the same.  With constant parameters, the paths can also be
+         evolved in single precision, with the running sum, the payoff
+         and the samples still computed in double precision.
+
+         When compiled with \c MONTECARLO_ENABLE_INSTRUMENTATION, the
+         counters and phase times of the calculation are also returned
+         as additional results (see McInstrumentation).
+
+         The samples are accumulated by default in StreamingStatistics,
+         whose memory does not grow with their number; Statistics can
+         be given as the accumulator to keep them all.
+
+         Given the first of a block of samples, only the block is
+         simulated, and its accumulator is also returned as the
+         "partialResult" additional result, so that a run can be
+         split among processes (see McPartialResult).
+
+         \ingroup asianengines
+    */
+    template <class RNG = PseudoRandom, class S = StreamingStatistics>
     class MCDiscreteArithmeticASEngine_2
-        : public MCDiscreteAveragingAsianEngineBase<SingleVariate,RNG,S> {
+        : public MCDiscreteAveragingAsianEngineBase<SingleVariate_2,RngTraits_2<RNG>,S>,
+          public SharedPathEngine_2<RNG> {
       public:
-        typedef typename MCDiscreteAveragingAsianEngineBase<SingleVariate,RNG,S>::path_generator_type path_generator_type;
-        typedef typename MCDiscreteAveragingAsianEngineBase<SingleVariate,RNG,S>::path_pricer_type   path_pricer_type;
-        typedef typename MCDiscreteAveragingAsianEngineBase<SingleVariate,RNG,S>::stats_type         stats_type;
-        // Constructor incluant l'option constantParameters
+        typedef typename MCDiscreteAveragingAsianEngineBase<SingleVariate_2,RngTraits_2<RNG>,S>::path_generator_type path_generator_type;
+        typedef typename MCDiscreteAveragingAsianEngineBase<SingleVariate_2,RngTraits_2<RNG>,S>::path_pricer_type   path_pricer_type;
+        typedef typename MCDiscreteAveragingAsianEngineBase<SingleVariate_2,RngTraits_2<RNG>,S>::stats_type         stats_type;
+        // Constructor incluant le choix des paramètres du processus
         MCDiscreteArithmeticASEngine_2(
              const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
              bool brownianBridge,
@@ -50,14 +148,132 @@ namespace QuantLib {
              Real requiredTolerance,
              Size maxSamples,
              BigNatural seed,
-             bool constantParameters);
+             ProcessParameters::Mode parameterMode,
+             Size threads = Null<Size>(),
+             bool batchSimulation = false,
+             std::chrono::microseconds timeBudget = std::chrono::microseconds::zero(),
+             bool greeks = false,
+             bool controlVariate = false,
+             Size firstSample = Null<Size>(),
+             bool singlePrecision = false);
+        void calculate() const override;
+        // SharedPathEngine_2 interface
+        ext::shared_ptr<GeneralizedBlackScholesProcess> sharedProcess() const override;
+        ProcessParameters::Mode sharedParameterMode() const override { return parameterMode_; }
+        BigNatural sharedSeed() const override { return this->seed_; }
+        Real sharedStrike() const override;
+        TimeGrid sharedTimeGrid() const override;
+        ext::shared_ptr<path_generator_type> sharedPathGenerator(BigNatural seed) const override;
+        ext::shared_ptr<path_pricer_type> sharedPathPricer(BigNatural seed,
+                                                           bool singleStream) const override;
       protected:
+        typedef BatchMonteCarloModel<typename SingleVariate_2<RNG>::rsg_type,S> batch_model_type;
         // Surcharge de la méthode pathGenerator() pour intégrer le traitement
         // des paramètres constants si demandé
         ext::shared_ptr<path_generator_type> pathGenerator() const override;
+        ext::shared_ptr<path_generator_type> pathGenerator(BigNatural seed) const;
         ext::shared_ptr<path_pricer_type>   pathPricer() const override;
+        // simulated process and batch simulation
+        ext::shared_ptr<StochasticProcess> simulatedProcess() const;
+        ext::shared_ptr<ConstantBlackScholesProcess> constantProcess() const;
+        ext::shared_ptr<PiecewiseConstantBlackScholesProcess> piecewiseProcess() const;
+        ext::shared_ptr<typename batch_model_type::path_generator_type>
+        batchPathGenerator(BigNatural seed) const;
+        ext::shared_ptr<BatchPathPricer> batchPathPricer() const;
+        // simulation pricing the paths while they are generated
+        template <Option::Type Type, class T>
+        ArithmeticASOPathKernel_2<Type,T> pathKernel() const;
+        // simulation of the Greeks
+        typedef MonteCarloModel_2<SingleVariateGreeks_2,RNG,GreeksStatistics<S> >
+            greeks_model_type;
+        ext::shared_ptr<typename greeks_model_type::path_pricer_type>
+        greeksPathPricer() const;
+        // control variate: the geometric average-strike option under the constant process
+        ext::shared_ptr<path_pricer_type> controlPathPricer() const override;
+        ext::shared_ptr<path_generator_type> controlPathGenerator() const override;
+        ext::shared_ptr<path_generator_type> controlPathGenerator(BigNatural seed) const;
+        ext::shared_ptr<PricingEngine> controlPricingEngine() const override;
+        Real controlVariateValue() const override;
+        ext::shared_ptr<GeneralizedBlackScholesProcess> controlProcess() const;
+      private:
+        // runs the simulation and stores mean, error and samples used
+        template <class Simulation>
+        void simulate(const Simulation& simulation) const;
+        // runs the simulation pricing the paths in the precision T
+        template <Option::Type Type, class T>
+        void simulateFused() const;
+        // first sample of the simulation, null if not a block
+        Size firstSample() const { return firstSample_ != Null<Size>() ? firstSample_ : 0; }
+        ProcessParameters::Mode parameterMode_;
+        Size threads_;
+        bool batchSimulation_;
+        std::chrono::microseconds timeBudget_;
+        bool greeks_;
+        Size firstSample_;
+        bool singlePrecision_;
+    };
+
+
+    //! arithmetic average-strike path pricer for the option type \c Type
+    /*! Same payoff as ArithmeticASOPathPricer, without testing the
+        option type on every path.
+    */
+    template <Option::Type Type>
+    class ArithmeticASOPathPricer_2 : public PathPricer<Path> {
+      public:
+        ArithmeticASOPathPricer_2(DiscountFactor discount,
+                                  Real runningSum = 0.0,
+                                  Size pastFixings = 0);
+        Real operator()(const Path& path) const override;
+      private:
+        DiscountFactor discount_;
+        Real runningSum_;
+        Size pastFixings_;
+    };
+
+
+    //! prices the arithmetic average-strike payoff of a block of paths
+    class ArithmeticASOBatchPathPricer_2 : public BatchPathPricer {
+      public:
+        ArithmeticASOBatchPathPricer_2(Option::Type type,
+                                       DiscountFactor discount,
+                                       Real runningSum = 0.0,
+                                       Size pastFixings = 0);
+        void operator()(const PathBlock& paths, Real* values) const override;
+      private:
+        Real sign_;
+        DiscountFactor discount_;
+        Real runningSum_;
+        Size pastFixings_;
+    };
+
+
+    //! geometric average-strike payoff over the same fixings as ArithmeticASOPathPricer
+    class GeometricASOPathPricer_2 : public PathPricer<Path> {
+      public:
+        GeometricASOPathPricer_2(Option::Type type, DiscountFactor discount);
+        Real operator()(const Path& path) const override;
+      private:
+        Real sign_;
+        DiscountFactor discount_;
+    };
+
+
+    //! average-strike payoff, pathwise delta and vega, and mixed gamma
+    class ArithmeticASOGreeksPathPricer_2 : public PathPricer<Path,PathGreeks> {
+      public:
+        ArithmeticASOGreeksPathPricer_2(Option::Type type,
+                                        DiscountFactor discount,
+                                        const ConstantPathDerivatives& derivatives,
+                                        Real runningSum = 0.0,
+                                        Size pastFixings = 0);
+        PathGreeks operator()(const Path& path) const override;
       private:
-        bool constantParameters_;
+        Real sign_;
+        DiscountFactor discount_;
+        ConstantPathDerivatives derivatives_;
+        Real runningSum_;
+        Size pastFixings_;
     };
 
 
@@ -73,47 +289,352 @@ namespace QuantLib {
              Real requiredTolerance,
              Size maxSamples,
              BigNatural seed,
-             bool constantParameters)
-    : MCDiscreteAveragingAsianEngineBase<SingleVariate,RNG,S>(process,
+             ProcessParameters::Mode parameterMode,
+             Size threads,
+             bool batchSimulation,
+             std::chrono::microseconds timeBudget,
+             bool greeks,
+             bool controlVariate,
+             Size firstSample,
+             bool singlePrecision)
+    : MCDiscreteAveragingAsianEngineBase<SingleVariate_2,RngTraits_2<RNG>,S>(process,
                                                               brownianBridge,
                                                               antitheticVariate,
-                                                              false,
+                                                              controlVariate,
                                                               requiredSamples,
                                                               requiredTolerance,
                                                               maxSamples,
                                                               seed),
-      constantParameters_(constantParameters) {}
+      parameterMode_(parameterMode), threads_(threads),
+      batchSimulation_(batchSimulation), timeBudget_(timeBudget), greeks_(greeks),
+      firstSample_(firstSample), singlePrecision_(singlePrecision) {}
+
+
+    template <class RNG, class S>
+    inline void MCDiscreteArithmeticASEngine_2<RNG,S>::calculate() const {
+        MONTECARLO_INSTRUMENT(this->results_.additionalResults);
+        if (firstSample_ != Null<Size>()) {
+            detail::checkSampleBlock<S,RNG>(this->requiredSamples_, this->requiredTolerance_,
+                                            timeBudget_, this->seed_);
+            QL_REQUIRE(!greeks_, "Greeks not available with blocks of samples");
+        }
+        if (singlePrecision_) {
+            QL_REQUIRE(parameterMode_ == ProcessParameters::Constant,
+                       "single precision requires constant parameters");
+            QL_REQUIRE(!greeks_, "Greeks not available in single precision");
+            QL_REQUIRE(!batchSimulation_,
+                       "batch simulation not available in single precision");
+            QL_REQUIRE(!this->controlVariate_,
+                       "control variate not available in single precision");
+        }
+        if (greeks_) {
+            QL_REQUIRE(parameterMode_ == ProcessParameters::Constant,
+                       "Greeks require constant parameters");
+            QL_REQUIRE(!batchSimulation_, "Greeks not available with batch simulation");
+            QL_REQUIRE(!this->controlVariate_, "Greeks not available with control variate");
+            ext::shared_ptr<typename greeks_model_type::path_pricer_type> pricer =
+                greeksPathPricer();
+            auto factory = [this, pricer](BigNatural seed) {
+                return ext::make_shared<greeks_model_type>(
+                    pathGenerator(seed), pricer, GreeksStatistics<S>(),
+                    this->antitheticVariate_);
+            };
+            if (QmcRandomizations<RNG>::value > 0) {
+                RandomizedQmcSimulation<greeks_model_type> simulation(
+                    factory, QmcRandomizations<RNG>::value,
+                    threads_ != Null<Size>() ? threads_ : 1, this->seed_);
+                simulate(simulation);
+            } else if (threads_ == Null<Size>()) {
+                SequentialMcSimulation<greeks_model_type> simulation(factory(this->seed_));
+                simulate(simulation);
+            } else {
+                ParallelMcSimulation<SingleVariateGreeks_2,RNG,GreeksStatistics<S> >
+                    simulation(factory, threads_, this->seed_);
+                simulate(simulation);
+            }
+            return;
+        }
+
+        if (batchSimulation_) {
+            QL_REQUIRE(!this->controlVariate_,
+                       "control variate not available with batch simulation");
+            QL_REQUIRE(parameterMode_ != ProcessParameters::Full,
+                       "batch simulation requires constant, piecewise-constant "
+                       "or tabulated parameters");
+            ext::shared_ptr<BatchPathPricer> pricer = batchPathPricer();
+            auto factory = [this, pricer](BigNatural seed) {
+                return ext::make_shared<batch_model_type>(
+                    batchPathGenerator(seed), pricer, S(), this->antitheticVariate_);
+            };
+            if (QmcRandomizations<RNG>::value > 0) {
+                RandomizedQmcSimulation<batch_model_type> simulation(
+                    factory, QmcRandomizations<RNG>::value,
+                    threads_ != Null<Size>() ? threads_ : 1, this->seed_);
+                simulate(simulation);
+                return;
+            }
+            ParallelMcSimulation<SingleVariate_2,RNG,S,batch_model_type> simulation(
+                factory, threads_ != Null<Size>() ? threads_ : 1, this->seed_, firstSample());
+            simulate(simulation);
+            return;
+        }
+
+        if (!this->controlVariate_ && parameterMode_ != ProcessParameters::Full) {
+            // deterministic parameters: no need to store the paths;
+            // the kernel is instantiated for the option type
+            ext::shared_ptr<PlainVanillaPayoff> payoff =
+                ext::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+            QL_REQUIRE(payoff, "non-plain payoff given");
+            dispatchOptionType(payoff->optionType(), [&](auto type) {
+                constexpr Option::Type Type = decltype(type)::value;
+                if (singlePrecision_)
+                    simulateFused<Type,float>();
+                else
+                    simulateFused<Type,Real>();
+            });
+            return;
+        }
+
+        // the pricers are stateless and can be shared among threads;
+        // the analytic value of the control variate is computed once
+        ext::shared_ptr<path_pricer_type> pricer = this->pathPricer();
+        ext::shared_ptr<path_pricer_type> cvPricer;
+        Real cvValue = 0.0;
+        if (this->controlVariate_) {
+            cvPricer = this->controlPathPricer();
+            cvValue = this->controlVariateValue();
+        }
+        auto factory = [this, pricer, cvPricer, cvValue](BigNatural seed) {
+            return ext::make_shared<MonteCarloModel_2<SingleVariate_2,RNG,S> >(
+                this->pathGenerator(seed), pricer, S(), this->antitheticVariate_,
+                cvPricer, cvValue,
+                cvPricer ? controlPathGenerator(seed)
+                         : ext::shared_ptr<path_generator_type>());
+        };
+
+        if (threads_ == Null<Size>() && firstSample_ == Null<Size>() &&
+            QmcRandomizations<RNG>::value == 0) {
+            // single stream, as in the base engine, with reused path storage
+            SequentialMcSimulation<MonteCarloModel_2<SingleVariate_2,RNG,S> > simulation(
+                factory(this->seed_));
+            simulate(simulation);
+            return;
+        }
+
+        // set up the lazy local volatility before sharing the process among threads
+        ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_)
+            ->localVolatility();
+        if (QmcRandomizations<RNG>::value > 0) {
+            // independent randomizations of the same point set
+            RandomizedQmcSimulation<MonteCarloModel_2<SingleVariate_2,RNG,S> > simulation(
+                factory, QmcRandomizations<RNG>::value,
+                threads_ != Null<Size>() ? threads_ : 1, this->seed_);
+            simulate(simulation);
+            return;
+        }
+        ParallelMcSimulation<SingleVariate_2,RNG,S> simulation(
+            factory, threads_ != Null<Size>() ? threads_ : 1, this->seed_, firstSample());
+        simulate(simulation);
+    }
+
+
+    template <class RNG, class S>
+    template <class Simulation>
+    inline void
+    MCDiscreteArithmeticASEngine_2<RNG,S>::simulate(const Simulation& simulation) const {
+        simulation.calculate(this->requiredTolerance_,
+                             this->requiredSamples_,
+                             this->maxSamples_,
+                             timeBudget_);
+        detail::storeResults(simulation.sampleAccumulator(), this->results_,
+                             RNG::allowsErrorEstimate);
+        this->results_.additionalResults["samples"] = simulation.samples();
+        if (firstSample_ != Null<Size>())
+            detail::storePartialResult(simulation.sampleAccumulator(), this->seed_,
+                                       firstSample_, this->results_);
+    }
+
+    template <class RNG, class S>
+    template <Option::Type Type, class T>
+    inline void MCDiscreteArithmeticASEngine_2<RNG,S>::simulateFused() const {
+        typedef FusedMonteCarloModel<typename SingleVariate_2<RNG>::rsg_type,
+                                     ArithmeticASOPathKernel_2<Type,T>,S> model_type;
+        ArithmeticASOPathKernel_2<Type,T> kernel = pathKernel<Type,T>();
+        ext::shared_ptr<StochasticProcess> process = simulatedProcess();
+        TimeGrid grid = this->timeGrid();
+        auto factory = [this, kernel, process, grid](BigNatural seed) {
+            return ext::make_shared<model_type>(
+                process, grid,
+                SingleVariate_2<RNG>::make_sequence_generator(grid.size() - 1, seed),
+                this->brownianBridge_, kernel, S(), this->antitheticVariate_);
+        };
+        if (QmcRandomizations<RNG>::value > 0) {
+            RandomizedQmcSimulation<model_type> simulation(
+                factory, QmcRandomizations<RNG>::value,
+                threads_ != Null<Size>() ? threads_ : 1, this->seed_);
+            simulate(simulation);
+        } else if (threads_ == Null<Size>() && firstSample_ == Null<Size>()) {
+            SequentialMcSimulation<model_type> simulation(factory(this->seed_));
+            simulate(simulation);
+        } else {
+            ParallelMcSimulation<SingleVariate_2,RNG,S,model_type> simulation(
+                factory, threads_ != Null<Size>() ? threads_ : 1, this->seed_,
+                firstSample());
+            simulate(simulation);
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline ext::shared_ptr<GeneralizedBlackScholesProcess>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::sharedProcess() const {
+        return ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+    }
+
+
+    template <class RNG, class S>
+    inline Real MCDiscreteArithmeticASEngine_2<RNG,S>::sharedStrike() const {
+        // the paths of full and tabulated parameters do not depend on it
+        if (parameterMode_ == ProcessParameters::Full ||
+            parameterMode_ == ProcessParameters::Tabulated)
+            return Null<Real>();
+        ext::shared_ptr<StrikedTypePayoff> payoff =
+            ext::dynamic_pointer_cast<StrikedTypePayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-striked payoff given");
+        return payoff->strike();
+    }
+
+
+    template <class RNG, class S>
+    inline TimeGrid MCDiscreteArithmeticASEngine_2<RNG,S>::sharedTimeGrid() const {
+        return this->timeGrid();
+    }
+
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<typename MCDiscreteArithmeticASEngine_2<RNG,S>::path_generator_type>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::sharedPathGenerator(BigNatural seed) const {
+        // set up the lazy local volatility before the paths are drawn on other threads
+        ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_)
+            ->localVolatility();
+        return pathGenerator(seed);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<typename MCDiscreteArithmeticASEngine_2<RNG,S>::path_pricer_type>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::sharedPathPricer(BigNatural, bool) const {
+        return this->pathPricer();
+    }
 
 
     template <class RNG, class S>
     inline
     ext::shared_ptr<typename MCDiscreteArithmeticASEngine_2<RNG,S>::path_generator_type>
     MCDiscreteArithmeticASEngine_2<RNG,S>::pathGenerator() const {
+        return pathGenerator(this->seed_);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<typename MCDiscreteArithmeticASEngine_2<RNG,S>::path_generator_type>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::pathGenerator(BigNatural seed) const {
         Size dimensions = this->process_->factors();
         TimeGrid grid = this->timeGrid();
-        typename RNG::rsg_type generator =
-            RNG::make_sequence_generator(dimensions * (grid.size() - 1), this->seed_);
-        if (constantParameters_) {
-            ext::shared_ptr<GeneralizedBlackScholesProcess> BS_process =
-                ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
-            Time time_of_extraction = grid.back();
-            // Extraction du strike à partir du payoff supposé de type StrikedTypePayoff
-            double strike = ext::dynamic_pointer_cast<StrikedTypePayoff>(this->arguments_.payoff)->strike();
-            double riskFreeRate_ = BS_process->riskFreeRate()->zeroRate(time_of_extraction, Continuous);
-            double dividend_     = BS_process->dividendYield()->zeroRate(time_of_extraction, Continuous);
-            double volatility_   = BS_process->blackVolatility()->blackVol(time_of_extraction, strike);
-            double underlyingValue_ = BS_process->x0();
-            // Création d'un processus constant avec les paramètres extraits
-            ext::shared_ptr<ConstantBlackScholesProcess> cst_BS_process(
-                new ConstantBlackScholesProcess(underlyingValue_, riskFreeRate_, volatility_, dividend_));
-            return ext::shared_ptr<path_generator_type>(
-                new path_generator_type(cst_BS_process, grid, generator, this->brownianBridge_));
-        } else {
-            return ext::shared_ptr<path_generator_type>(
-                new path_generator_type(this->process_, grid, generator, this->brownianBridge_));
+        typename SingleVariate_2<RNG>::rsg_type generator =
+            SingleVariate_2<RNG>::make_sequence_generator(dimensions * (grid.size() - 1), seed);
+        return ext::shared_ptr<path_generator_type>(
+            new path_generator_type(simulatedProcess(), grid, generator, this->brownianBridge_));
+    }
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<StochasticProcess>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::simulatedProcess() const {
+        switch (parameterMode_) {
+          case ProcessParameters::Full:
+            return this->process_;
+          case ProcessParameters::Constant:
+            return constantProcess();
+          case ProcessParameters::Piecewise:
+            return piecewiseProcess();
+          case ProcessParameters::Tabulated:
+            return makeTabulatedBlackScholesProcess(
+                ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_),
+                this->timeGrid());
+          default:
+            QL_FAIL("unknown parameter mode");
         }
     }
 
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<ConstantBlackScholesProcess>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::constantProcess() const {
+        ext::shared_ptr<GeneralizedBlackScholesProcess> BS_process =
+            ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+        Time time_of_extraction = this->timeGrid().back();
+        // Extraction du strike à partir du payoff de type StrikedTypePayoff
+        ext::shared_ptr<StrikedTypePayoff> payoff =
+            ext::dynamic_pointer_cast<StrikedTypePayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-striked payoff given");
+        double strike = payoff->strike();
+        // Paramètres partagés entre moteurs, recalculés si le marché change
+        return makeConstantBlackScholesProcess(BS_process, time_of_extraction, strike);
+    }
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<PiecewiseConstantBlackScholesProcess>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::piecewiseProcess() const {
+        ext::shared_ptr<StrikedTypePayoff> payoff =
+            ext::dynamic_pointer_cast<StrikedTypePayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-striked payoff given");
+        double strike = payoff->strike();
+        return makePiecewiseConstantBlackScholesProcess(
+            ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_),
+            this->timeGrid(), strike);
+    }
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<typename MCDiscreteArithmeticASEngine_2<RNG,S>::batch_model_type::path_generator_type>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::batchPathGenerator(BigNatural seed) const {
+        TimeGrid grid = this->timeGrid();
+        typename SingleVariate_2<RNG>::rsg_type generator =
+            SingleVariate_2<RNG>::make_sequence_generator(grid.size() - 1, seed);
+        return ext::make_shared<typename batch_model_type::path_generator_type>(
+            simulatedProcess(), grid, generator, this->brownianBridge_);
+    }
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<BatchPathPricer>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::batchPathPricer() const {
+
+        ext::shared_ptr<PlainVanillaPayoff> payoff =
+            ext::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        ext::shared_ptr<EuropeanExercise> exercise =
+            ext::dynamic_pointer_cast<EuropeanExercise>(this->arguments_.exercise);
+        QL_REQUIRE(exercise, "wrong exercise given");
+
+        ext::shared_ptr<GeneralizedBlackScholesProcess> process =
+            ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        return ext::shared_ptr<BatchPathPricer>(
+            new ArithmeticASOBatchPathPricer_2(
+                payoff->optionType(),
+                process->riskFreeRate()->discount(exercise->lastDate()),
+                this->arguments_.runningAccumulator,
+                this->arguments_.pastFixings));
+    }
+
     template <class RNG, class S>
     inline
     ext::shared_ptr<typename MCDiscreteArithmeticASEngine_2<RNG,S>::path_pricer_type>
@@ -131,16 +652,165 @@ namespace QuantLib {
             ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
         QL_REQUIRE(process, "Black-Scholes process required");
 
-        return ext::shared_ptr<path_pricer_type>(
-            new ArithmeticASOPathPricer(
+        DiscountFactor discount = process->riskFreeRate()->discount(exercise->lastDate());
+        return dispatchOptionType(payoff->optionType(), [&](auto type) {
+            return ext::shared_ptr<path_pricer_type>(
+                new ArithmeticASOPathPricer_2<decltype(type)::value>(
+                    discount,
+                    this->arguments_.runningAccumulator,
+                    this->arguments_.pastFixings));
+        });
+    }
+
+
+    template <class RNG, class S>
+    template <Option::Type Type, class T>
+    inline ArithmeticASOPathKernel_2<Type,T>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::pathKernel() const {
+
+        ext::shared_ptr<PlainVanillaPayoff> payoff =
+            ext::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        ext::shared_ptr<EuropeanExercise> exercise =
+            ext::dynamic_pointer_cast<EuropeanExercise>(this->arguments_.exercise);
+        QL_REQUIRE(exercise, "wrong exercise given");
+
+        ext::shared_ptr<GeneralizedBlackScholesProcess> process =
+            ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        QL_REQUIRE(payoff->optionType() == Type, "wrong option type");
+
+        return ArithmeticASOPathKernel_2<Type,T>(
+            process->riskFreeRate()->discount(exercise->lastDate()),
+            this->timeGrid(),
+            this->arguments_.runningAccumulator,
+            this->arguments_.pastFixings);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<typename MCDiscreteArithmeticASEngine_2<RNG,S>::greeks_model_type::path_pricer_type>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::greeksPathPricer() const {
+
+        ext::shared_ptr<PlainVanillaPayoff> payoff =
+            ext::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        ext::shared_ptr<EuropeanExercise> exercise =
+            ext::dynamic_pointer_cast<EuropeanExercise>(this->arguments_.exercise);
+        QL_REQUIRE(exercise, "wrong exercise given");
+
+        ext::shared_ptr<GeneralizedBlackScholesProcess> process =
+            ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        // a fixing at the evaluation date would make the payoff
+        // depend on the initial value through the average as well
+        QL_REQUIRE(this->timeGrid().mandatoryTimes()[0] != 0.0,
+                   "Greeks not available with a fixing at the evaluation date");
+
+        return ext::shared_ptr<typename greeks_model_type::path_pricer_type>(
+            new ArithmeticASOGreeksPathPricer_2(
                 payoff->optionType(),
                 process->riskFreeRate()->discount(exercise->lastDate()),
+                ConstantPathDerivatives(*constantProcess()),
                 this->arguments_.runningAccumulator,
                 this->arguments_.pastFixings));
     }
 
 
-    template <class RNG = PseudoRandom, class S = Statistics>
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<GeneralizedBlackScholesProcess>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::controlProcess() const {
+        return makeFlatBlackScholesProcess(
+            ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_),
+            *constantProcess());
+    }
+
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<typename MCDiscreteArithmeticASEngine_2<RNG,S>::path_pricer_type>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::controlPathPricer() const {
+
+        ext::shared_ptr<PlainVanillaPayoff> payoff =
+            ext::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        ext::shared_ptr<EuropeanExercise> exercise =
+            ext::dynamic_pointer_cast<EuropeanExercise>(this->arguments_.exercise);
+        QL_REQUIRE(exercise, "wrong exercise given");
+
+        QL_REQUIRE(this->arguments_.pastFixings == 0,
+                   "control variate not available with past fixings");
+
+        // discounted as in the analytic engine
+        return ext::shared_ptr<path_pricer_type>(
+            new GeometricASOPathPricer_2(
+                payoff->optionType(),
+                controlProcess()->riskFreeRate()->discount(exercise->lastDate())));
+    }
+
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<typename MCDiscreteArithmeticASEngine_2<RNG,S>::path_generator_type>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::controlPathGenerator() const {
+        return controlPathGenerator(this->seed_);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<typename MCDiscreteArithmeticASEngine_2<RNG,S>::path_generator_type>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::controlPathGenerator(BigNatural seed) const {
+        // with constant parameters, the control variate uses the simulated paths
+        if (parameterMode_ == ProcessParameters::Constant)
+            return ext::shared_ptr<path_generator_type>();
+
+        Size dimensions = this->process_->factors();
+        TimeGrid grid = this->timeGrid();
+        typename SingleVariate_2<RNG>::rsg_type generator =
+            SingleVariate_2<RNG>::make_sequence_generator(dimensions * (grid.size() - 1), seed);
+        return ext::shared_ptr<path_generator_type>(
+            new path_generator_type(constantProcess(), grid, generator, this->brownianBridge_));
+    }
+
+
+    template <class RNG, class S>
+    inline
+    ext::shared_ptr<PricingEngine>
+    MCDiscreteArithmeticASEngine_2<RNG,S>::controlPricingEngine() const {
+        return ext::make_shared<AnalyticDiscreteGeometricAverageStrikeAsianEngine>(
+            controlProcess());
+    }
+
+
+    template <class RNG, class S>
+    inline Real MCDiscreteArithmeticASEngine_2<RNG,S>::controlVariateValue() const {
+        ext::shared_ptr<PricingEngine> controlPE = this->controlPricingEngine();
+        auto* controlArguments =
+            dynamic_cast<DiscreteAveragingAsianOption::arguments*>(controlPE->getArguments());
+        QL_REQUIRE(controlArguments, "engine is using inconsistent arguments");
+
+        // same option with a geometric average and no running product
+        *controlArguments = this->arguments_;
+        controlArguments->averageType = Average::Geometric;
+        controlArguments->runningAccumulator = 1.0;
+        controlPE->calculate();
+
+        const auto* controlResults =
+            dynamic_cast<const DiscreteAveragingAsianOption::results*>(controlPE->getResults());
+        QL_REQUIRE(controlResults, "engine returns an inconsistent result type");
+        return controlResults->value;
+    }
+
+
+    template <class RNG = PseudoRandom, class S = StreamingStatistics>
     class MakeMCDiscreteArithmeticASEngine_2 {
       public:
         explicit MakeMCDiscreteArithmeticASEngine_2(
@@ -153,6 +823,16 @@ namespace QuantLib {
         MakeMCDiscreteArithmeticASEngine_2& withSeed(BigNatural seed);
         MakeMCDiscreteArithmeticASEngine_2& withAntitheticVariate(bool b = true);
         MakeMCDiscreteArithmeticASEngine_2& withConstantParameters(bool b);
+        MakeMCDiscreteArithmeticASEngine_2& withParameterMode(ProcessParameters::Mode mode);
+        MakeMCDiscreteArithmeticASEngine_2& withThreads(Size threads);
+        MakeMCDiscreteArithmeticASEngine_2& withBatchSimulation(bool b = true);
+        MakeMCDiscreteArithmeticASEngine_2& withTimeBudget(std::chrono::microseconds budget);
+        MakeMCDiscreteArithmeticASEngine_2& withGreeks(bool b = true);
+        MakeMCDiscreteArithmeticASEngine_2& withControlVariate(bool b = true);
+        //! simulates only the given block of samples of the run
+        MakeMCDiscreteArithmeticASEngine_2& withSampleBlock(Size firstSample, Size samples);
+        //! paths and payoff in single precision, with constant parameters
+        MakeMCDiscreteArithmeticASEngine_2& withSinglePrecision(bool b = true);
         // Conversion to pricing engine
         operator ext::shared_ptr<PricingEngine>() const;
       private:
@@ -163,7 +843,14 @@ namespace QuantLib {
         Real tolerance_ = Null<Real>();
         bool brownianBridge_ = true;
         BigNatural seed_ = 0;
-        bool constantParameters_ = false;
+        ProcessParameters::Mode parameterMode_ = ProcessParameters::Full;
+        Size threads_ = Null<Size>();
+        bool batchSimulation_ = false;
+        std::chrono::microseconds timeBudget_ = std::chrono::microseconds::zero();
+        bool greeks_ = false;
+        bool controlVariate_ = false;
+        Size firstSample_ = Null<Size>();
+        bool singlePrecision_ = false;
     };
 
     template <class RNG, class S>
@@ -220,7 +907,69 @@ namespace QuantLib {
     template <class RNG, class S>
     inline MakeMCDiscreteArithmeticASEngine_2<RNG,S>&
     MakeMCDiscreteArithmeticASEngine_2<RNG,S>::withConstantParameters(bool b) {
-        constantParameters_ = b;
+        parameterMode_ = b ? ProcessParameters::Constant : ProcessParameters::Full;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCDiscreteArithmeticASEngine_2<RNG,S>&
+    MakeMCDiscreteArithmeticASEngine_2<RNG,S>::withParameterMode(ProcessParameters::Mode mode) {
+        parameterMode_ = mode;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCDiscreteArithmeticASEngine_2<RNG,S>&
+    MakeMCDiscreteArithmeticASEngine_2<RNG,S>::withThreads(Size threads) {
+        QL_REQUIRE(threads > 0, "at least one thread is required");
+        QL_REQUIRE(RNG::allowsErrorEstimate,
+                   "chosen random generator policy does not provide independent substreams");
+        threads_ = threads;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCDiscreteArithmeticASEngine_2<RNG,S>&
+    MakeMCDiscreteArithmeticASEngine_2<RNG,S>::withBatchSimulation(bool b) {
+        batchSimulation_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCDiscreteArithmeticASEngine_2<RNG,S>&
+    MakeMCDiscreteArithmeticASEngine_2<RNG,S>::withTimeBudget(std::chrono::microseconds budget) {
+        QL_REQUIRE(budget > std::chrono::microseconds::zero(),
+                   "time budget must be positive");
+        timeBudget_ = budget;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCDiscreteArithmeticASEngine_2<RNG,S>&
+    MakeMCDiscreteArithmeticASEngine_2<RNG,S>::withGreeks(bool b) {
+        greeks_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCDiscreteArithmeticASEngine_2<RNG,S>&
+    MakeMCDiscreteArithmeticASEngine_2<RNG,S>::withControlVariate(bool b) {
+        controlVariate_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCDiscreteArithmeticASEngine_2<RNG,S>&
+    MakeMCDiscreteArithmeticASEngine_2<RNG,S>::withSampleBlock(Size firstSample, Size samples) {
+        QL_REQUIRE(firstSample != Null<Size>(), "null first sample");
+        firstSample_ = firstSample;
+        return withSamples(samples);
+    }
+
+    template <class RNG, class S>
+    inline MakeMCDiscreteArithmeticASEngine_2<RNG,S>&
+    MakeMCDiscreteArithmeticASEngine_2<RNG,S>::withSinglePrecision(bool b) {
+        singlePrecision_ = b;
         return *this;
     }
 
@@ -235,7 +984,129 @@ namespace QuantLib {
                                                       tolerance_,
                                                       maxSamples_,
                                                       seed_,
-                                                      constantParameters_));
+                                                      parameterMode_,
+                                                      threads_,
+                                                      batchSimulation_,
+                                                      timeBudget_,
+                                                      greeks_,
+                                                      controlVariate_,
+                                                      firstSample_,
+                                                      singlePrecision_));
+    }
+
+
+    inline ArithmeticASOBatchPathPricer_2::ArithmeticASOBatchPathPricer_2(
+                                                            Option::Type type,
+                                                            DiscountFactor discount,
+                                                            Real runningSum,
+                                                            Size pastFixings)
+    : sign_(type == Option::Call ? 1.0 : -1.0), discount_(discount),
+      runningSum_(runningSum), pastFixings_(pastFixings) {}
+
+    inline void ArithmeticASOBatchPathPricer_2::operator()(const PathBlock& paths,
+                                                           Real* values) const {
+        Size n = paths.length();
+        QL_REQUIRE(n>1, "the path cannot be empty");
+        // same fixings as ArithmeticASOPathPricer
+        Size first = paths.timeGrid().mandatoryTimes()[0] == 0.0 ? 0 : 1;
+        Real sum[batchLanes];
+        std::fill(sum, sum + batchLanes, runningSum_);
+        for (Size i=first; i<n; ++i) {
+            const Real* x = paths[i];
+            for (Size j=0; j<batchLanes; ++j)
+                sum[j] += x[j];
+        }
+        Real fixings = static_cast<Real>(pastFixings_ + n - first);
+        const Real* x = paths.back();
+        for (Size j=0; j<batchLanes; ++j)
+            values[j] = discount_ * std::max(sign_ * (x[j] - sum[j] / fixings), 0.0);
+    }
+
+
+    template <Option::Type Type, class T>
+    inline ArithmeticASOPathKernel_2<Type,T>::ArithmeticASOPathKernel_2(
+                                                   DiscountFactor discount,
+                                                   const TimeGrid& timeGrid,
+                                                   Real runningSum,
+                                                   Size pastFixings)
+    : discount_(discount),
+      runningSum_(runningSum),
+      fixingAtStart_(timeGrid.mandatoryTimes()[0] == 0.0),
+      fixings_(static_cast<Real>(pastFixings + timeGrid.size()
+                                 - (fixingAtStart_ ? 0 : 1))) {
+        QL_REQUIRE(timeGrid.size() > 1, "the path cannot be empty");
+    }
+
+
+    template <Option::Type Type>
+    inline ArithmeticASOPathPricer_2<Type>::ArithmeticASOPathPricer_2(DiscountFactor discount,
+                                                                      Real runningSum,
+                                                                      Size pastFixings)
+    : discount_(discount), runningSum_(runningSum), pastFixings_(pastFixings) {}
+
+    template <Option::Type Type>
+    inline Real ArithmeticASOPathPricer_2<Type>::operator()(const Path& path) const {
+        Size n = path.length();
+        QL_REQUIRE(n>1, "the path cannot be empty");
+        Real averageStrike;
+        if (path.timeGrid().mandatoryTimes()[0] == 0.0)
+            averageStrike = std::accumulate(path.begin(), path.end(), runningSum_)
+                / (pastFixings_ + n);
+        else
+            averageStrike = std::accumulate(path.begin()+1, path.end(), runningSum_)
+                / (pastFixings_ + n - 1);
+        return discount_ * vanillaPayoff<Type>(path.back(), averageStrike);
+    }
+
+
+    inline GeometricASOPathPricer_2::GeometricASOPathPricer_2(Option::Type type,
+                                                              DiscountFactor discount)
+    : sign_(type == Option::Call ? 1.0 : -1.0), discount_(discount) {}
+
+    inline Real GeometricASOPathPricer_2::operator()(const Path& path) const {
+        Size n = path.length();
+        QL_REQUIRE(n>1, "the path cannot be empty");
+        Size first = path.timeGrid().mandatoryTimes()[0] == 0.0 ? 0 : 1;
+        Real logSum = 0.0;
+        for (Size i=first; i<n; ++i)
+            logSum += std::log(path[i]);
+        Real average = std::exp(logSum / static_cast<Real>(n - first));
+        return discount_ * std::max(sign_ * (path.back() - average), 0.0);
+    }
+
+
+    inline ArithmeticASOGreeksPathPricer_2::ArithmeticASOGreeksPathPricer_2(
+                                            Option::Type type,
+                                            DiscountFactor discount,
+                                            const ConstantPathDerivatives& derivatives,
+                                            Real runningSum,
+                                            Size pastFixings)
+    : sign_(type == Option::Call ? 1.0 : -1.0), discount_(discount),
+      derivatives_(derivatives), runningSum_(runningSum), pastFixings_(pastFixings) {}
+
+    inline PathGreeks ArithmeticASOGreeksPathPricer_2::operator()(const Path& path) const {
+        Size n = path.length();
+        QL_REQUIRE(n>1, "the path cannot be empty");
+        const TimeGrid& grid = path.timeGrid();
+        Real sum = runningSum_;
+        for (Size i=1; i<n; ++i)
+            sum += path[i];
+        Real fixings = static_cast<Real>(pastFixings_ + n - 1);
+        Real x = path.back();
+        PathGreeks greeks;
+        if (sign_ * (x - sum / fixings) > 0.0) {
+            // the past fixings do not depend on the initial value
+            Real sumDelta = 0.0, sumVega = 0.0;
+            for (Size i=1; i<n; ++i) {
+                sumDelta += derivatives_.delta(path[i]);
+                sumVega += derivatives_.vega(path[i], grid[i]);
+            }
+            greeks.value = discount_ * sign_ * (x - sum / fixings);
+            greeks.delta = discount_ * sign_ * (derivatives_.delta(x) - sumDelta / fixings);
+            greeks.vega = discount_ * sign_ * (derivatives_.vega(x, grid.back()) - sumVega / fixings);
+            greeks.gamma = derivatives_.gamma(greeks.delta, path[1], grid[1]);
+        }
+        return greeks;
     }
 
 }
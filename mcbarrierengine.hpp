@@ -29,12 +29,137 @@
 #include <ql/exercise.hpp>
 #include <ql/instruments/barrieroption.hpp>
 #include <ql/pricingengines/mcsimulation.hpp>
+#include <ql/pricingengines/barrier/analyticbarrierengine.hpp>
 #include <ql/pricingengines/barrier/mcbarrierengine.hpp>
 #include <ql/processes/blackscholesprocess.hpp>
+#include "mcparallelsimulation.hpp"
+#include "pathgenerator.hpp"
+#include "processparameters.hpp"
+#include "batchmontecarlomodel.hpp"
+#include "fusedmontecarlomodel.hpp"
+#include "multilevelmontecarlo.hpp"
+#include "rqmcsimulation.hpp"
+#include "multiinstrumentsimulation.hpp"
+#include "mcgreeks.hpp"
+#include "mcinstrumentation.hpp"
+#include "mcpartialresults.hpp"
+#include "streamingstatistics.hpp"
+#include "payoffdispatch.hpp"
+#include <chrono>
 #include <utility>
 
 namespace QuantLib {
 
+    //! crossing constants and discount factors of a constant process on a time grid
+    struct ConstantBarrierGridData {
+        ConstantBarrierGridData(const ConstantBlackScholesProcess& process,
+                                const TimeGrid& grid);
+        std::vector<Real> crossingFactors;
+        std::vector<DiscountFactor> discounts;
+    };
+
+
+    //! payoff of ConstantBarrierPathPricer_2 as a kernel of FusedMonteCarloModel
+    /*! The uniforms of the Brownian bridges are drawn when a path
+        starts.  Once the barrier is hit, a knock-out option stops the
+        path, while a knock-in option only keeps its last value.  The
+        path, the crossings and the payoff are computed in the
+        precision \c T; the uniforms are drawn in double precision.
+        The barrier and option types are template arguments, so that
+        the steps and the payoff do not test them.
+    */
+    template <Barrier::Type BarrierType, Option::Type Type, class T = Real>
+    class ConstantBarrierPathKernel_2 {
+      public:
+        typedef T real_type;
+        typedef ConstantBarrierGridData GridData;
+        struct state_type {
+            T distance, last;
+            const Real* uniforms;
+            Size knockNode;
+        };
+        ConstantBarrierPathKernel_2(Real barrier,
+                                    Real rebate,
+                                    Real strike,
+                                    ext::shared_ptr<const GridData> gridData,
+                                    PseudoRandom::ursg_type sequenceGen);
+        state_type initialState(T x0) const;
+        bool update(state_type& state, Size i, T x) const;
+        Real value(const state_type& state) const;
+        //! number of nodes of the paths
+        Size nodes() const { return gridData_->discounts.size(); }
+      private:
+        T logBarrier_;
+        Real rebate_;
+        T strike_;
+        ext::shared_ptr<const GridData> gridData_;
+        mutable PseudoRandom::ursg_type sequenceGen_;
+    };
+
+
+    //! Brownian-bridge barrier path pricer for constant parameters
+    /*! Same as BarrierPathPricer_2 for the paths of a
+        ConstantBlackScholesProcess, without querying the process.
+        With \f$ d_i = \log(S_i / H) \f$, the Brownian bridge between
+        two nodes crosses the barrier \f$ H \f$ if
+        \f[
+            \log u \leq -\frac{2 d_i d_{i+1}}{\sigma^2 \Delta t_i},
+        \f]
+        which is equivalent to comparing its extremum as computed by
+        BarrierPathPricer_2 to the barrier.  The constants
+        \f$ -2 / (\sigma^2 \Delta t_i) \f$ and the discount factors
+        at the nodes are computed once for the grid and shared by the
+        pricers built from the same GridData; the path is read until
+        its payoff is known.  The payoff is computed by
+        ConstantBarrierPathKernel_2.
+    */
+    template <Barrier::Type BarrierType, Option::Type Type>
+    class ConstantBarrierPathPricer_2 : public PathPricer<Path> {
+      public:
+        typedef ConstantBarrierGridData GridData;
+        ConstantBarrierPathPricer_2(Real barrier,
+                                    Real rebate,
+                                    Real strike,
+                                    ext::shared_ptr<const GridData> gridData,
+                                    PseudoRandom::ursg_type sequenceGen);
+        Real operator()(const Path& path) const override;
+      private:
+        ConstantBarrierPathKernel_2<BarrierType,Type> kernel_;
+    };
+
+
+    //! barrier payoff monitored at the nodes of the grid only
+    /*! Same payoff as BiasedBarrierPathPricer, with the interface of
+        the kernels of FusedMonteCarloModel: the barrier is only
+        checked at the nodes, so that the price is the one of an
+        option monitored at the dates of the grid.  On each level of
+        a multilevel simulation, the coarse path is then monitored at
+        half of the dates of the fine one.
+    */
+    class DiscreteBarrierPathKernel_2 {
+      public:
+        struct state_type {
+            Real last;
+            Size knockNode;
+        };
+        DiscreteBarrierPathKernel_2(Barrier::Type barrierType,
+                                    Real barrier,
+                                    Real rebate,
+                                    Option::Type type,
+                                    Real strike,
+                                    std::vector<DiscountFactor> discounts);
+        state_type initialState(Real x0) const { return { x0, Null<Size>() }; }
+        bool update(state_type& state, Size i, Real x) const;
+        Real value(const state_type& state) const;
+      private:
+        bool up_, in_;
+        Real barrier_;
+        Real rebate_;
+        Real sign_, strike_;
+        std::vector<DiscountFactor> discounts_;
+    };
+
+
     //! Pricing engine for barrier options using Monte Carlo simulation
     /*! Uses the Brownian-bridge correction for the barrier found in
         <i>
@@ -49,18 +174,103 @@ namespace QuantLib {
         Journal of Derivatives; Winter 1998; 6, 2; pg. 65-83
         </i>
 
+        With a time budget, samples are added in batches until the
+        budget is spent, or until the tolerance or the number of
+        samples, if also given, is reached; the number of samples
+        used is returned as the "samples" additional result.
+
+        With tabulated parameters, the paths and the crossing
+        probabilities are the ones of the given process, but its
+        drift and diffusion are read once per node of the time grid
+        (see TabulatedBlackScholesProcess).
+
+        With constant parameters, the crossing probabilities are
+        computed by ConstantBarrierPathPricer_2, and the uniforms of
+        the Brownian bridges are drawn from a substream of the engine
+        seed instead of the fixed seed of the original engine.  Unless
+        a control variate, the Greeks, batch simulation or the biased
+        pricer are required, each path is priced while it is
+        generated, and a knock-out option stops evolving it once the
+        barrier is hit (see FusedMonteCarloModel); the results are the
+        same.  These paths, the crossings and the payoff can also be
+        computed in single precision, with the samples still
+        accumulated in double precision.
+
+        With constant parameters, the biased pricer and more than one
+        level, the engine runs a multilevel simulation (see
+        MultilevelMcSimulation) up to the required tolerance: the
+        finest level uses the time grid of the engine, and each
+        coarser level every other node of the next one.  The barrier
+        is monitored at the nodes of each grid (see
+        DiscreteBarrierPathKernel_2), so that the coarse levels are
+        biased and the estimate is the price of the option monitored
+        at the dates of the finest grid, e.g., daily; the unbiased
+        pricer has the same expectation on every grid and needs no
+        finer levels.  The number of samples, the
+        variance of the samples and their cost in simulated steps are
+        returned for each level, from the coarsest, as the
+        "levelSamples", "levelVariances" and "levelCosts" additional
+        results, together with the number of steps of each level as
+        "levelSteps".
+
+        With constant parameters, the paths can also be sampled by
+        importance with a drift of the Brownian motion (see
+        FusedMonteCarloModel), either given or chosen automatically.
+        In the latter case, the drift taking the median terminal value
+        to the barrier for knock-in options, or to the strike for
+        knock-out options out of the money unless that moves the paths
+        towards the barrier, is scaled by a few fractions, which are
+        tried on a short pilot run; the one with the smallest variance
+        is used (see pilotDrift).  The drift used is returned as the
+        "importanceDrift" additional result.
+
+        With constant parameters, delta, gamma and vega can be
+        computed on the same paths as the value, together with their
+        error estimates ("deltaErrorEstimate", "gammaErrorEstimate"
+        and "vegaErrorEstimate" additional results).  Since the payoff
+        jumps at the barrier, they are likelihood-ratio estimates; see
+        BarrierGreeksPathPricer_2.
+
+        With a control variate, the option with a continuously
+        monitored barrier is priced on paths of the process with the
+        extracted constant parameters, drawn from the same random
+        numbers and bridge uniforms, and corrected by its analytic
+        price.  Since the analytic formula pays the rebate of
+        knock-out options when the barrier is hit, whereas the
+        simulation pays it at the next node, the control variate of
+        knock-out options has no rebate.  With constant parameters,
+        the control variate is only available with the biased pricer,
+        since the unbiased one prices the same paths as the control
+        variate and would return its analytic price with a null error
+        estimate.
+
+        When compiled with \c MONTECARLO_ENABLE_INSTRUMENTATION, the
+        counters and phase times of the calculation are also returned
+        as additional results (see McInstrumentation).
+
+        The samples are accumulated by default in StreamingStatistics,
+        whose memory does not grow with their number; Statistics can
+        be given as the accumulator to keep them all.
+
+        Given the first of a block of samples, only the samples of the
+        block are simulated, with the chunk substreams and bridge
+        uniforms of a multi-threaded run with the same seed; the
+        accumulator of the block is also returned as the
+        "partialResult" additional result (see McPartialResult).
+
         \ingroup barrierengines
 
         \test the correctness of the returned value is tested by
               reproducing results available in literature.
     */
-    template <class RNG = PseudoRandom, class S = Statistics>
+    template <class RNG = PseudoRandom, class S = StreamingStatistics>
     class MCBarrierEngine_2 : public BarrierOption::engine,
-                              public McSimulation<SingleVariate,RNG,S> {
+                              public McSimulation<SingleVariate_2,RNG,S>,
+                              public SharedPathEngine_2<RNG> {
       public:
-        typedef typename McSimulation<SingleVariate,RNG,S>::path_generator_type path_generator_type;
-        typedef typename McSimulation<SingleVariate,RNG,S>::path_pricer_type    path_pricer_type;
-        typedef typename McSimulation<SingleVariate,RNG,S>::stats_type            stats_type;
+        typedef typename McSimulation<SingleVariate_2,RNG,S>::path_generator_type path_generator_type;
+        typedef typename McSimulation<SingleVariate_2,RNG,S>::path_pricer_type    path_pricer_type;
+        typedef typename McSimulation<SingleVariate_2,RNG,S>::stats_type            stats_type;
         // constructor
         MCBarrierEngine_2(ext::shared_ptr<GeneralizedBlackScholesProcess> process,
                           Size timeSteps,
@@ -72,46 +282,384 @@ namespace QuantLib {
                           Size maxSamples,
                           bool isBiased,
                           BigNatural seed,
-                          bool constantParameters);
+                          ProcessParameters::Mode parameterMode,
+                          Size threads = Null<Size>(),
+                          bool batchSimulation = false,
+                          std::chrono::microseconds timeBudget =
+                                             std::chrono::microseconds::zero(),
+                          bool greeks = false,
+                          bool controlVariate = false,
+                          Size levels = 1,
+                          bool importanceSampling = false,
+                          Real importanceDrift = Null<Real>(),
+                          Size firstSample = Null<Size>(),
+                          bool singlePrecision = false);
         void calculate() const override {
+            MONTECARLO_INSTRUMENT(results_.additionalResults);
             Real spot = process_->x0();
             QL_REQUIRE(spot > 0.0, "negative or null underlying given");
             QL_REQUIRE(!triggered(spot), "barrier touched");
-            McSimulation<SingleVariate,RNG,S>::calculate(requiredTolerance_,
-                                                         requiredSamples_,
-                                                         maxSamples_);
-            results_.value = this->mcModel_->sampleAccumulator().mean();
-            if (RNG::allowsErrorEstimate)
-                results_.errorEstimate =
-                    this->mcModel_->sampleAccumulator().errorEstimate();
+            if (firstSample_ != Null<Size>()) {
+                QL_REQUIRE(levels_ == 1,
+                           "multilevel simulation not available with blocks of samples");
+                QL_REQUIRE(!greeks_, "Greeks not available with blocks of samples");
+                detail::checkSampleBlock<S,RNG>(requiredSamples_, requiredTolerance_,
+                                                timeBudget_, seed_);
+            }
+            if (singlePrecision_) {
+                QL_REQUIRE(parameterMode_ == ProcessParameters::Constant,
+                           "single precision requires constant parameters");
+                QL_REQUIRE(levels_ == 1,
+                           "multilevel simulation not available in single precision");
+                QL_REQUIRE(!isBiased_, "biased pricer not available in single precision");
+                QL_REQUIRE(!greeks_, "Greeks not available in single precision");
+                QL_REQUIRE(!batchSimulation_,
+                           "batch simulation not available in single precision");
+                QL_REQUIRE(!this->controlVariate_,
+                           "control variate not available in single precision");
+            }
+            // with constant parameters, the unbiased pricer prices the
+            // paths of the control variate itself
+            QL_REQUIRE(!this->controlVariate_ ||
+                       parameterMode_ != ProcessParameters::Constant || isBiased_,
+                       "control variate not available with constant parameters "
+                       "and unbiased pricer");
+            if (levels_ > 1) {
+                simulateMultilevel();
+                return;
+            }
+            if (importanceSampling_) {
+                QL_REQUIRE(parameterMode_ == ProcessParameters::Constant,
+                           "importance sampling requires constant parameters");
+                QL_REQUIRE(!isBiased_, "importance sampling not available with biased pricer");
+                QL_REQUIRE(!greeks_, "Greeks not available with importance sampling");
+                QL_REQUIRE(!batchSimulation_,
+                           "batch simulation not available with importance sampling");
+                QL_REQUIRE(!this->controlVariate_,
+                           "control variate not available with importance sampling");
+            }
+            if (greeks_) {
+                QL_REQUIRE(parameterMode_ == ProcessParameters::Constant,
+                           "Greeks require constant parameters");
+                QL_REQUIRE(!batchSimulation_, "Greeks not available with batch simulation");
+                QL_REQUIRE(!this->controlVariate_, "Greeks not available with control variate");
+                auto factory = [this](BigNatural seed) {
+                    return ext::make_shared<greeks_model_type>(
+                        pathGenerator(seed), greeksPathPricer(substreamSeed(seed, 0)),
+                        GreeksStatistics<S>(), this->antitheticVariate_);
+                };
+                if (QmcRandomizations<RNG>::value > 0) {
+                    RandomizedQmcSimulation<greeks_model_type> simulation(
+                        factory, QmcRandomizations<RNG>::value,
+                        threads_ != Null<Size>() ? threads_ : 1, seed_);
+                    simulate(simulation);
+                } else if (threads_ == Null<Size>()) {
+                    // same streams as the single-threaded pricing
+                    SequentialMcSimulation<greeks_model_type> simulation(
+                        ext::make_shared<greeks_model_type>(
+                            pathGenerator(), greeksPathPricer(bridgeSeed()),
+                            GreeksStatistics<S>(), this->antitheticVariate_));
+                    simulate(simulation);
+                } else {
+                    ParallelMcSimulation<SingleVariateGreeks_2,RNG,GreeksStatistics<S> >
+                        simulation(factory, threads_, seed_);
+                    simulate(simulation);
+                }
+                return;
+            }
+            if (batchSimulation_) {
+                QL_REQUIRE(!this->controlVariate_,
+                           "control variate not available with batch simulation");
+                QL_REQUIRE(parameterMode_ != ProcessParameters::Full,
+                           "batch simulation requires constant, "
+                           "piecewise-constant or tabulated parameters");
+                auto factory = [this](BigNatural seed) {
+                    return ext::make_shared<batch_model_type>(
+                        batchPathGenerator(seed), batchPathPricer(substreamSeed(seed, 0)),
+                        S(), this->antitheticVariate_);
+                };
+                if (QmcRandomizations<RNG>::value > 0) {
+                    RandomizedQmcSimulation<batch_model_type> simulation(
+                        factory, QmcRandomizations<RNG>::value,
+                        threads_ != Null<Size>() ? threads_ : 1, seed_);
+                    simulate(simulation);
+                    return;
+                }
+                ParallelMcSimulation<SingleVariate_2,RNG,S,batch_model_type> simulation(
+                    factory, threads_ != Null<Size>() ? threads_ : 1, seed_, firstSample());
+                simulate(simulation);
+                return;
+            }
+            if (!this->controlVariate_ &&
+                parameterMode_ == ProcessParameters::Constant && !isBiased_) {
+                // no need to store the paths; the kernel is
+                // instantiated for the barrier and option types
+                ext::shared_ptr<PlainVanillaPayoff> payoff =
+                    ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+                QL_REQUIRE(payoff, "non-plain payoff given");
+                dispatchBarrierType(arguments_.barrierType, payoff->optionType(),
+                                    [&](auto barrierType, auto type) {
+                    constexpr Barrier::Type BarrierType = decltype(barrierType)::value;
+                    constexpr Option::Type Type = decltype(type)::value;
+                    Real drift = importanceDrift<BarrierType,Type>();
+                    if (singlePrecision_)
+                        simulateFused<BarrierType,Type,float>(drift);
+                    else
+                        simulateFused<BarrierType,Type,Real>(drift);
+                    if (importanceSampling_)
+                        results_.additionalResults["importanceDrift"] = drift;
+                });
+                return;
+            }
+            // the analytic value of the control variate and the grid
+            // data of the constant-parameter pricers are computed once
+            Real cvValue = this->controlVariate_ ? this->controlVariateValue() : 0.0;
+            ext::shared_ptr<const ConstantBarrierGridData> gridData;
+            if (parameterMode_ == ProcessParameters::Constant || this->controlVariate_)
+                gridData = constantGridData();
+            auto model = [this, cvValue, gridData](BigNatural seed, BigNatural bridgeSeed) {
+                return ext::make_shared<MonteCarloModel_2<SingleVariate_2,RNG,S> >(
+                    pathGenerator(seed), pathPricer(bridgeSeed, gridData), S(),
+                    this->antitheticVariate_,
+                    this->controlVariate_ ? controlPathPricer(bridgeSeed, gridData)
+                                          : ext::shared_ptr<path_pricer_type>(),
+                    cvValue,
+                    this->controlVariate_ ? controlPathGenerator(seed)
+                                          : ext::shared_ptr<path_generator_type>());
+            };
+            if (threads_ == Null<Size>() && firstSample_ == Null<Size>() &&
+                QmcRandomizations<RNG>::value == 0) {
+                // single stream, as in McSimulation, with reused path storage
+                SequentialMcSimulation<MonteCarloModel_2<SingleVariate_2,RNG,S> > simulation(
+                    model(seed_, bridgeSeed()));
+                simulate(simulation);
+                return;
+            }
+
+            // set up the lazy local volatility before sharing the process among threads
+            process_->localVolatility();
+            // the pricers draw their own uniforms, so each chunk gets its own
+            auto factory = [model](BigNatural seed) {
+                return model(seed, substreamSeed(seed, 0));
+            };
+            if (QmcRandomizations<RNG>::value > 0) {
+                // independent randomizations of the same point set
+                RandomizedQmcSimulation<MonteCarloModel_2<SingleVariate_2,RNG,S> > simulation(
+                    factory, QmcRandomizations<RNG>::value,
+                    threads_ != Null<Size>() ? threads_ : 1, seed_);
+                simulate(simulation);
+                return;
+            }
+            ParallelMcSimulation<SingleVariate_2,RNG,S> simulation(
+                factory, threads_ != Null<Size>() ? threads_ : 1, seed_, firstSample());
+            simulate(simulation);
+        }
+        // SharedPathEngine_2 interface
+        ext::shared_ptr<GeneralizedBlackScholesProcess> sharedProcess() const override {
+            return process_;
+        }
+        ProcessParameters::Mode sharedParameterMode() const override { return parameterMode_; }
+        BigNatural sharedSeed() const override { return seed_; }
+        Real sharedStrike() const override {
+            // the paths of full and tabulated parameters do not depend on it
+            if (parameterMode_ == ProcessParameters::Full ||
+                parameterMode_ == ProcessParameters::Tabulated)
+                return Null<Real>();
+            ext::shared_ptr<PlainVanillaPayoff> payoff =
+                ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+            QL_REQUIRE(payoff, "non-plain payoff given");
+            return payoff->strike();
+        }
+        TimeGrid sharedTimeGrid() const override { return timeGrid(); }
+        ext::shared_ptr<path_generator_type> sharedPathGenerator(BigNatural seed) const override {
+            // set up the lazy local volatility before the paths are drawn on other threads
+            process_->localVolatility();
+            return pathGenerator(seed);
+        }
+        ext::shared_ptr<path_pricer_type> sharedPathPricer(BigNatural seed,
+                                                           bool singleStream) const override {
+            // same bridge uniforms as in the sequential or multi-threaded simulation
+            return pathPricer(singleStream ? bridgeSeed() : substreamSeed(seed, 0));
         }
       protected:
+        typedef BatchMonteCarloModel<typename SingleVariate_2<RNG>::rsg_type,S> batch_model_type;
         // McSimulation implementation
         TimeGrid timeGrid() const override;
         ext::shared_ptr<path_generator_type> pathGenerator() const override {
+            return pathGenerator(seed_);
+        }
+        ext::shared_ptr<path_generator_type> pathGenerator(BigNatural seed) const {
             TimeGrid grid = timeGrid();
-            typename RNG::rsg_type gen = RNG::make_sequence_generator(grid.size()-1, seed_);
-            if (constantParameters_) {
-                // On extrait les paramètres du process pour construire un processus constant.
-                ext::shared_ptr<GeneralizedBlackScholesProcess> bsProcess =
-                    ext::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(process_);
-                Time t = grid.back();
-                Real strike = ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff)->strike();
-                Real riskFreeRate = bsProcess->riskFreeRate()->zeroRate(t, Continuous);
-                Real dividendYield = bsProcess->dividendYield()->zeroRate(t, Continuous);
-                Real volatility = bsProcess->blackVolatility()->blackVol(t, strike);
-                Real underlying = bsProcess->x0();
-                // Création d'un ConstantBlackScholesProcess avec les paramètres extraits.
-                ext::shared_ptr<ConstantBlackScholesProcess> cstProcess(
-                    new ConstantBlackScholesProcess(underlying, riskFreeRate, volatility, dividendYield));
-                return ext::shared_ptr<path_generator_type>(
-                    new path_generator_type(cstProcess, grid, gen, brownianBridge_));
+            typename SingleVariate_2<RNG>::rsg_type gen =
+                SingleVariate_2<RNG>::make_sequence_generator(grid.size()-1, seed);
+            return ext::shared_ptr<path_generator_type>(
+                new path_generator_type(simulatedProcess(), grid, gen, brownianBridge_));
+        }
+        ext::shared_ptr<path_pricer_type> pathPricer() const override {
+            return pathPricer(bridgeSeed());
+        }
+        /*! with constant parameters and no bias, the given grid data
+            are used if any, and computed otherwise
+        */
+        ext::shared_ptr<path_pricer_type> pathPricer(
+            BigNatural bridgeSeed,
+            const ext::shared_ptr<const ConstantBarrierGridData>& gridData =
+                ext::shared_ptr<const ConstantBarrierGridData>()) const;
+        // seed of the bridge uniforms along the single stream: the one of
+        // the original engine, or a substream of the engine seed with
+        // constant parameters (a null seed draws a random one)
+        BigNatural bridgeSeed() const {
+            if (parameterMode_ != ProcessParameters::Constant)
+                return 5;
+            return seed_ != 0 ? substreamSeed(seed_, 0) : 0;
+        }
+        // variances and discount factors of the constant process on the grid
+        ext::shared_ptr<const ConstantBarrierGridData> constantGridData() const {
+            return ext::make_shared<ConstantBarrierGridData>(
+                *constantProcess(), timeGrid());
+        }
+        // simulated process and batch simulation
+        ext::shared_ptr<StochasticProcess1D> simulatedProcess() const {
+            switch (parameterMode_) {
+              case ProcessParameters::Full:
+                return process_;
+              case ProcessParameters::Constant:
+                return constantProcess();
+              case ProcessParameters::Piecewise: {
+                ext::shared_ptr<PlainVanillaPayoff> payoff =
+                    ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+                QL_REQUIRE(payoff, "non-plain payoff given");
+                return makePiecewiseConstantBlackScholesProcess(
+                    process_, timeGrid(), payoff->strike());
+              }
+              case ProcessParameters::Tabulated:
+                return makeTabulatedBlackScholesProcess(process_, timeGrid());
+              default:
+                QL_FAIL("unknown parameter mode");
+            }
+        }
+        ext::shared_ptr<ConstantBlackScholesProcess> constantProcess() const {
+            // On extrait les paramètres du process pour construire un processus constant.
+            Time t = timeGrid().back();
+            ext::shared_ptr<PlainVanillaPayoff> payoff =
+                ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+            QL_REQUIRE(payoff, "non-plain payoff given");
+            Real strike = payoff->strike();
+            // Paramètres mis en cache et partagés avec les autres moteurs.
+            return makeConstantBlackScholesProcess(process_, t, strike);
+        }
+        ext::shared_ptr<typename batch_model_type::path_generator_type>
+        batchPathGenerator(BigNatural seed) const {
+            TimeGrid grid = timeGrid();
+            typename SingleVariate_2<RNG>::rsg_type gen =
+                SingleVariate_2<RNG>::make_sequence_generator(grid.size()-1, seed);
+            return ext::make_shared<typename batch_model_type::path_generator_type>(
+                simulatedProcess(), grid, gen, brownianBridge_);
+        }
+        ext::shared_ptr<BatchPathPricer> batchPathPricer(BigNatural bridgeSeed) const;
+        // simulation pricing the paths while they are generated
+        template <Barrier::Type BarrierType, Option::Type Type, class T = Real>
+        using fused_model_type =
+            FusedMonteCarloModel<typename SingleVariate_2<RNG>::rsg_type,
+                                 ConstantBarrierPathKernel_2<BarrierType,Type,T>,S>;
+        template <Barrier::Type BarrierType, Option::Type Type, class T>
+        ConstantBarrierPathKernel_2<BarrierType,Type,T> pathKernel(
+            BigNatural bridgeSeed,
+            const ext::shared_ptr<const ConstantBarrierGridData>& gridData) const;
+        // Brownian drift of the importance sampling, null if not used
+        template <Barrier::Type BarrierType, Option::Type Type>
+        Real importanceDrift() const;
+        // control variate: the continuous barrier option under the constant process
+        ext::shared_ptr<path_pricer_type> controlPathPricer() const override {
+            return controlPathPricer(bridgeSeed());
+        }
+        ext::shared_ptr<path_pricer_type> controlPathPricer(
+            BigNatural bridgeSeed,
+            const ext::shared_ptr<const ConstantBarrierGridData>& gridData =
+                ext::shared_ptr<const ConstantBarrierGridData>()) const;
+        ext::shared_ptr<path_generator_type> controlPathGenerator() const override {
+            return controlPathGenerator(seed_);
+        }
+        ext::shared_ptr<path_generator_type> controlPathGenerator(BigNatural seed) const {
+            // with constant parameters, the control variate uses the simulated paths
+            if (parameterMode_ == ProcessParameters::Constant)
+                return ext::shared_ptr<path_generator_type>();
+            TimeGrid grid = timeGrid();
+            typename SingleVariate_2<RNG>::rsg_type gen =
+                SingleVariate_2<RNG>::make_sequence_generator(grid.size()-1, seed);
+            return ext::shared_ptr<path_generator_type>(
+                new path_generator_type(constantProcess(), grid, gen, brownianBridge_));
+        }
+        ext::shared_ptr<PricingEngine> controlPricingEngine() const override {
+            return ext::make_shared<AnalyticBarrierEngine>(
+                makeFlatBlackScholesProcess(process_, *constantProcess()));
+        }
+        Real controlVariateValue() const override;
+        // rebate of the control variate, paid at expiry
+        Real controlRebate() const {
+            return arguments_.barrierType == Barrier::DownIn ||
+                   arguments_.barrierType == Barrier::UpIn ? arguments_.rebate : 0.0;
+        }
+        // simulation of the Greeks
+        typedef MonteCarloModel_2<SingleVariateGreeks_2,RNG,GreeksStatistics<S> >
+            greeks_model_type;
+        ext::shared_ptr<typename greeks_model_type::path_pricer_type>
+        greeksPathPricer(BigNatural bridgeSeed) const;
+        // multilevel simulation
+        typedef MultilevelMonteCarloModel<typename SingleVariate_2<RNG>::rsg_type,
+                                          DiscreteBarrierPathKernel_2,S>
+            multilevel_model_type;
+        void simulateMultilevel() const;
+        // runs the simulation and stores mean, error and samples used
+        template <class Simulation>
+        void simulate(const Simulation& simulation) const {
+            simulation.calculate(requiredTolerance_, requiredSamples_, maxSamples_,
+                                 timeBudget_);
+            detail::storeResults(simulation.sampleAccumulator(), results_,
+                                 RNG::allowsErrorEstimate);
+            results_.additionalResults["samples"] = simulation.samples();
+            if (firstSample_ != Null<Size>())
+                detail::storePartialResult(simulation.sampleAccumulator(), seed_,
+                                           firstSample_, results_);
+        }
+        // runs the simulation pricing the paths in the precision T;
+        // the grid data are shared
+        template <Barrier::Type BarrierType, Option::Type Type, class T>
+        void simulateFused(Real drift) const {
+            typedef fused_model_type<BarrierType,Type,T> model_type;
+            ext::shared_ptr<const ConstantBarrierGridData> gridData =
+                constantGridData();
+            ext::shared_ptr<StochasticProcess> process = simulatedProcess();
+            TimeGrid grid = timeGrid();
+            auto model = [this, gridData, process, grid, drift](BigNatural seed,
+                                                                BigNatural bridgeSeed) {
+                return ext::make_shared<model_type>(
+                    process, grid,
+                    SingleVariate_2<RNG>::make_sequence_generator(grid.size()-1, seed),
+                    brownianBridge_,
+                    pathKernel<BarrierType,Type,T>(bridgeSeed, gridData), S(),
+                    this->antitheticVariate_, drift);
+            };
+            auto factory = [model](BigNatural seed) {
+                return model(seed, substreamSeed(seed, 0));
+            };
+            if (QmcRandomizations<RNG>::value > 0) {
+                RandomizedQmcSimulation<model_type> simulation(
+                    factory, QmcRandomizations<RNG>::value,
+                    threads_ != Null<Size>() ? threads_ : 1, seed_);
+                simulate(simulation);
+            } else if (threads_ == Null<Size>() && firstSample_ == Null<Size>()) {
+                SequentialMcSimulation<model_type> simulation(model(seed_, bridgeSeed()));
+                simulate(simulation);
             } else {
-                return ext::shared_ptr<path_generator_type>(
-                    new path_generator_type(process_, grid, gen, brownianBridge_));
+                ParallelMcSimulation<SingleVariate_2,RNG,S,model_type> simulation(
+                    factory, threads_ != Null<Size>() ? threads_ : 1, seed_,
+                    firstSample());
+                simulate(simulation);
             }
         }
-        ext::shared_ptr<path_pricer_type> pathPricer() const override;
+        // first sample of the simulation, null if not a block
+        Size firstSample() const { return firstSample_ != Null<Size>() ? firstSample_ : 0; }
         // data members
         ext::shared_ptr<GeneralizedBlackScholesProcess> process_;
         Size timeSteps_, timeStepsPerYear_;
@@ -120,12 +668,21 @@ namespace QuantLib {
         bool isBiased_;
         bool brownianBridge_;
         BigNatural seed_;
-        bool constantParameters_;
+        ProcessParameters::Mode parameterMode_;
+        Size threads_;
+        bool batchSimulation_;
+        std::chrono::microseconds timeBudget_;
+        bool greeks_;
+        Size levels_;
+        bool importanceSampling_;
+        Real importanceDrift_;
+        Size firstSample_;
+        bool singlePrecision_;
     };
 
 
     //! Monte Carlo barrier-option engine factory
-    template <class RNG = PseudoRandom, class S = Statistics>
+    template <class RNG = PseudoRandom, class S = StreamingStatistics>
     class MakeMCBarrierEngine_2 {
       public:
         MakeMCBarrierEngine_2(ext::shared_ptr<GeneralizedBlackScholesProcess> process);
@@ -140,6 +697,19 @@ namespace QuantLib {
         MakeMCBarrierEngine_2& withBias(bool b = true);
         MakeMCBarrierEngine_2& withSeed(BigNatural seed);
         MakeMCBarrierEngine_2& withConstantParameters(bool b = true);
+        MakeMCBarrierEngine_2& withParameterMode(ProcessParameters::Mode mode);
+        MakeMCBarrierEngine_2& withThreads(Size threads);
+        MakeMCBarrierEngine_2& withBatchSimulation(bool b = true);
+        MakeMCBarrierEngine_2& withTimeBudget(std::chrono::microseconds budget);
+        MakeMCBarrierEngine_2& withGreeks(bool b = true);
+        MakeMCBarrierEngine_2& withControlVariate(bool b = true);
+        MakeMCBarrierEngine_2& withMultilevel(Size levels);
+        //! importance sampling with the given drift, or an automatic one if null
+        MakeMCBarrierEngine_2& withImportanceSampling(Real drift = Null<Real>());
+        //! simulates only the given block of samples of the run
+        MakeMCBarrierEngine_2& withSampleBlock(Size firstSample, Size samples);
+        //! paths and payoff in single precision, with constant parameters
+        MakeMCBarrierEngine_2& withSinglePrecision(bool b = true);
         // conversion to pricing engine
         operator ext::shared_ptr<PricingEngine>() const;
       private:
@@ -148,7 +718,131 @@ namespace QuantLib {
         Size steps_, stepsPerYear_, samples_, maxSamples_;
         Real tolerance_;
         BigNatural seed_ = 0;
-        bool constantParameters_ = false;
+        ProcessParameters::Mode parameterMode_ = ProcessParameters::Full;
+        Size threads_ = Null<Size>();
+        bool batchSimulation_ = false;
+        std::chrono::microseconds timeBudget_ = std::chrono::microseconds::zero();
+        bool greeks_ = false;
+        bool controlVariate_ = false;
+        Size levels_ = 1;
+        bool importanceSampling_ = false;
+        Real importanceDrift_ = Null<Real>();
+        Size firstSample_ = Null<Size>();
+        bool singlePrecision_ = false;
+    };
+
+
+    //! Brownian-bridge barrier path pricer
+    /*! Same as BarrierPathPricer, except that the uniforms used for
+        the crossing probabilities are read in place instead of being
+        copied for every path.
+    */
+    template <Barrier::Type BarrierType, Option::Type Type>
+    class BarrierPathPricer_2 : public PathPricer<Path> {
+      public:
+        BarrierPathPricer_2(Real barrier,
+                            Real rebate,
+                            Real strike,
+                            std::vector<DiscountFactor> discounts,
+                            ext::shared_ptr<StochasticProcess1D> diffProcess,
+                            PseudoRandom::ursg_type sequenceGen);
+        Real operator()(const Path& path) const override;
+      private:
+        Real barrier_;
+        Real rebate_;
+        ext::shared_ptr<StochasticProcess1D> diffProcess_;
+        mutable PseudoRandom::ursg_type sequenceGen_;
+        Real strike_;
+        std::vector<DiscountFactor> discounts_;
+    };
+
+
+    //! prices a block of paths with the Brownian-bridge barrier correction
+    /*! Same correction as BarrierPathPricer, evaluated in log space on
+        all the paths of the block at once.  The crossing probability
+        between two nodes uses the variance of the step the paths were
+        generated with.
+    */
+    class BarrierBatchPathPricer_2 : public BatchPathPricer {
+      public:
+        BarrierBatchPathPricer_2(Barrier::Type barrierType,
+                                 Real barrier,
+                                 Real rebate,
+                                 Option::Type type,
+                                 Real strike,
+                                 std::vector<DiscountFactor> discounts,
+                                 std::vector<Real> variances,
+                                 PseudoRandom::ursg_type sequenceGen);
+        void operator()(const PathBlock& paths, Real* values) const override;
+      private:
+        Barrier::Type barrierType_;
+        Real barrier_;
+        Real rebate_;
+        Real sign_, strike_;
+        std::vector<DiscountFactor> discounts_;
+        std::vector<Real> variances_;
+        mutable PseudoRandom::ursg_type sequenceGen_;
+        mutable std::vector<Real> logs_, uniforms_;
+    };
+
+
+    //! barrier payoff with likelihood-ratio delta, gamma and vega
+    /*! The derivatives are taken of the density of the simulated
+        variables, i.e., of the log-values at the nodes and, without
+        bias, of the extrema of the Brownian bridges between them,
+        which are drawn from the same uniforms as in
+        BarrierPathPricer_2.  The payoff does not depend on the
+        parameters once these variables are given, so that the
+        estimates are not affected by its jumps at the barrier.
+
+        Delta and gamma only involve the first step.  Since the range
+        of the extremum over the first step depends on the initial
+        value, the crossing over that step is not drawn: the estimate
+        averages the payoffs with and without crossing, weighted by
+        the crossing probability of the Brownian bridge.  This gives
+        the same expected value with a lower variance, but a slightly
+        different value per path than BarrierPathPricer_2.
+    */
+    class BarrierGreeksPathPricer_2 : public PathPricer<Path,PathGreeks> {
+      public:
+        BarrierGreeksPathPricer_2(Barrier::Type barrierType,
+                                  Real barrier,
+                                  Real rebate,
+                                  Option::Type type,
+                                  Real strike,
+                                  std::vector<DiscountFactor> discounts,
+                                  const ConstantPathDerivatives& derivatives,
+                                  bool isBiased,
+                                  PseudoRandom::ursg_type sequenceGen);
+        PathGreeks operator()(const Path& path) const override;
+      private:
+        Barrier::Type barrierType_;
+        Real barrier_;
+        Real rebate_;
+        Real sign_, strike_;
+        std::vector<DiscountFactor> discounts_;
+        ConstantPathDerivatives derivatives_;
+        bool isBiased_;
+        mutable PseudoRandom::ursg_type sequenceGen_;
+    };
+
+
+    //! prices a block of paths monitoring the barrier at the nodes only
+    class BiasedBarrierBatchPathPricer_2 : public BatchPathPricer {
+      public:
+        BiasedBarrierBatchPathPricer_2(Barrier::Type barrierType,
+                                       Real barrier,
+                                       Real rebate,
+                                       Option::Type type,
+                                       Real strike,
+                                       std::vector<DiscountFactor> discounts);
+        void operator()(const PathBlock& paths, Real* values) const override;
+      private:
+        Barrier::Type barrierType_;
+        Real barrier_;
+        Real rebate_;
+        Real sign_, strike_;
+        std::vector<DiscountFactor> discounts_;
     };
 
 
@@ -166,13 +860,27 @@ namespace QuantLib {
         Size maxSamples,
         bool isBiased,
         BigNatural seed,
-        bool constantParameters)
-    : McSimulation<SingleVariate, RNG, S>(antitheticVariate, false),
+        ProcessParameters::Mode parameterMode,
+        Size threads,
+        bool batchSimulation,
+        std::chrono::microseconds timeBudget,
+        bool greeks,
+        bool controlVariate,
+        Size levels,
+        bool importanceSampling,
+        Real importanceDrift,
+        Size firstSample,
+        bool singlePrecision)
+    : McSimulation<SingleVariate_2, RNG, S>(antitheticVariate, controlVariate),
       process_(std::move(process)),
       timeSteps_(timeSteps), timeStepsPerYear_(timeStepsPerYear),
       requiredSamples_(requiredSamples), maxSamples_(maxSamples),
       requiredTolerance_(requiredTolerance), isBiased_(isBiased),
-      brownianBridge_(brownianBridge), seed_(seed), constantParameters_(constantParameters) {
+      brownianBridge_(brownianBridge), seed_(seed), parameterMode_(parameterMode),
+      threads_(threads), batchSimulation_(batchSimulation), timeBudget_(timeBudget),
+      greeks_(greeks), levels_(levels),
+      importanceSampling_(importanceSampling), importanceDrift_(importanceDrift),
+      firstSample_(firstSample), singlePrecision_(singlePrecision) {
         QL_REQUIRE(timeSteps != Null<Size>() || timeStepsPerYear != Null<Size>(),
                    "no time steps provided");
         QL_REQUIRE(timeSteps == Null<Size>() || timeStepsPerYear == Null<Size>(),
@@ -181,6 +889,7 @@ namespace QuantLib {
                    "timeSteps must be positive, " << timeSteps << " not allowed");
         QL_REQUIRE(timeStepsPerYear != 0,
                    "timeStepsPerYear must be positive, " << timeStepsPerYear << " not allowed");
+        QL_REQUIRE(levels > 0, "at least one level is required");
         registerWith(process_);
     }
 
@@ -199,11 +908,28 @@ namespace QuantLib {
 
     template <class RNG, class S>
     inline ext::shared_ptr<typename MCBarrierEngine_2<RNG,S>::path_pricer_type>
-    MCBarrierEngine_2<RNG,S>::pathPricer() const {
+    MCBarrierEngine_2<RNG,S>::pathPricer(
+            BigNatural bridgeSeed,
+            const ext::shared_ptr<const ConstantBarrierGridData>& gridData) const {
         ext::shared_ptr<PlainVanillaPayoff> payoff =
             ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
         QL_REQUIRE(payoff, "non-plain payoff given");
         TimeGrid grid = timeGrid();
+        if (parameterMode_ == ProcessParameters::Constant && !isBiased_) {
+            PseudoRandom::ursg_type sequenceGen(grid.size()-1,
+                                                PseudoRandom::urng_type(bridgeSeed));
+            return dispatchBarrierType(arguments_.barrierType, payoff->optionType(),
+                                       [&](auto barrierType, auto type) {
+                return ext::shared_ptr<path_pricer_type>(
+                    new ConstantBarrierPathPricer_2<decltype(barrierType)::value,
+                                                    decltype(type)::value>(
+                        arguments_.barrier,
+                        arguments_.rebate,
+                        payoff->strike(),
+                        gridData ? gridData : constantGridData(),
+                        sequenceGen));
+            });
+        }
         std::vector<DiscountFactor> discounts(grid.size());
         for (Size i = 0; i < grid.size(); i++)
             discounts[i] = process_->riskFreeRate()->discount(grid[i]);
@@ -217,25 +943,286 @@ namespace QuantLib {
                                             discounts));
         } else {
             PseudoRandom::ursg_type sequenceGen(grid.size()-1,
-                                                  PseudoRandom::urng_type(5));
+                                                  PseudoRandom::urng_type(bridgeSeed));
+            // the tabulated process gives the same diffusion at the nodes
+            ext::shared_ptr<StochasticProcess1D> diffProcess =
+                parameterMode_ == ProcessParameters::Tabulated ? simulatedProcess()
+                                                               : process_;
+            return dispatchBarrierType(arguments_.barrierType, payoff->optionType(),
+                                       [&](auto barrierType, auto type) {
+                return ext::shared_ptr<path_pricer_type>(
+                    new BarrierPathPricer_2<decltype(barrierType)::value,
+                                            decltype(type)::value>(
+                        arguments_.barrier,
+                        arguments_.rebate,
+                        payoff->strike(),
+                        discounts,
+                        diffProcess,
+                        sequenceGen));
+            });
+        }
+    }
+
+    template <class RNG, class S>
+    inline void MCBarrierEngine_2<RNG,S>::simulateMultilevel() const {
+        QL_REQUIRE(parameterMode_ == ProcessParameters::Constant,
+                   "multilevel simulation requires constant parameters");
+        // the unbiased pricer has the same expectation on all levels
+        QL_REQUIRE(isBiased_, "multilevel simulation requires the biased pricer");
+        QL_REQUIRE(!greeks_, "Greeks not available with multilevel simulation");
+        QL_REQUIRE(!batchSimulation_,
+                   "batch simulation not available with multilevel simulation");
+        QL_REQUIRE(!this->controlVariate_,
+                   "control variate not available with multilevel simulation");
+        QL_REQUIRE(!importanceSampling_,
+                   "importance sampling not available with multilevel simulation");
+        QL_REQUIRE(threads_ == Null<Size>(), "multilevel simulation is single-threaded");
+        QL_REQUIRE(QmcRandomizations<RNG>::value == 0,
+                   "multilevel simulation requires pseudo-random numbers");
+        QL_REQUIRE(requiredTolerance_ != Null<Real>(),
+                   "multilevel simulation requires a tolerance");
+        QL_REQUIRE(timeBudget_ == std::chrono::microseconds::zero(),
+                   "time budget not available with multilevel simulation");
+
+        ext::shared_ptr<PlainVanillaPayoff> payoff =
+            ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        // the finest grid is the one of the engine
+        std::vector<TimeGrid> grids(levels_);
+        grids.back() = timeGrid();
+        for (Size l=levels_-1; l>0; --l) {
+            QL_REQUIRE(grids[l].size() > 2,
+                       "not enough time steps for " << levels_ << " levels");
+            grids[l-1] = coarseTimeGrid(grids[l]);
+        }
+
+        ext::shared_ptr<ConstantBlackScholesProcess> process = constantProcess();
+        std::vector<DiscreteBarrierPathKernel_2> kernels;
+        for (const TimeGrid& grid : grids) {
+            // same discount factors as the biased pricer
+            std::vector<DiscountFactor> discounts(grid.size());
+            for (Size i=0; i<grid.size(); ++i)
+                discounts[i] = process_->riskFreeRate()->discount(grid[i]);
+            kernels.emplace_back(arguments_.barrierType, arguments_.barrier,
+                                 arguments_.rebate, payoff->optionType(),
+                                 payoff->strike(), discounts);
+        }
+
+        // independent streams for the levels
+        BigNatural seed = seed_ != 0 ? seed_ : SeedGenerator::instance().get();
+        std::vector<ext::shared_ptr<multilevel_model_type> > models;
+        for (Size l=0; l<levels_; ++l) {
+            models.push_back(ext::make_shared<multilevel_model_type>(
+                process, grids[l],
+                SingleVariate_2<RNG>::make_sequence_generator(grids[l].size()-1,
+                                                              substreamSeed(seed, l)),
+                kernels[l],
+                l > 0 ? ext::make_shared<DiscreteBarrierPathKernel_2>(kernels[l-1])
+                      : ext::shared_ptr<DiscreteBarrierPathKernel_2>(),
+                S(), this->antitheticVariate_));
+        }
+
+        MultilevelMcSimulation<multilevel_model_type> simulation(models);
+        simulation.value(requiredTolerance_,
+                         maxSamples_ != Null<Size>() ? maxSamples_ : QL_MAX_INTEGER);
+
+        results_.value = simulation.mean();
+        results_.errorEstimate = simulation.errorEstimate();
+        results_.additionalResults["samples"] = simulation.samples();
+        std::vector<Size> samples(levels_), steps(levels_);
+        std::vector<Real> variances(levels_), costs(levels_);
+        for (Size l=0; l<levels_; ++l) {
+            samples[l] = simulation.levelStatistics(l).samples();
+            variances[l] = simulation.levelStatistics(l).variance();
+            costs[l] = simulation.levelCost(l);
+            steps[l] = grids[l].size() - 1;
+        }
+        results_.additionalResults["levelSamples"] = samples;
+        results_.additionalResults["levelVariances"] = variances;
+        results_.additionalResults["levelCosts"] = costs;
+        results_.additionalResults["levelSteps"] = steps;
+    }
+
+    template <class RNG, class S>
+    template <Barrier::Type BarrierType, Option::Type Type>
+    inline Real MCBarrierEngine_2<RNG,S>::importanceDrift() const {
+        if (!importanceSampling_)
+            return 0.0;
+        if (importanceDrift_ != Null<Real>())
+            return importanceDrift_;
+
+        ext::shared_ptr<PlainVanillaPayoff> payoff =
+            ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        ext::shared_ptr<ConstantBlackScholesProcess> process = constantProcess();
+        Time t = timeGrid().back();
+        bool up = (arguments_.barrierType == Barrier::UpIn ||
+                   arguments_.barrierType == Barrier::UpOut);
+        Real drift;
+        if (arguments_.barrierType == Barrier::UpIn ||
+            arguments_.barrierType == Barrier::DownIn) {
+            // towards the barrier, if the median does not reach it
+            drift = girsanovDrift(*process, t, arguments_.barrier);
+            drift = up ? std::max(drift, 0.0) : std::min(drift, 0.0);
+        } else {
+            // towards the strike, if out of the money and away from the barrier
+            drift = girsanovDrift(*process, t, payoff->strike());
+            drift = payoff->optionType() == Option::Call ? std::max(drift, 0.0)
+                                                         : std::min(drift, 0.0);
+            if (up ? drift > 0.0 : drift < 0.0)
+                drift = 0.0;
+        }
+        if (drift == 0.0)
+            return 0.0;
+
+        // the pilot paths are drawn from their own substream
+        BigNatural seed = substreamSeed(seed_, QL_MAX_INTEGER);
+        TimeGrid grid = timeGrid();
+        ext::shared_ptr<const ConstantBarrierGridData> gridData =
+            constantGridData();
+        auto factory = [this, &process, &grid, &gridData, seed](Real d) {
+            return ext::make_shared<fused_model_type<BarrierType,Type> >(
+                process, grid,
+                SingleVariate_2<RNG>::make_sequence_generator(grid.size()-1, seed),
+                brownianBridge_,
+                pathKernel<BarrierType,Type,Real>(substreamSeed(seed, 0), gridData), S(),
+                this->antitheticVariate_, d);
+        };
+        return pilotDrift(factory, {0.0, 0.25*drift, 0.5*drift, 0.75*drift, drift}, 1024);
+    }
+
+    template <class RNG, class S>
+    template <Barrier::Type BarrierType, Option::Type Type, class T>
+    inline ConstantBarrierPathKernel_2<BarrierType,Type,T>
+    MCBarrierEngine_2<RNG,S>::pathKernel(
+            BigNatural bridgeSeed,
+            const ext::shared_ptr<const ConstantBarrierGridData>& gridData) const {
+        ext::shared_ptr<PlainVanillaPayoff> payoff =
+            ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        QL_REQUIRE(arguments_.barrierType == BarrierType &&
+                   payoff->optionType() == Type,
+                   "wrong barrier or option type");
+        // same uniforms as the constant-parameter path pricer
+        PseudoRandom::ursg_type sequenceGen(timeGrid().size()-1,
+                                            PseudoRandom::urng_type(bridgeSeed));
+        return ConstantBarrierPathKernel_2<BarrierType,Type,T>(arguments_.barrier,
+                                                               arguments_.rebate,
+                                                               payoff->strike(),
+                                                               gridData,
+                                                               sequenceGen);
+    }
+
+    template <class RNG, class S>
+    inline ext::shared_ptr<typename MCBarrierEngine_2<RNG,S>::path_pricer_type>
+    MCBarrierEngine_2<RNG,S>::controlPathPricer(
+            BigNatural bridgeSeed,
+            const ext::shared_ptr<const ConstantBarrierGridData>& gridData) const {
+        ext::shared_ptr<PlainVanillaPayoff> payoff =
+            ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        // same uniforms as the path pricer; the crossings are exact
+        // for the constant volatility, and the discount factors are
+        // the ones of the analytic engines
+        PseudoRandom::ursg_type sequenceGen(timeGrid().size()-1,
+                                            PseudoRandom::urng_type(bridgeSeed));
+        return dispatchBarrierType(arguments_.barrierType, payoff->optionType(),
+                                   [&](auto barrierType, auto type) {
             return ext::shared_ptr<path_pricer_type>(
-                new BarrierPathPricer(arguments_.barrierType,
-                                      arguments_.barrier,
-                                      arguments_.rebate,
-                                      payoff->optionType(),
-                                      payoff->strike(),
-                                      discounts,
-                                      process_,
-                                      sequenceGen));
+                new ConstantBarrierPathPricer_2<decltype(barrierType)::value,
+                                                decltype(type)::value>(
+                    arguments_.barrier,
+                    controlRebate(),
+                    payoff->strike(),
+                    gridData ? gridData : constantGridData(),
+                    sequenceGen));
+        });
+    }
+
+    template <class RNG, class S>
+    inline Real MCBarrierEngine_2<RNG,S>::controlVariateValue() const {
+        ext::shared_ptr<PricingEngine> controlPE = controlPricingEngine();
+        auto* controlArguments =
+            dynamic_cast<BarrierOption::arguments*>(controlPE->getArguments());
+        QL_REQUIRE(controlArguments, "engine is using inconsistent arguments");
+        *controlArguments = arguments_;
+        controlArguments->rebate = controlRebate();
+        controlPE->calculate();
+
+        const auto* controlResults =
+            dynamic_cast<const OneAssetOption::results*>(controlPE->getResults());
+        QL_REQUIRE(controlResults, "engine returns an inconsistent result type");
+        return controlResults->value;
+    }
+
+    template <class RNG, class S>
+    inline ext::shared_ptr<BatchPathPricer>
+    MCBarrierEngine_2<RNG,S>::batchPathPricer(BigNatural bridgeSeed) const {
+        ext::shared_ptr<PlainVanillaPayoff> payoff =
+            ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        TimeGrid grid = timeGrid();
+        std::vector<DiscountFactor> discounts(grid.size());
+        for (Size i = 0; i < grid.size(); i++)
+            discounts[i] = process_->riskFreeRate()->discount(grid[i]);
+        if (isBiased_) {
+            return ext::shared_ptr<BatchPathPricer>(
+                new BiasedBarrierBatchPathPricer_2(arguments_.barrierType,
+                                                   arguments_.barrier,
+                                                   arguments_.rebate,
+                                                   payoff->optionType(),
+                                                   payoff->strike(),
+                                                   discounts));
+        } else {
+            // variance of each step of the simulated paths
+            ext::shared_ptr<StochasticProcess1D> process = simulatedProcess();
+            std::vector<Real> variances(grid.size()-1);
+            for (Size i = 0; i < grid.size()-1; i++)
+                variances[i] = process->variance(grid[i], process->x0(), grid.dt(i));
+            PseudoRandom::ursg_type sequenceGen(grid.size()-1,
+                                                PseudoRandom::urng_type(bridgeSeed));
+            return ext::shared_ptr<BatchPathPricer>(
+                new BarrierBatchPathPricer_2(arguments_.barrierType,
+                                             arguments_.barrier,
+                                             arguments_.rebate,
+                                             payoff->optionType(),
+                                             payoff->strike(),
+                                             discounts,
+                                             variances,
+                                             sequenceGen));
         }
     }
 
+    template <class RNG, class S>
+    inline ext::shared_ptr<typename MCBarrierEngine_2<RNG,S>::greeks_model_type::path_pricer_type>
+    MCBarrierEngine_2<RNG,S>::greeksPathPricer(BigNatural bridgeSeed) const {
+        ext::shared_ptr<PlainVanillaPayoff> payoff =
+            ext::dynamic_pointer_cast<PlainVanillaPayoff>(arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        TimeGrid grid = timeGrid();
+        std::vector<DiscountFactor> discounts(grid.size());
+        for (Size i = 0; i < grid.size(); i++)
+            discounts[i] = process_->riskFreeRate()->discount(grid[i]);
+        PseudoRandom::ursg_type sequenceGen(grid.size()-1,
+                                            PseudoRandom::urng_type(bridgeSeed));
+        return ext::shared_ptr<typename greeks_model_type::path_pricer_type>(
+            new BarrierGreeksPathPricer_2(arguments_.barrierType,
+                                          arguments_.barrier,
+                                          arguments_.rebate,
+                                          payoff->optionType(),
+                                          payoff->strike(),
+                                          discounts,
+                                          ConstantPathDerivatives(*constantProcess()),
+                                          isBiased_,
+                                          sequenceGen));
+    }
+
     template <class RNG, class S>
     inline MakeMCBarrierEngine_2<RNG,S>::MakeMCBarrierEngine_2(
         ext::shared_ptr<GeneralizedBlackScholesProcess> process)
     : process_(std::move(process)), steps_(Null<Size>()), stepsPerYear_(Null<Size>()),
-      samples_(Null<Size>()), maxSamples_(Null<Size>()), tolerance_(Null<Real>()),
-      constantParameters_(false) {}
+      samples_(Null<Size>()), maxSamples_(Null<Size>()), tolerance_(Null<Real>()) {}
 
     template <class RNG, class S>
     inline MakeMCBarrierEngine_2<RNG,S>&
@@ -307,7 +1294,87 @@ namespace QuantLib {
     template <class RNG, class S>
     inline MakeMCBarrierEngine_2<RNG,S>&
     MakeMCBarrierEngine_2<RNG,S>::withConstantParameters(bool b) {
-        constantParameters_ = b;
+        parameterMode_ = b ? ProcessParameters::Constant : ProcessParameters::Full;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCBarrierEngine_2<RNG,S>&
+    MakeMCBarrierEngine_2<RNG,S>::withParameterMode(ProcessParameters::Mode mode) {
+        parameterMode_ = mode;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCBarrierEngine_2<RNG,S>&
+    MakeMCBarrierEngine_2<RNG,S>::withThreads(Size threads) {
+        QL_REQUIRE(threads > 0, "at least one thread is required");
+        QL_REQUIRE(RNG::allowsErrorEstimate,
+                   "chosen random generator policy does not provide independent substreams");
+        threads_ = threads;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCBarrierEngine_2<RNG,S>&
+    MakeMCBarrierEngine_2<RNG,S>::withBatchSimulation(bool b) {
+        batchSimulation_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCBarrierEngine_2<RNG,S>&
+    MakeMCBarrierEngine_2<RNG,S>::withTimeBudget(std::chrono::microseconds budget) {
+        QL_REQUIRE(budget > std::chrono::microseconds::zero(),
+                   "time budget must be positive");
+        timeBudget_ = budget;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCBarrierEngine_2<RNG,S>&
+    MakeMCBarrierEngine_2<RNG,S>::withGreeks(bool b) {
+        greeks_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCBarrierEngine_2<RNG,S>&
+    MakeMCBarrierEngine_2<RNG,S>::withControlVariate(bool b) {
+        controlVariate_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCBarrierEngine_2<RNG,S>&
+    MakeMCBarrierEngine_2<RNG,S>::withMultilevel(Size levels) {
+        QL_REQUIRE(levels > 0, "at least one level is required");
+        QL_REQUIRE(RNG::allowsErrorEstimate,
+                   "chosen random generator policy does not allow an error estimate");
+        levels_ = levels;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCBarrierEngine_2<RNG,S>&
+    MakeMCBarrierEngine_2<RNG,S>::withImportanceSampling(Real drift) {
+        importanceSampling_ = true;
+        importanceDrift_ = drift;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCBarrierEngine_2<RNG,S>&
+    MakeMCBarrierEngine_2<RNG,S>::withSampleBlock(Size firstSample, Size samples) {
+        QL_REQUIRE(firstSample != Null<Size>(), "null first sample");
+        firstSample_ = firstSample;
+        return withSamples(samples);
+    }
+
+    template <class RNG, class S>
+    inline MakeMCBarrierEngine_2<RNG,S>&
+    MakeMCBarrierEngine_2<RNG,S>::withSinglePrecision(bool b) {
+        singlePrecision_ = b;
         return *this;
     }
 
@@ -328,7 +1395,494 @@ namespace QuantLib {
             maxSamples_,
             biased_,
             seed_,
-            constantParameters_));
+            parameterMode_,
+            threads_,
+            batchSimulation_,
+            timeBudget_,
+            greeks_,
+            controlVariate_,
+            levels_,
+            importanceSampling_,
+            importanceDrift_,
+            firstSample_,
+            singlePrecision_));
+    }
+
+
+    template <Barrier::Type BarrierType, Option::Type Type>
+    inline BarrierPathPricer_2<BarrierType,Type>::BarrierPathPricer_2(
+                    Real barrier,
+                    Real rebate,
+                    Real strike,
+                    std::vector<DiscountFactor> discounts,
+                    ext::shared_ptr<StochasticProcess1D> diffProcess,
+                    PseudoRandom::ursg_type sequenceGen)
+    : barrier_(barrier), rebate_(rebate),
+      diffProcess_(std::move(diffProcess)), sequenceGen_(std::move(sequenceGen)),
+      strike_(strike), discounts_(std::move(discounts)) {
+        QL_REQUIRE(strike>=0.0, "strike less than zero not allowed");
+        QL_REQUIRE(barrier>0.0, "barrier less/equal zero not allowed");
+    }
+
+    template <Barrier::Type BarrierType, Option::Type Type>
+    inline Real BarrierPathPricer_2<BarrierType,Type>::operator()(const Path& path) const {
+        static Size null = Null<Size>();
+        Size n = path.length();
+        QL_REQUIRE(n>1, "the path cannot be empty");
+
+        bool isOptionActive = false;
+        Size knockNode = null;
+        Real asset_price = path.front();
+        Real new_asset_price;
+        Real x, y;
+        Volatility vol;
+        const TimeGrid& timeGrid = path.timeGrid();
+        Time dt;
+        const std::vector<Real>& u = sequenceGen_.nextSequence().value;
+        Size i;
+
+        // the switches are resolved at compile time
+        switch (BarrierType) {
+          case Barrier::DownIn:
+            isOptionActive = false;
+            for (i = 0; i < n-1; i++) {
+                new_asset_price = path[i+1];
+                // terminal or initial vol?
+                vol = diffProcess_->diffusion(timeGrid[i],asset_price);
+                dt = timeGrid.dt(i);
+
+                x = std::log(new_asset_price / asset_price);
+                y = 0.5*(x - std::sqrt(x*x - 2*vol*vol*dt*std::log(u[i])));
+                y = asset_price * std::exp(y);
+                if (y <= barrier_) {
+                    isOptionActive = true;
+                    if (knockNode == null)
+                        knockNode = i+1;
+                }
+                asset_price = new_asset_price;
+            }
+            break;
+          case Barrier::UpIn:
+            isOptionActive = false;
+            for (i = 0; i < n-1; i++) {
+                new_asset_price = path[i+1];
+                // terminal or initial vol?
+                vol = diffProcess_->diffusion(timeGrid[i],asset_price);
+                dt = timeGrid.dt(i);
+
+                x = std::log(new_asset_price / asset_price);
+                y = 0.5*(x + std::sqrt(x*x - 2*vol*vol*dt*std::log((1-u[i]))));
+                y = asset_price * std::exp(y);
+                if (y >= barrier_) {
+                    isOptionActive = true;
+                    if (knockNode == null)
+                        knockNode = i+1;
+                }
+                asset_price = new_asset_price;
+            }
+            break;
+          case Barrier::DownOut:
+            isOptionActive = true;
+            for (i = 0; i < n-1; i++) {
+                new_asset_price = path[i+1];
+                // terminal or initial vol?
+                vol = diffProcess_->diffusion(timeGrid[i],asset_price);
+                dt = timeGrid.dt(i);
+
+                x = std::log(new_asset_price / asset_price);
+                y = 0.5*(x - std::sqrt(x*x - 2*vol*vol*dt*std::log(u[i])));
+                y = asset_price * std::exp(y);
+                if (y <= barrier_) {
+                    isOptionActive = false;
+                    if (knockNode == null)
+                        knockNode = i+1;
+                }
+                asset_price = new_asset_price;
+            }
+            break;
+          case Barrier::UpOut:
+            isOptionActive = true;
+            for (i = 0; i < n-1; i++) {
+                new_asset_price = path[i+1];
+                // terminal or initial vol?
+                vol = diffProcess_->diffusion(timeGrid[i],asset_price);
+                dt = timeGrid.dt(i);
+
+                x = std::log(new_asset_price / asset_price);
+                y = 0.5*(x + std::sqrt(x*x - 2*vol*vol*dt*std::log((1-u[i]))));
+                y = asset_price * std::exp(y);
+                if (y >= barrier_) {
+                    isOptionActive = false;
+                    if (knockNode == null)
+                        knockNode = i+1;
+                }
+                asset_price = new_asset_price;
+            }
+            break;
+          default:
+            QL_FAIL("unknown barrier type");
+        }
+
+        if (isOptionActive) {
+            return vanillaPayoff<Type>(asset_price, strike_) * discounts_.back();
+        } else {
+            switch (BarrierType) {
+              case Barrier::UpIn:
+              case Barrier::DownIn:
+                return rebate_*discounts_.back();
+              case Barrier::UpOut:
+              case Barrier::DownOut:
+                return rebate_*discounts_[knockNode];
+              default:
+                QL_FAIL("unknown barrier type");
+            }
+        }
+    }
+
+
+    inline ConstantBarrierGridData::ConstantBarrierGridData(
+                                            const ConstantBlackScholesProcess& process,
+                                            const TimeGrid& grid)
+    : crossingFactors(grid.size()-1), discounts(grid.size()) {
+        Volatility sigma = process.volatility();
+        for (Size i=0; i<grid.size()-1; ++i)
+            crossingFactors[i] = -2.0 / (sigma * sigma * grid.dt(i));
+        for (Size i=0; i<grid.size(); ++i)
+            discounts[i] = std::exp(-process.riskFreeRate() * grid[i]);
+    }
+
+    template <Barrier::Type BarrierType, Option::Type Type, class T>
+    inline ConstantBarrierPathKernel_2<BarrierType,Type,T>::ConstantBarrierPathKernel_2(
+                                            Real barrier,
+                                            Real rebate,
+                                            Real strike,
+                                            ext::shared_ptr<const GridData> gridData,
+                                            PseudoRandom::ursg_type sequenceGen)
+    : rebate_(rebate), strike_(static_cast<T>(strike)),
+      gridData_(std::move(gridData)), sequenceGen_(std::move(sequenceGen)) {
+        QL_REQUIRE(strike>=0.0, "strike less than zero not allowed");
+        QL_REQUIRE(barrier>0.0, "barrier less/equal zero not allowed");
+        QL_REQUIRE(gridData_, "no grid data given");
+        logBarrier_ = static_cast<T>(std::log(barrier));
+    }
+
+    template <Barrier::Type BarrierType, Option::Type Type, class T>
+    inline typename ConstantBarrierPathKernel_2<BarrierType,Type,T>::state_type
+    ConstantBarrierPathKernel_2<BarrierType,Type,T>::initialState(T x0) const {
+        // one sequence of uniforms per path, even if it stops early
+        const std::vector<Real>& u = sequenceGen_.nextSequence().value;
+        return { std::log(x0) - logBarrier_, x0, u.data(), Null<Size>() };
+    }
+
+    template <Barrier::Type BarrierType, Option::Type Type, class T>
+    inline bool ConstantBarrierPathKernel_2<BarrierType,Type,T>::update(state_type& state,
+                                                                       Size i, T x) const {
+        state.last = x;
+        if (state.knockNode == Null<Size>()) {
+            T d = std::log(x) - logBarrier_;
+            Real u = state.uniforms[i-1];
+            T logU = std::log(static_cast<T>(isUpBarrier<BarrierType>() ? 1.0 - u : u));
+            T factor = static_cast<T>(gridData_->crossingFactors[i-1]);
+            if (logU <= factor * state.distance * d) {
+                state.knockNode = i;
+                // a knock-in option still needs the terminal value
+                return isKnockIn<BarrierType>();
+            }
+            state.distance = d;
+        }
+        return true;
+    }
+
+    template <Barrier::Type BarrierType, Option::Type Type, class T>
+    inline Real ConstantBarrierPathKernel_2<BarrierType,Type,T>::value(
+                                                       const state_type& state) const {
+        const std::vector<DiscountFactor>& discounts = gridData_->discounts;
+        const bool in = isKnockIn<BarrierType>();
+        bool isOptionActive = (state.knockNode != Null<Size>()) == in;
+        if (isOptionActive)
+            return vanillaPayoff<Type>(state.last, strike_) * discounts.back();
+        else
+            return rebate_ * (in ? discounts.back() : discounts[state.knockNode]);
+    }
+
+
+    inline DiscreteBarrierPathKernel_2::DiscreteBarrierPathKernel_2(
+                                            Barrier::Type barrierType,
+                                            Real barrier,
+                                            Real rebate,
+                                            Option::Type type,
+                                            Real strike,
+                                            std::vector<DiscountFactor> discounts)
+    : up_(barrierType == Barrier::UpIn || barrierType == Barrier::UpOut),
+      in_(barrierType == Barrier::UpIn || barrierType == Barrier::DownIn),
+      barrier_(barrier), rebate_(rebate), sign_(type == Option::Call ? 1.0 : -1.0),
+      strike_(strike), discounts_(std::move(discounts)) {
+        QL_REQUIRE(strike>=0.0, "strike less than zero not allowed");
+        QL_REQUIRE(barrier>0.0, "barrier less/equal zero not allowed");
+    }
+
+    inline bool DiscreteBarrierPathKernel_2::update(state_type& state,
+                                                    Size i, Real x) const {
+        state.last = x;
+        if (state.knockNode == Null<Size>() && (up_ ? x >= barrier_ : x <= barrier_))
+            state.knockNode = i;
+        // a knocked-out option has nothing left to pay
+        return in_ || state.knockNode == Null<Size>();
+    }
+
+    inline Real DiscreteBarrierPathKernel_2::value(const state_type& state) const {
+        bool isOptionActive = (state.knockNode != Null<Size>()) == in_;
+        if (isOptionActive)
+            return std::max(sign_ * (state.last - strike_), 0.0) * discounts_.back();
+        else
+            return rebate_ * (in_ ? discounts_.back() : discounts_[state.knockNode]);
+    }
+
+
+    template <Barrier::Type BarrierType, Option::Type Type>
+    inline ConstantBarrierPathPricer_2<BarrierType,Type>::ConstantBarrierPathPricer_2(
+                                            Real barrier,
+                                            Real rebate,
+                                            Real strike,
+                                            ext::shared_ptr<const GridData> gridData,
+                                            PseudoRandom::ursg_type sequenceGen)
+    : kernel_(barrier, rebate, strike, std::move(gridData), std::move(sequenceGen)) {}
+
+    template <Barrier::Type BarrierType, Option::Type Type>
+    inline Real ConstantBarrierPathPricer_2<BarrierType,Type>::operator()(
+                                                       const Path& path) const {
+        Size n = path.length();
+        QL_REQUIRE(n>1, "the path cannot be empty");
+        QL_REQUIRE(n == kernel_.nodes(), "wrong number of nodes");
+        return kernelValue(kernel_, path);
+    }
+
+
+    inline BarrierBatchPathPricer_2::BarrierBatchPathPricer_2(
+                                            Barrier::Type barrierType,
+                                            Real barrier,
+                                            Real rebate,
+                                            Option::Type type,
+                                            Real strike,
+                                            std::vector<DiscountFactor> discounts,
+                                            std::vector<Real> variances,
+                                            PseudoRandom::ursg_type sequenceGen)
+    : barrierType_(barrierType), barrier_(barrier), rebate_(rebate),
+      sign_(type == Option::Call ? 1.0 : -1.0), strike_(strike),
+      discounts_(std::move(discounts)), variances_(std::move(variances)),
+      sequenceGen_(std::move(sequenceGen)),
+      logs_(discounts_.size() * batchLanes),
+      uniforms_((discounts_.size()-1) * batchLanes) {
+        QL_REQUIRE(strike>=0.0, "strike less than zero not allowed");
+        QL_REQUIRE(barrier>0.0, "barrier less/equal zero not allowed");
+        QL_REQUIRE(variances_.size() == discounts_.size()-1,
+                   "one variance per step required");
+    }
+
+    inline void BarrierBatchPathPricer_2::operator()(const PathBlock& paths,
+                                                     Real* values) const {
+        Size n = paths.length();
+        QL_REQUIRE(n>1, "the path cannot be empty");
+        QL_REQUIRE(n == discounts_.size(), "wrong number of nodes");
+        bool up = (barrierType_ == Barrier::UpIn || barrierType_ == Barrier::UpOut);
+        bool in = (barrierType_ == Barrier::UpIn || barrierType_ == Barrier::DownIn);
+
+        // one sequence of uniforms per path, as in BarrierPathPricer
+        for (Size j=0; j<batchLanes; ++j) {
+            const std::vector<Real>& u = sequenceGen_.nextSequence().value;
+            for (Size i=0; i<n-1; ++i)
+                uniforms_[i*batchLanes + j] = up ? 1.0 - u[i] : u[i];
+        }
+        for (Size i=0; i<n-1; ++i)
+            detail::batchLog(&uniforms_[i*batchLanes]);
+        for (Size i=0; i<n; ++i) {
+            std::copy(paths[i], paths[i] + batchLanes, &logs_[i*batchLanes]);
+            detail::batchLog(&logs_[i*batchLanes]);
+        }
+
+        Real logBarrier = std::log(barrier_);
+        Size knockNode[batchLanes];
+        std::fill(knockNode, knockNode + batchLanes, Null<Size>());
+        for (Size i=0; i<n-1; ++i) {
+            Real variance = variances_[i];
+            const Real* y0 = &logs_[i*batchLanes];
+            const Real* y1 = &logs_[(i+1)*batchLanes];
+            const Real* logU = &uniforms_[i*batchLanes];
+            for (Size j=0; j<batchLanes; ++j) {
+                // extremum of the Brownian bridge between the nodes
+                Real x = y1[j] - y0[j];
+                Real root = std::sqrt(x*x - 2.0*variance*logU[j]);
+                Real extremum = y0[j] + 0.5*(up ? x + root : x - root);
+                bool hit = up ? extremum >= logBarrier : extremum <= logBarrier;
+                if (hit && knockNode[j] == Null<Size>())
+                    knockNode[j] = i+1;
+            }
+        }
+
+        const Real* x = paths.back();
+        for (Size j=0; j<batchLanes; ++j) {
+            bool isOptionActive = (knockNode[j] != Null<Size>()) == in;
+            if (isOptionActive)
+                values[j] = std::max(sign_ * (x[j] - strike_), 0.0) * discounts_.back();
+            else
+                values[j] = rebate_ * (in ? discounts_.back() : discounts_[knockNode[j]]);
+        }
+    }
+
+
+    inline BarrierGreeksPathPricer_2::BarrierGreeksPathPricer_2(
+                                            Barrier::Type barrierType,
+                                            Real barrier,
+                                            Real rebate,
+                                            Option::Type type,
+                                            Real strike,
+                                            std::vector<DiscountFactor> discounts,
+                                            const ConstantPathDerivatives& derivatives,
+                                            bool isBiased,
+                                            PseudoRandom::ursg_type sequenceGen)
+    : barrierType_(barrierType), barrier_(barrier), rebate_(rebate),
+      sign_(type == Option::Call ? 1.0 : -1.0), strike_(strike),
+      discounts_(std::move(discounts)), derivatives_(derivatives),
+      isBiased_(isBiased), sequenceGen_(std::move(sequenceGen)) {
+        QL_REQUIRE(strike>=0.0, "strike less than zero not allowed");
+        QL_REQUIRE(barrier>0.0, "barrier less/equal zero not allowed");
+    }
+
+    inline PathGreeks BarrierGreeksPathPricer_2::operator()(const Path& path) const {
+        Size n = path.length();
+        QL_REQUIRE(n>1, "the path cannot be empty");
+        QL_REQUIRE(n == discounts_.size(), "wrong number of nodes");
+        bool up = (barrierType_ == Barrier::UpIn || barrierType_ == Barrier::UpOut);
+        bool in = (barrierType_ == Barrier::UpIn || barrierType_ == Barrier::DownIn);
+        const TimeGrid& grid = path.timeGrid();
+        Volatility sigma = derivatives_.volatility();
+        Real logBarrier = std::log(barrier_);
+
+        // scores of the density of the first node with respect to the
+        // log of the initial value and to the volatility
+        Time dt = grid.dt(0);
+        Real variance0 = sigma*sigma*dt;
+        Real z = derivatives_.variate(path[0], path[1], dt);
+        Real score = z / std::sqrt(variance0);
+        Real vegaScore = (z*z - 1.0)/sigma - z*std::sqrt(dt);
+
+        Size knockNode = Null<Size>();
+        // crossing probability over the first step and its log-derivatives
+        Real crossing = 0.0, crossingScore = 0.0, crossingVegaScore = 0.0;
+        if (isBiased_) {
+            for (Size i=1; i<n; ++i) {
+                bool hit = up ? path[i] >= barrier_ : path[i] <= barrier_;
+                if (hit && knockNode == Null<Size>())
+                    knockNode = i;
+            }
+            for (Size i=1; i<n-1; ++i) {
+                dt = grid.dt(i);
+                z = derivatives_.variate(path[i], path[i+1], dt);
+                vegaScore += (z*z - 1.0)/sigma - z*std::sqrt(dt);
+            }
+        } else {
+            const std::vector<Real>& u = sequenceGen_.nextSequence().value;
+            Real epsilon = up ? 1.0 : -1.0;
+            Real y1 = std::log(path[1]);
+            if (up ? path[1] >= barrier_ : path[1] <= barrier_) {
+                crossing = 1.0;
+            } else {
+                Real k = (logBarrier - std::log(path[0])) * (logBarrier - y1);
+                crossing = std::exp(-2.0*k/variance0);
+                crossingScore = 2.0*(logBarrier - y1)/variance0;
+                crossingVegaScore = 4.0*k/(sigma*variance0);
+            }
+            Real y0 = y1;
+            for (Size i=1; i<n-1; ++i) {
+                dt = grid.dt(i);
+                y1 = std::log(path[i+1]);
+                Real variance = sigma*sigma*dt;
+                // extremum of the Brownian bridge between the nodes
+                Real x = y1 - y0;
+                Real root = std::sqrt(x*x - 2.0*variance*std::log(up ? 1.0-u[i] : u[i]));
+                Real extremum = y0 + 0.5*(up ? x + root : x - root);
+                bool hit = up ? extremum >= logBarrier : extremum <= logBarrier;
+                if (hit && knockNode == Null<Size>())
+                    knockNode = i+1;
+                // the density of the extremum given the nodes adds its
+                // own score to the one of the step
+                Real e = epsilon*(extremum - y0), f = epsilon*(extremum - y1);
+                z = derivatives_.variate(path[i], path[i+1], dt);
+                vegaScore += (z*z - 1.0)/sigma - z*std::sqrt(dt)
+                    - 2.0/sigma + 4.0*e*f/(sigma*variance);
+                y0 = y1;
+            }
+        }
+
+        Real payoff = std::max(sign_ * (path.back() - strike_), 0.0) * discounts_.back();
+        auto value = [&](Size knock) {
+            bool isOptionActive = (knock != Null<Size>()) == in;
+            if (isOptionActive)
+                return payoff;
+            else
+                return rebate_ * (in ? discounts_.back() : discounts_[knock]);
+        };
+        // payoff without crossing over the first step, and its change
+        // when the barrier is crossed over it
+        Real noCrossing = value(knockNode);
+        Real jump = crossing * (value(1) - noCrossing);
+
+        // derivatives with respect to the log of the initial value
+        Real v = noCrossing + jump;
+        Real d1 = jump*crossingScore + v*score;
+        Real d2 = jump*crossingScore*crossingScore + 2.0*jump*crossingScore*score
+            + v*(score*score - 1.0/variance0);
+
+        Real x0 = derivatives_.x0();
+        PathGreeks greeks;
+        greeks.value = v;
+        greeks.delta = d1 / x0;
+        greeks.gamma = (d2 - d1) / (x0*x0);
+        greeks.vega = jump*crossingVegaScore + v*vegaScore;
+        return greeks;
+    }
+
+
+    inline BiasedBarrierBatchPathPricer_2::BiasedBarrierBatchPathPricer_2(
+                                            Barrier::Type barrierType,
+                                            Real barrier,
+                                            Real rebate,
+                                            Option::Type type,
+                                            Real strike,
+                                            std::vector<DiscountFactor> discounts)
+    : barrierType_(barrierType), barrier_(barrier), rebate_(rebate),
+      sign_(type == Option::Call ? 1.0 : -1.0), strike_(strike),
+      discounts_(std::move(discounts)) {
+        QL_REQUIRE(strike>=0.0, "strike less than zero not allowed");
+        QL_REQUIRE(barrier>0.0, "barrier less/equal zero not allowed");
+    }
+
+    inline void BiasedBarrierBatchPathPricer_2::operator()(const PathBlock& paths,
+                                                           Real* values) const {
+        Size n = paths.length();
+        QL_REQUIRE(n>1, "the path cannot be empty");
+        bool up = (barrierType_ == Barrier::UpIn || barrierType_ == Barrier::UpOut);
+        bool in = (barrierType_ == Barrier::UpIn || barrierType_ == Barrier::DownIn);
+
+        Size knockNode[batchLanes];
+        std::fill(knockNode, knockNode + batchLanes, Null<Size>());
+        for (Size i=1; i<n; ++i) {
+            const Real* s = paths[i];
+            for (Size j=0; j<batchLanes; ++j) {
+                bool hit = up ? s[j] >= barrier_ : s[j] <= barrier_;
+                if (hit && knockNode[j] == Null<Size>())
+                    knockNode[j] = i;
+            }
+        }
+
+        const Real* x = paths.back();
+        for (Size j=0; j<batchLanes; ++j) {
+            bool isOptionActive = (knockNode[j] != Null<Size>()) == in;
+            if (isOptionActive)
+                values[j] = std::max(sign_ * (x[j] - strike_), 0.0) * discounts_.back();
+            else
+                values[j] = rebate_ * (in ? discounts_.back() : discounts_[knockNode[j]]);
+        }
     }
 
 }
@@ -26,26 +26,140 @@
 #ifndef montecarlo_european_engine_hpp
 #define montecarlo_european_engine_hpp
 
+#include <ql/pricingengines/vanilla/analyticeuropeanengine.hpp>
 #include <ql/pricingengines/vanilla/mcvanillaengine.hpp>
 #include <ql/processes/blackscholesprocess.hpp>
 #include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
 #include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
 #include "constantblackscholesprocess.hpp"  // pour le processus à paramètres constants
+#include "processparameters.hpp"
+#include "mcparallelsimulation.hpp"
+#include "pathgenerator.hpp"
+#include "batchmontecarlomodel.hpp"
+#include "fusedmontecarlomodel.hpp"
+#include "rqmcsimulation.hpp"
+#include "multiinstrumentsimulation.hpp"
+#include "mcgreeks.hpp"
+#include "mcinstrumentation.hpp"
+#include "mcpartialresults.hpp"
+#include "streamingstatistics.hpp"
+#include "payoffdispatch.hpp"
+#include <chrono>
 
 namespace QuantLib {
 
+    //! European payoff as a kernel of FusedMonteCarloModel
+    /*! Only the last value of the path is kept.  The path and the
+        payoff are computed in the precision \c T.  The option type is
+        a template argument, so that the payoff does not test it.
+    */
+    template <Option::Type Type, class T = Real>
+    class EuropeanPathKernel_2 {
+      public:
+        typedef T real_type;
+        typedef T state_type;
+        EuropeanPathKernel_2(Real strike,
+                             DiscountFactor discount);
+        state_type initialState(T x0) const { return x0; }
+        bool update(state_type& last, Size, T x) const {
+            last = x;
+            return true;
+        }
+        Real value(const state_type& last) const {
+            return vanillaPayoff<Type>(last, strike_) * discount_;
+        }
+      private:
+        T strike_;
+        DiscountFactor discount_;
+    };
+
+
     //! European option pricing engine using Monte Carlo simulation with optional constant parameters
-    /*! \ingroup vanillaengines
+    /*! The process can be simulated as given, with constant parameters
+        read at maturity, or with piecewise-constant parameters read once
+        per interval of the time grid (see ProcessParameters).  It can
+        also be tabulated on the time grid, which gives the same paths
+        as the given process without querying its term structures at
+        each step (see TabulatedBlackScholesProcess).
+
+        Since the payoff only depends on the terminal value, the engine
+        can also sample it directly in a single step (terminal sampling).
+        With constant parameters the extracted (r, q, sigma) are used;
+        otherwise, the terminal distribution is matched exactly by the
+        discount and dividend factors and the Black variance at maturity.
+
+        With a time budget, samples are added in batches until the
+        budget is spent, or until the tolerance or the number of
+        samples, if also given, is reached.  The number of samples
+        actually used is returned as the "samples" additional result.
+
+        With constant parameters, the engine can also return delta,
+        gamma and vega computed on the same paths as the value: delta
+        and vega are pathwise estimates, while gamma differentiates the
+        pathwise delta, which is discontinuous at the strike, through
+        the likelihood ratio of the terminal value.  Their error
+        estimates are returned as the "deltaErrorEstimate",
+        "gammaErrorEstimate" and "vegaErrorEstimate" additional
+        results.
+
+        With a control variate, the same payoff is priced on paths of
+        the process with the extracted constant parameters, drawn from
+        the same random numbers, and corrected by its analytic
+        Black-Scholes price.  It is not available with constant
+        parameters, since both paths would be the same and the
+        estimate the analytic price with a null error estimate.
+
+        Unless a control variate, the Greeks or batch simulation are
+        required, the simulations with constant, piecewise-constant or
+        tabulated parameters, or with terminal sampling, price each path while
+        it is generated instead of storing it (see
+        FusedMonteCarloModel); the results are the same.
+
+        With constant parameters and without a control variate, the
+        Greeks or batch simulation, the paths and the payoff can be
+        computed in single precision (see FusedMonteCarloModel) while
+        the samples are still accumulated in double precision.  The
+        value differs from the double-precision one by the rounding of
+        the paths, which is small with respect to the error estimate
+        for the usual numbers of steps.
+
+        With constant parameters, the paths can be sampled by
+        importance with a drift of the Brownian motion (see
+        FusedMonteCarloModel), either given or chosen automatically.
+        In the latter case, for an option out of the money at the
+        median, fractions of the drift taking the median terminal
+        value to the strike are tried on a short pilot run, and the
+        one with the smallest variance is used (see pilotDrift).  The
+        drift used is returned as the "importanceDrift" additional
+        result.
+
+        When compiled with \c MONTECARLO_ENABLE_INSTRUMENTATION, the
+        counters and phase times of the calculation are also returned
+        as additional results (see McInstrumentation).
+
+        The samples are accumulated by default in StreamingStatistics,
+        whose memory does not grow with their number; Statistics can
+        be given as the accumulator to keep them all.
+
+        Given the first of a block of samples, the engine simulates
+        only the block, as ParallelMcSimulation would number them
+        in a run with the same seed, and also returns its serialized
+        accumulator as the "partialResult" additional result.  Blocks
+        simulated by separate processes can then be merged by
+        mergePartialResults() into the accumulator of the whole run.
+
+        \ingroup vanillaengines
 
         \test the correctness of the returned value is tested by
               checking it against analytic results.
     */
-    template <class RNG = PseudoRandom, class S = Statistics>
-    class MCEuropeanEngine_2 : public MCVanillaEngine<SingleVariate,RNG,S> {
+    template <class RNG = PseudoRandom, class S = StreamingStatistics>
+    class MCEuropeanEngine_2 : public MCVanillaEngine<SingleVariate_2,RngTraits_2<RNG>,S>,
+                               public SharedPathEngine_2<RNG> {
       public:
-        typedef typename MCVanillaEngine<SingleVariate,RNG,S>::path_generator_type path_generator_type;
-        typedef typename MCVanillaEngine<SingleVariate,RNG,S>::path_pricer_type   path_pricer_type;
-        typedef typename MCVanillaEngine<SingleVariate,RNG,S>::stats_type         stats_type;
+        typedef typename MCVanillaEngine<SingleVariate_2,RngTraits_2<RNG>,S>::path_generator_type path_generator_type;
+        typedef typename MCVanillaEngine<SingleVariate_2,RngTraits_2<RNG>,S>::path_pricer_type   path_pricer_type;
+        typedef typename MCVanillaEngine<SingleVariate_2,RngTraits_2<RNG>,S>::stats_type         stats_type;
         // Constructor with an extra flag for constant parameters (default false)
         MCEuropeanEngine_2(
              const boost::shared_ptr<GeneralizedBlackScholesProcess>& process,
@@ -57,17 +171,85 @@ namespace QuantLib {
              Real requiredTolerance,
              Size maxSamples,
              BigNatural seed,
-             bool constantParameters = false);
+             ProcessParameters::Mode parameterMode = ProcessParameters::Full,
+             Size threads = Null<Size>(),
+             bool batchSimulation = false,
+             bool terminalSampling = false,
+             std::chrono::microseconds timeBudget = std::chrono::microseconds::zero(),
+             bool greeks = false,
+             bool controlVariate = false,
+             bool importanceSampling = false,
+             Real importanceDrift = Null<Real>(),
+             Size firstSample = Null<Size>(),
+             bool singlePrecision = false);
+        void calculate() const;
+        // SharedPathEngine_2 interface
+        boost::shared_ptr<GeneralizedBlackScholesProcess> sharedProcess() const override;
+        ProcessParameters::Mode sharedParameterMode() const override { return parameterMode_; }
+        BigNatural sharedSeed() const override { return this->seed_; }
+        Real sharedStrike() const override;
+        TimeGrid sharedTimeGrid() const override;
+        boost::shared_ptr<path_generator_type> sharedPathGenerator(BigNatural seed) const override;
+        boost::shared_ptr<path_pricer_type> sharedPathPricer(BigNatural seed,
+                                                             bool singleStream) const override;
       protected:
-        // Redéfinition de la génération de chemin pour supporter l'option constantParameters
+        TimeGrid timeGrid() const;
+        typedef BatchMonteCarloModel<typename SingleVariate_2<RNG>::rsg_type,S> batch_model_type;
+        // Redéfinition de la génération de chemin pour supporter les paramètres constants ou par morceaux
         boost::shared_ptr<path_generator_type> pathGenerator() const;
+        boost::shared_ptr<path_generator_type> pathGenerator(BigNatural seed) const;
         boost::shared_ptr<path_pricer_type>   pathPricer() const;
+        // simulated process and batch simulation
+        boost::shared_ptr<StochasticProcess> simulatedProcess() const;
+        boost::shared_ptr<ConstantBlackScholesProcess> constantProcess() const;
+        boost::shared_ptr<PiecewiseConstantBlackScholesProcess> piecewiseProcess() const;
+        boost::shared_ptr<ConstantBlackScholesProcess> terminalProcess() const;
+        boost::shared_ptr<typename batch_model_type::path_generator_type>
+        batchPathGenerator(BigNatural seed) const;
+        boost::shared_ptr<BatchPathPricer> batchPathPricer() const;
+        // simulation pricing the paths while they are generated
+        template <Option::Type Type, class T = Real>
+        using fused_model_type =
+            FusedMonteCarloModel<typename SingleVariate_2<RNG>::rsg_type,
+                                 EuropeanPathKernel_2<Type,T>,S>;
+        template <Option::Type Type, class T>
+        EuropeanPathKernel_2<Type,T> pathKernel() const;
+        // Brownian drift of the importance sampling, null if not used
+        template <Option::Type Type>
+        Real importanceDrift() const;
+        // simulation of the Greeks
+        typedef MonteCarloModel_2<SingleVariateGreeks_2,RNG,GreeksStatistics<S> >
+            greeks_model_type;
+        boost::shared_ptr<typename greeks_model_type::path_pricer_type>
+        greeksPathPricer() const;
+        // control variate: the payoff under the constant process
+        boost::shared_ptr<path_pricer_type> controlPathPricer() const override;
+        boost::shared_ptr<path_generator_type> controlPathGenerator() const override;
+        boost::shared_ptr<path_generator_type> controlPathGenerator(BigNatural seed) const;
+        boost::shared_ptr<PricingEngine> controlPricingEngine() const override;
       private:
-        bool constantParameters_;
+        // runs the simulation and stores mean, error and samples used
+        template <class Simulation>
+        void simulate(const Simulation& simulation) const;
+        // runs the simulation pricing the paths in the precision T
+        template <Option::Type Type, class T>
+        void simulateFused(Real drift) const;
+        // first sample of the simulation, null if not a block
+        Size firstSample() const { return firstSample_ != Null<Size>() ? firstSample_ : 0; }
+        ProcessParameters::Mode parameterMode_;
+        Size threads_;
+        bool batchSimulation_;
+        bool terminalSampling_;
+        std::chrono::microseconds timeBudget_;
+        bool greeks_;
+        bool importanceSampling_;
+        Real importanceDrift_;
+        Size firstSample_;
+        bool singlePrecision_;
     };
 
     //! Monte Carlo European engine factory with optional constant parameters
-    template <class RNG = PseudoRandom, class S = Statistics>
+    template <class RNG = PseudoRandom, class S = StreamingStatistics>
     class MakeMCEuropeanEngine_2 {
       public:
         MakeMCEuropeanEngine_2(const boost::shared_ptr<GeneralizedBlackScholesProcess>&);
@@ -81,6 +263,19 @@ namespace QuantLib {
         MakeMCEuropeanEngine_2& withSeed(BigNatural seed);
         MakeMCEuropeanEngine_2& withAntitheticVariate(bool b = true);
         MakeMCEuropeanEngine_2& withConstantParameters(bool constantParameters);
+        MakeMCEuropeanEngine_2& withParameterMode(ProcessParameters::Mode mode);
+        MakeMCEuropeanEngine_2& withThreads(Size threads);
+        MakeMCEuropeanEngine_2& withBatchSimulation(bool b = true);
+        MakeMCEuropeanEngine_2& withTerminalSampling(bool b = true);
+        MakeMCEuropeanEngine_2& withTimeBudget(std::chrono::microseconds budget);
+        MakeMCEuropeanEngine_2& withGreeks(bool b = true);
+        MakeMCEuropeanEngine_2& withControlVariate(bool b = true);
+        //! importance sampling with the given drift, or an automatic one if null
+        MakeMCEuropeanEngine_2& withImportanceSampling(Real drift = Null<Real>());
+        //! simulates only the given block of samples of the run
+        MakeMCEuropeanEngine_2& withSampleBlock(Size firstSample, Size samples);
+        //! paths and payoff in single precision, with constant parameters
+        MakeMCEuropeanEngine_2& withSinglePrecision(bool b = true);
         // conversion to pricing engine
         operator boost::shared_ptr<PricingEngine>() const;
       private:
@@ -90,17 +285,54 @@ namespace QuantLib {
         Real tolerance_;
         bool brownianBridge_;
         BigNatural seed_;
-        bool constantParameters_;
+        ProcessParameters::Mode parameterMode_;
+        Size threads_;
+        bool batchSimulation_;
+        bool terminalSampling_;
+        std::chrono::microseconds timeBudget_;
+        bool greeks_;
+        bool controlVariate_;
+        bool importanceSampling_;
+        Real importanceDrift_;
+        Size firstSample_;
+        bool singlePrecision_;
     };
 
+    //! discounted payoff of the option type \c Type
+    template <Option::Type Type>
     class EuropeanPathPricer_2 : public PathPricer<Path> {
       public:
-        EuropeanPathPricer_2(Option::Type type,
-                             Real strike,
+        EuropeanPathPricer_2(Real strike,
                              DiscountFactor discount);
         Real operator()(const Path& path) const;
       private:
-        PlainVanillaPayoff payoff_;
+        Real strike_;
+        DiscountFactor discount_;
+    };
+
+    //! discounted payoff, pathwise delta and vega, and mixed gamma
+    class EuropeanGreeksPathPricer_2 : public PathPricer<Path,PathGreeks> {
+      public:
+        EuropeanGreeksPathPricer_2(Option::Type type,
+                                   Real strike,
+                                   DiscountFactor discount,
+                                   const ConstantPathDerivatives& derivatives);
+        PathGreeks operator()(const Path& path) const;
+      private:
+        Real sign_, strike_;
+        DiscountFactor discount_;
+        ConstantPathDerivatives derivatives_;
+    };
+
+    //! prices the terminal values of a block of paths
+    class EuropeanBatchPathPricer_2 : public BatchPathPricer {
+      public:
+        EuropeanBatchPathPricer_2(Option::Type type,
+                                  Real strike,
+                                  DiscountFactor discount);
+        void operator()(const PathBlock& paths, Real* values) const;
+      private:
+        Real sign_, strike_;
         DiscountFactor discount_;
     };
 
@@ -119,62 +351,417 @@ namespace QuantLib {
              Real requiredTolerance,
              Size maxSamples,
              BigNatural seed,
-             bool constantParameters)
-    : MCVanillaEngine<SingleVariate,RNG,S>(process,
+             ProcessParameters::Mode parameterMode,
+             Size threads,
+             bool batchSimulation,
+             bool terminalSampling,
+             std::chrono::microseconds timeBudget,
+             bool greeks,
+             bool controlVariate,
+             bool importanceSampling,
+             Real importanceDrift,
+             Size firstSample,
+             bool singlePrecision)
+    : MCVanillaEngine<SingleVariate_2,RngTraits_2<RNG>,S>(process,
                                            timeSteps,
                                            timeStepsPerYear,
                                            brownianBridge,
                                            antitheticVariate,
-                                           false,
+                                           controlVariate,
                                            requiredSamples,
                                            requiredTolerance,
                                            maxSamples,
                                            seed),
-      constantParameters_(constantParameters) {}
+      parameterMode_(parameterMode), threads_(threads),
+      batchSimulation_(batchSimulation), terminalSampling_(terminalSampling),
+      timeBudget_(timeBudget), greeks_(greeks),
+      importanceSampling_(importanceSampling), importanceDrift_(importanceDrift),
+      firstSample_(firstSample), singlePrecision_(singlePrecision) {}
+
+
+    template <class RNG, class S>
+    inline void MCEuropeanEngine_2<RNG,S>::calculate() const {
+        MONTECARLO_INSTRUMENT(this->results_.additionalResults);
+        if (firstSample_ != Null<Size>()) {
+            detail::checkSampleBlock<S,RNG>(this->requiredSamples_, this->requiredTolerance_,
+                                            timeBudget_, this->seed_);
+            QL_REQUIRE(!greeks_, "Greeks not available with blocks of samples");
+        }
+        // with constant parameters, the control variate prices the same paths
+        QL_REQUIRE(!this->controlVariate_ || parameterMode_ != ProcessParameters::Constant,
+                   "control variate not available with constant parameters");
+        if (singlePrecision_) {
+            QL_REQUIRE(parameterMode_ == ProcessParameters::Constant,
+                       "single precision requires constant parameters");
+            QL_REQUIRE(!greeks_, "Greeks not available in single precision");
+            QL_REQUIRE(!batchSimulation_,
+                       "batch simulation not available in single precision");
+            QL_REQUIRE(!this->controlVariate_,
+                       "control variate not available in single precision");
+        }
+        if (importanceSampling_) {
+            QL_REQUIRE(parameterMode_ == ProcessParameters::Constant,
+                       "importance sampling requires constant parameters");
+            QL_REQUIRE(!greeks_, "Greeks not available with importance sampling");
+            QL_REQUIRE(!batchSimulation_,
+                       "batch simulation not available with importance sampling");
+            QL_REQUIRE(!this->controlVariate_,
+                       "control variate not available with importance sampling");
+        }
+
+        if (greeks_) {
+            QL_REQUIRE(parameterMode_ == ProcessParameters::Constant,
+                       "Greeks require constant parameters");
+            QL_REQUIRE(!batchSimulation_, "Greeks not available with batch simulation");
+            QL_REQUIRE(!this->controlVariate_, "Greeks not available with control variate");
+            boost::shared_ptr<typename greeks_model_type::path_pricer_type> pricer =
+                greeksPathPricer();
+            auto factory = [this, pricer](BigNatural seed) {
+                return boost::make_shared<greeks_model_type>(
+                    pathGenerator(seed), pricer, GreeksStatistics<S>(),
+                    this->antitheticVariate_);
+            };
+            if (QmcRandomizations<RNG>::value > 0) {
+                RandomizedQmcSimulation<greeks_model_type> simulation(
+                    factory, QmcRandomizations<RNG>::value,
+                    threads_ != Null<Size>() ? threads_ : 1, this->seed_);
+                simulate(simulation);
+            } else if (threads_ == Null<Size>()) {
+                SequentialMcSimulation<greeks_model_type> simulation(factory(this->seed_));
+                simulate(simulation);
+            } else {
+                ParallelMcSimulation<SingleVariateGreeks_2,RNG,GreeksStatistics<S> >
+                    simulation(factory, threads_, this->seed_);
+                simulate(simulation);
+            }
+            return;
+        }
+
+        if (batchSimulation_) {
+            QL_REQUIRE(!this->controlVariate_,
+                       "control variate not available with batch simulation");
+            QL_REQUIRE(parameterMode_ != ProcessParameters::Full || terminalSampling_,
+                       "batch simulation requires constant, piecewise-constant "
+                       "or tabulated parameters, or terminal sampling");
+            boost::shared_ptr<BatchPathPricer> pricer = batchPathPricer();
+            auto factory = [this, pricer](BigNatural seed) {
+                return boost::make_shared<batch_model_type>(
+                    batchPathGenerator(seed), pricer, S(), this->antitheticVariate_);
+            };
+            if (QmcRandomizations<RNG>::value > 0) {
+                RandomizedQmcSimulation<batch_model_type> simulation(
+                    factory, QmcRandomizations<RNG>::value,
+                    threads_ != Null<Size>() ? threads_ : 1, this->seed_);
+                simulate(simulation);
+                return;
+            }
+            ParallelMcSimulation<SingleVariate_2,RNG,S,batch_model_type> simulation(
+                factory, threads_ != Null<Size>() ? threads_ : 1, this->seed_, firstSample());
+            simulate(simulation);
+            return;
+        }
+
+        if (!this->controlVariate_ &&
+            (parameterMode_ != ProcessParameters::Full || terminalSampling_)) {
+            // deterministic parameters: no need to store the paths;
+            // the kernel is instantiated for the option type
+            boost::shared_ptr<PlainVanillaPayoff> payoff =
+                boost::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+            QL_REQUIRE(payoff, "non-plain payoff given");
+            dispatchOptionType(payoff->optionType(), [&](auto type) {
+                constexpr Option::Type Type = decltype(type)::value;
+                Real drift = importanceDrift<Type>();
+                if (singlePrecision_)
+                    simulateFused<Type,float>(drift);
+                else
+                    simulateFused<Type,Real>(drift);
+                if (importanceSampling_)
+                    this->results_.additionalResults["importanceDrift"] = drift;
+            });
+            return;
+        }
+
+        // the pricers are stateless and can be shared among threads;
+        // the analytic value of the control variate is computed once
+        boost::shared_ptr<path_pricer_type> pricer = this->pathPricer();
+        boost::shared_ptr<path_pricer_type> cvPricer;
+        Real cvValue = 0.0;
+        if (this->controlVariate_) {
+            cvPricer = this->controlPathPricer();
+            cvValue = this->controlVariateValue();
+        }
+        auto factory = [this, pricer, cvPricer, cvValue](BigNatural seed) {
+            return boost::make_shared<MonteCarloModel_2<SingleVariate_2,RNG,S> >(
+                this->pathGenerator(seed), pricer, S(), this->antitheticVariate_,
+                cvPricer, cvValue,
+                cvPricer ? controlPathGenerator(seed)
+                         : boost::shared_ptr<path_generator_type>());
+        };
+
+        if (threads_ == Null<Size>() && firstSample_ == Null<Size>() &&
+            QmcRandomizations<RNG>::value == 0) {
+            // single stream, as in MCVanillaEngine, with reused path storage
+            SequentialMcSimulation<MonteCarloModel_2<SingleVariate_2,RNG,S> > simulation(
+                factory(this->seed_));
+            simulate(simulation);
+            return;
+        }
+
+        // set up the lazy local volatility before sharing the process among threads
+        boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_)
+            ->localVolatility();
+        if (QmcRandomizations<RNG>::value > 0) {
+            // independent randomizations of the same point set
+            RandomizedQmcSimulation<MonteCarloModel_2<SingleVariate_2,RNG,S> > simulation(
+                factory, QmcRandomizations<RNG>::value,
+                threads_ != Null<Size>() ? threads_ : 1, this->seed_);
+            simulate(simulation);
+            return;
+        }
+        ParallelMcSimulation<SingleVariate_2,RNG,S> simulation(
+            factory, threads_ != Null<Size>() ? threads_ : 1, this->seed_, firstSample());
+        simulate(simulation);
+    }
+
+
+    template <class RNG, class S>
+    template <class Simulation>
+    inline void MCEuropeanEngine_2<RNG,S>::simulate(const Simulation& simulation) const {
+        simulation.calculate(this->requiredTolerance_,
+                             this->requiredSamples_,
+                             this->maxSamples_,
+                             timeBudget_);
+        detail::storeResults(simulation.sampleAccumulator(), this->results_,
+                             RNG::allowsErrorEstimate);
+        this->results_.additionalResults["samples"] = simulation.samples();
+        if (firstSample_ != Null<Size>())
+            detail::storePartialResult(simulation.sampleAccumulator(), this->seed_,
+                                       firstSample_, this->results_);
+    }
+
+    template <class RNG, class S>
+    template <Option::Type Type, class T>
+    inline void MCEuropeanEngine_2<RNG,S>::simulateFused(Real drift) const {
+        typedef fused_model_type<Type,T> model_type;
+        EuropeanPathKernel_2<Type,T> kernel = pathKernel<Type,T>();
+        boost::shared_ptr<StochasticProcess> process = simulatedProcess();
+        TimeGrid grid = this->timeGrid();
+        auto factory = [this, kernel, process, grid, drift](BigNatural seed) {
+            return boost::make_shared<model_type>(
+                process, grid,
+                SingleVariate_2<RNG>::make_sequence_generator(grid.size() - 1, seed),
+                this->brownianBridge_, kernel, S(), this->antitheticVariate_, drift);
+        };
+        if (QmcRandomizations<RNG>::value > 0) {
+            RandomizedQmcSimulation<model_type> simulation(
+                factory, QmcRandomizations<RNG>::value,
+                threads_ != Null<Size>() ? threads_ : 1, this->seed_);
+            simulate(simulation);
+        } else if (threads_ == Null<Size>() && firstSample_ == Null<Size>()) {
+            SequentialMcSimulation<model_type> simulation(factory(this->seed_));
+            simulate(simulation);
+        } else {
+            ParallelMcSimulation<SingleVariate_2,RNG,S,model_type> simulation(
+                factory, threads_ != Null<Size>() ? threads_ : 1, this->seed_,
+                firstSample());
+            simulate(simulation);
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline TimeGrid MCEuropeanEngine_2<RNG,S>::timeGrid() const {
+        if (!terminalSampling_)
+            return MCVanillaEngine<SingleVariate_2,RngTraits_2<RNG>,S>::timeGrid();
+        // a single step up to maturity
+        Date lastExerciseDate = this->arguments_.exercise->lastDate();
+        Time t = this->process_->time(lastExerciseDate);
+        QL_REQUIRE(t > 0.0, "expired option");
+        return TimeGrid(t, 1);
+    }
+
+
+    template <class RNG, class S>
+    inline boost::shared_ptr<GeneralizedBlackScholesProcess>
+    MCEuropeanEngine_2<RNG,S>::sharedProcess() const {
+        return boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+    }
+
+
+    template <class RNG, class S>
+    inline Real MCEuropeanEngine_2<RNG,S>::sharedStrike() const {
+        // the paths of full and tabulated parameters do not depend on it
+        if (parameterMode_ == ProcessParameters::Tabulated ||
+            (parameterMode_ == ProcessParameters::Full && !terminalSampling_))
+            return Null<Real>();
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        return payoff->strike();
+    }
+
+
+    template <class RNG, class S>
+    inline TimeGrid MCEuropeanEngine_2<RNG,S>::sharedTimeGrid() const {
+        return this->timeGrid();
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_generator_type>
+    MCEuropeanEngine_2<RNG,S>::sharedPathGenerator(BigNatural seed) const {
+        // set up the lazy local volatility before the paths are drawn on other threads
+        boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_)
+            ->localVolatility();
+        return pathGenerator(seed);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>
+    MCEuropeanEngine_2<RNG,S>::sharedPathPricer(BigNatural, bool) const {
+        return this->pathPricer();
+    }
 
 
     template <class RNG, class S>
     inline
     boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_generator_type>
     MCEuropeanEngine_2<RNG,S>::pathGenerator() const {
+        // Utilisation du seed hérité dans la base
+        return pathGenerator(MCVanillaEngine<SingleVariate_2,RngTraits_2<RNG>,S>::seed_);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_generator_type>
+    MCEuropeanEngine_2<RNG,S>::pathGenerator(BigNatural seed) const {
 
         Size dimensions = this->process_->factors();
         TimeGrid grid = this->timeGrid();
-        // Utilisation du seed hérité dans la base
-        typename RNG::rsg_type generator =
-            RNG::make_sequence_generator(dimensions * (grid.size() - 1),
-                                         MCVanillaEngine<SingleVariate,RNG,S>::seed_);
-        
-        if(constantParameters_) {
-            boost::shared_ptr<GeneralizedBlackScholesProcess> BS_process =
-                boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
-            QL_REQUIRE(BS_process, "Black-Scholes process required for constant parameters");
-
-            Time time_of_extraction = grid.back();
-            boost::shared_ptr<PlainVanillaPayoff> payoff =
-                boost::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
-            QL_REQUIRE(payoff, "non-plain payoff given");
+        typename SingleVariate_2<RNG>::rsg_type generator =
+            SingleVariate_2<RNG>::make_sequence_generator(dimensions * (grid.size() - 1), seed);
 
-            double strike = payoff->strike();
-            double riskFreeRate = BS_process->riskFreeRate()->zeroRate(time_of_extraction, Continuous);
-            double dividend     = BS_process->dividendYield()->zeroRate(time_of_extraction, Continuous);
-            double volatility   = BS_process->blackVolatility()->blackVol(time_of_extraction, strike);
-            double underlyingValue = BS_process->x0();
+        return boost::shared_ptr<path_generator_type>(
+            new path_generator_type(simulatedProcess(), grid, generator,
+                                    MCVanillaEngine<SingleVariate_2,RngTraits_2<RNG>,S>::brownianBridge_));
+    }
 
-            boost::shared_ptr<ConstantBlackScholesProcess> cst_BS_process(
-                new ConstantBlackScholesProcess(underlyingValue, riskFreeRate, volatility, dividend));
 
-            return boost::shared_ptr<path_generator_type>(
-                new path_generator_type(cst_BS_process, grid, generator,
-                                        MCVanillaEngine<SingleVariate,RNG,S>::brownianBridge_));
-        } else {
-            return boost::shared_ptr<path_generator_type>(
-                new path_generator_type(this->process_, grid, generator,
-                                        MCVanillaEngine<SingleVariate,RNG,S>::brownianBridge_));
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<StochasticProcess>
+    MCEuropeanEngine_2<RNG,S>::simulatedProcess() const {
+        switch (parameterMode_) {
+          case ProcessParameters::Full:
+            return terminalSampling_ ? terminalProcess() : this->process_;
+          case ProcessParameters::Constant:
+            return constantProcess();
+          case ProcessParameters::Piecewise:
+            return piecewiseProcess();
+          case ProcessParameters::Tabulated:
+            return makeTabulatedBlackScholesProcess(
+                boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_),
+                this->timeGrid());
+          default:
+            QL_FAIL("unknown parameter mode");
         }
     }
 
 
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<ConstantBlackScholesProcess>
+    MCEuropeanEngine_2<RNG,S>::constantProcess() const {
+        boost::shared_ptr<GeneralizedBlackScholesProcess> BS_process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+        QL_REQUIRE(BS_process, "Black-Scholes process required for constant parameters");
+
+        Time time_of_extraction = this->timeGrid().back();
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        return makeConstantBlackScholesProcess(BS_process, time_of_extraction,
+                                               payoff->strike());
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<PiecewiseConstantBlackScholesProcess>
+    MCEuropeanEngine_2<RNG,S>::piecewiseProcess() const {
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        return makePiecewiseConstantBlackScholesProcess(
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_),
+            this->timeGrid(), payoff->strike());
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<ConstantBlackScholesProcess>
+    MCEuropeanEngine_2<RNG,S>::terminalProcess() const {
+        boost::shared_ptr<GeneralizedBlackScholesProcess> BS_process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+        QL_REQUIRE(BS_process, "Black-Scholes process required for terminal sampling");
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        // rates and volatility giving the exact distribution of the terminal value
+        Time maturity = this->timeGrid().back();
+        DiscountFactor discount = BS_process->riskFreeRate()->discount(maturity);
+        DiscountFactor dividendDiscount = BS_process->dividendYield()->discount(maturity);
+        Real variance = BS_process->blackVolatility()->blackVariance(maturity, payoff->strike());
+
+        return boost::shared_ptr<ConstantBlackScholesProcess>(
+            new ConstantBlackScholesProcess(BS_process->x0(),
+                                            -std::log(discount) / maturity,
+                                            std::sqrt(variance / maturity),
+                                            -std::log(dividendDiscount) / maturity));
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::batch_model_type::path_generator_type>
+    MCEuropeanEngine_2<RNG,S>::batchPathGenerator(BigNatural seed) const {
+        TimeGrid grid = this->timeGrid();
+        typename SingleVariate_2<RNG>::rsg_type generator =
+            SingleVariate_2<RNG>::make_sequence_generator(grid.size() - 1, seed);
+        return boost::make_shared<typename batch_model_type::path_generator_type>(
+            simulatedProcess(), grid, generator,
+            MCVanillaEngine<SingleVariate_2,RngTraits_2<RNG>,S>::brownianBridge_);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<BatchPathPricer>
+    MCEuropeanEngine_2<RNG,S>::batchPathPricer() const {
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        return boost::shared_ptr<BatchPathPricer>(
+          new EuropeanBatchPathPricer_2(
+              payoff->optionType(),
+              payoff->strike(),
+              process->riskFreeRate()->discount(this->timeGrid().back())));
+    }
+
+
     template <class RNG, class S>
     inline
     boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>
@@ -188,11 +775,132 @@ namespace QuantLib {
             boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
         QL_REQUIRE(process, "Black-Scholes process required");
 
-        return boost::shared_ptr<path_pricer_type>(
-          new EuropeanPathPricer_2(
+        Real strike = payoff->strike();
+        DiscountFactor discount = process->riskFreeRate()->discount(this->timeGrid().back());
+        return dispatchOptionType(payoff->optionType(), [&](auto type) {
+            return boost::shared_ptr<path_pricer_type>(
+                new EuropeanPathPricer_2<decltype(type)::value>(strike, discount));
+        });
+    }
+
+
+    template <class RNG, class S>
+    template <Option::Type Type, class T>
+    inline EuropeanPathKernel_2<Type,T> MCEuropeanEngine_2<RNG,S>::pathKernel() const {
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        QL_REQUIRE(payoff->optionType() == Type, "wrong option type");
+
+        return EuropeanPathKernel_2<Type,T>(
+            payoff->strike(),
+            process->riskFreeRate()->discount(this->timeGrid().back()));
+    }
+
+
+    template <class RNG, class S>
+    template <Option::Type Type>
+    inline Real MCEuropeanEngine_2<RNG,S>::importanceDrift() const {
+        if (!importanceSampling_)
+            return 0.0;
+        if (importanceDrift_ != Null<Real>())
+            return importanceDrift_;
+
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+        // towards the strike, if the option is out of the money at the median
+        boost::shared_ptr<ConstantBlackScholesProcess> process = constantProcess();
+        TimeGrid grid = this->timeGrid();
+        Real drift = girsanovDrift(*process, grid.back(), payoff->strike());
+        drift = payoff->optionType() == Option::Call ? std::max(drift, 0.0)
+                                                     : std::min(drift, 0.0);
+        if (drift == 0.0)
+            return 0.0;
+
+        // the pilot paths are drawn from their own substream
+        BigNatural seed = substreamSeed(this->seed_, QL_MAX_INTEGER);
+        EuropeanPathKernel_2<Type> kernel = pathKernel<Type,Real>();
+        auto factory = [this, &process, &grid, &kernel, seed](Real d) {
+            return boost::make_shared<fused_model_type<Type> >(
+                process, grid,
+                SingleVariate_2<RNG>::make_sequence_generator(grid.size() - 1, seed),
+                this->brownianBridge_, kernel, S(), this->antitheticVariate_, d);
+        };
+        return pilotDrift(factory, {0.0, 0.25*drift, 0.5*drift, 0.75*drift, drift}, 1024);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::greeks_model_type::path_pricer_type>
+    MCEuropeanEngine_2<RNG,S>::greeksPathPricer() const {
+        boost::shared_ptr<PlainVanillaPayoff> payoff =
+            boost::dynamic_pointer_cast<PlainVanillaPayoff>(this->arguments_.payoff);
+        QL_REQUIRE(payoff, "non-plain payoff given");
+
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+
+        return boost::shared_ptr<typename greeks_model_type::path_pricer_type>(
+          new EuropeanGreeksPathPricer_2(
               payoff->optionType(),
               payoff->strike(),
-              process->riskFreeRate()->discount(this->timeGrid().back())));
+              process->riskFreeRate()->discount(this->timeGrid().back()),
+              ConstantPathDerivatives(*constantProcess())));
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_pricer_type>
+    MCEuropeanEngine_2<RNG,S>::controlPathPricer() const {
+        // the discount factor at maturity is the one of the constant process
+        return this->pathPricer();
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_generator_type>
+    MCEuropeanEngine_2<RNG,S>::controlPathGenerator() const {
+        return controlPathGenerator(this->seed_);
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<typename MCEuropeanEngine_2<RNG,S>::path_generator_type>
+    MCEuropeanEngine_2<RNG,S>::controlPathGenerator(BigNatural seed) const {
+        // with constant parameters, the control variate uses the simulated paths
+        if (parameterMode_ == ProcessParameters::Constant)
+            return boost::shared_ptr<path_generator_type>();
+
+        Size dimensions = this->process_->factors();
+        TimeGrid grid = this->timeGrid();
+        typename SingleVariate_2<RNG>::rsg_type generator =
+            SingleVariate_2<RNG>::make_sequence_generator(dimensions * (grid.size() - 1), seed);
+        return boost::shared_ptr<path_generator_type>(
+            new path_generator_type(constantProcess(), grid, generator,
+                                    MCVanillaEngine<SingleVariate_2,RngTraits_2<RNG>,S>::brownianBridge_));
+    }
+
+
+    template <class RNG, class S>
+    inline
+    boost::shared_ptr<PricingEngine>
+    MCEuropeanEngine_2<RNG,S>::controlPricingEngine() const {
+        boost::shared_ptr<GeneralizedBlackScholesProcess> process =
+            boost::dynamic_pointer_cast<GeneralizedBlackScholesProcess>(this->process_);
+        QL_REQUIRE(process, "Black-Scholes process required");
+        return boost::make_shared<AnalyticEuropeanEngine>(
+            makeFlatBlackScholesProcess(process, *constantProcess()));
     }
 
 
@@ -203,7 +911,11 @@ namespace QuantLib {
       steps_(Null<Size>()), stepsPerYear_(Null<Size>()),
       samples_(Null<Size>()), maxSamples_(Null<Size>()),
       tolerance_(Null<Real>()), brownianBridge_(false), seed_(0),
-      constantParameters_(false) {}
+      parameterMode_(ProcessParameters::Full), threads_(Null<Size>()), batchSimulation_(false),
+      terminalSampling_(false), timeBudget_(std::chrono::microseconds::zero()),
+      greeks_(false), controlVariate_(false),
+      importanceSampling_(false), importanceDrift_(Null<Real>()),
+      firstSample_(Null<Size>()), singlePrecision_(false) {}
 
     template <class RNG, class S>
     inline MakeMCEuropeanEngine_2<RNG,S>&
@@ -268,7 +980,85 @@ namespace QuantLib {
     template <class RNG, class S>
     inline MakeMCEuropeanEngine_2<RNG,S>&
     MakeMCEuropeanEngine_2<RNG,S>::withConstantParameters(bool constantParameters) {
-        constantParameters_ = constantParameters;
+        parameterMode_ = constantParameters ? ProcessParameters::Constant
+                                            : ProcessParameters::Full;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withParameterMode(ProcessParameters::Mode mode) {
+        parameterMode_ = mode;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withThreads(Size threads) {
+        QL_REQUIRE(threads > 0, "at least one thread is required");
+        QL_REQUIRE(RNG::allowsErrorEstimate,
+                   "chosen random generator policy does not provide independent substreams");
+        threads_ = threads;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withBatchSimulation(bool b) {
+        batchSimulation_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withTerminalSampling(bool b) {
+        terminalSampling_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withTimeBudget(std::chrono::microseconds budget) {
+        QL_REQUIRE(budget > std::chrono::microseconds::zero(),
+                   "time budget must be positive");
+        timeBudget_ = budget;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withGreeks(bool b) {
+        greeks_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withControlVariate(bool b) {
+        controlVariate_ = b;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withImportanceSampling(Real drift) {
+        importanceSampling_ = true;
+        importanceDrift_ = drift;
+        return *this;
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withSampleBlock(Size firstSample, Size samples) {
+        QL_REQUIRE(firstSample != Null<Size>(), "null first sample");
+        firstSample_ = firstSample;
+        return withSamples(samples);
+    }
+
+    template <class RNG, class S>
+    inline MakeMCEuropeanEngine_2<RNG,S>&
+    MakeMCEuropeanEngine_2<RNG,S>::withSinglePrecision(bool b) {
+        singlePrecision_ = b;
         return *this;
     }
 
@@ -288,21 +1078,81 @@ namespace QuantLib {
                                       samples_, tolerance_,
                                       maxSamples_,
                                       seed_,
-                                      constantParameters_));
+                                      parameterMode_,
+                                      threads_,
+                                      batchSimulation_,
+                                      terminalSampling_,
+                                      timeBudget_,
+                                      greeks_,
+                                      controlVariate_,
+                                      importanceSampling_,
+                                      importanceDrift_,
+                                      firstSample_,
+                                      singlePrecision_));
     }
 
 
 
-    inline EuropeanPathPricer_2::EuropeanPathPricer_2(Option::Type type,
-                                                      Real strike,
-                                                      DiscountFactor discount)
-    : payoff_(type, strike), discount_(discount) {
+    template <Option::Type Type>
+    inline EuropeanPathPricer_2<Type>::EuropeanPathPricer_2(Real strike,
+                                                            DiscountFactor discount)
+    : strike_(strike), discount_(discount) {
         QL_REQUIRE(strike>=0.0, "strike less than zero not allowed");
     }
 
-    inline Real EuropeanPathPricer_2::operator()(const Path& path) const {
+    template <Option::Type Type>
+    inline Real EuropeanPathPricer_2<Type>::operator()(const Path& path) const {
         QL_REQUIRE(path.length() > 0, "the path cannot be empty");
-        return payoff_(path.back()) * discount_;
+        return vanillaPayoff<Type>(path.back(), strike_) * discount_;
+    }
+
+
+    template <Option::Type Type, class T>
+    inline EuropeanPathKernel_2<Type,T>::EuropeanPathKernel_2(Real strike,
+                                                              DiscountFactor discount)
+    : strike_(static_cast<T>(strike)), discount_(discount) {
+        QL_REQUIRE(strike>=0.0, "strike less than zero not allowed");
+    }
+
+
+    inline EuropeanGreeksPathPricer_2::EuropeanGreeksPathPricer_2(
+                                                   Option::Type type,
+                                                   Real strike,
+                                                   DiscountFactor discount,
+                                                   const ConstantPathDerivatives& derivatives)
+    : sign_(type == Option::Call ? 1.0 : -1.0), strike_(strike), discount_(discount),
+      derivatives_(derivatives) {
+        QL_REQUIRE(strike>=0.0, "strike less than zero not allowed");
+    }
+
+    inline PathGreeks EuropeanGreeksPathPricer_2::operator()(const Path& path) const {
+        QL_REQUIRE(path.length() > 0, "the path cannot be empty");
+        Real x = path.back();
+        Time t = path.timeGrid().back();
+        PathGreeks greeks;
+        if (sign_ * (x - strike_) > 0.0) {
+            greeks.value = sign_ * (x - strike_) * discount_;
+            greeks.delta = sign_ * derivatives_.delta(x) * discount_;
+            greeks.vega = sign_ * derivatives_.vega(x, t) * discount_;
+            greeks.gamma = derivatives_.gamma(greeks.delta, x, t);
+        }
+        return greeks;
+    }
+
+
+    inline EuropeanBatchPathPricer_2::EuropeanBatchPathPricer_2(Option::Type type,
+                                                                Real strike,
+                                                                DiscountFactor discount)
+    : sign_(type == Option::Call ? 1.0 : -1.0), strike_(strike), discount_(discount) {
+        QL_REQUIRE(strike>=0.0, "strike less than zero not allowed");
+    }
+
+    inline void EuropeanBatchPathPricer_2::operator()(const PathBlock& paths,
+                                                      Real* values) const {
+        QL_REQUIRE(paths.length() > 0, "the paths cannot be empty");
+        const Real* x = paths.back();
+        for (Size j=0; j<PathBlock::lanes(); ++j)
+            values[j] = std::max(sign_ * (x[j] - strike_), 0.0) * discount_;
     }
 
 }
@@ -0,0 +1,187 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file mcgreeks.hpp
+    \brief Monte Carlo Greeks computed in the pricing pass
+*/
+
+#ifndef montecarlo_mc_greeks_hpp
+#define montecarlo_mc_greeks_hpp
+
+#include <ql/methods/montecarlo/pathpricer.hpp>
+#include "constantblackscholesprocess.hpp"
+#include "mcparallelsimulation.hpp"
+#include "pathgenerator.hpp"
+#include <cmath>
+
+namespace QuantLib {
+
+    //! discounted payoff of a path and its sensitivities
+    /*! Delta and gamma are taken with respect to the initial value
+        of the underlying, vega with respect to the volatility of the
+        simulated process.
+    */
+    struct PathGreeks {
+        Real value = 0.0, delta = 0.0, gamma = 0.0, vega = 0.0;
+        PathGreeks& operator+=(const PathGreeks& g) {
+            value += g.value; delta += g.delta; gamma += g.gamma; vega += g.vega;
+            return *this;
+        }
+        PathGreeks& operator-=(const PathGreeks& g) {
+            value -= g.value; delta -= g.delta; gamma -= g.gamma; vega -= g.vega;
+            return *this;
+        }
+        PathGreeks& operator/=(Real x) {
+            value /= x; delta /= x; gamma /= x; vega /= x;
+            return *this;
+        }
+    };
+
+    inline PathGreeks operator+(PathGreeks g, const PathGreeks& h) { return g += h; }
+    inline PathGreeks operator-(PathGreeks g, const PathGreeks& h) { return g -= h; }
+    inline PathGreeks operator/(PathGreeks g, Real x) { return g /= x; }
+
+
+    //! Monte Carlo traits for path pricers returning Greeks
+    template <class RNG>
+    struct SingleVariateGreeks_2 : SingleVariate_2<RNG> {
+        typedef PathPricer<Path,PathGreeks> path_pricer_type;
+    };
+
+
+    template <class S> class GreeksStatistics;
+
+    template <class S>
+    void mergeStatistics(GreeksStatistics<S>& total, const GreeksStatistics<S>& partial);
+
+    //! accumulators for the value and the Greeks of the paths
+    /*! The number of samples and the error estimate are the ones of
+        the value, so that the simulations control the error on the
+        price as usual.
+    */
+    template <class S>
+    class GreeksStatistics {
+      public:
+        void add(const PathGreeks& g, Real weight = 1.0) {
+            value_.add(g.value, weight);
+            delta_.add(g.delta, weight);
+            gamma_.add(g.gamma, weight);
+            vega_.add(g.vega, weight);
+        }
+        Size samples() const { return value_.samples(); }
+        Real errorEstimate() const { return value_.errorEstimate(); }
+        PathGreeks mean() const {
+            PathGreeks g;
+            g.value = value_.mean();
+            g.delta = delta_.mean();
+            g.gamma = gamma_.mean();
+            g.vega = vega_.mean();
+            return g;
+        }
+        const S& value() const { return value_; }
+        const S& delta() const { return delta_; }
+        const S& gamma() const { return gamma_; }
+        const S& vega() const { return vega_; }
+      private:
+        friend void mergeStatistics<>(GreeksStatistics<S>&, const GreeksStatistics<S>&);
+        S value_, delta_, gamma_, vega_;
+    };
+
+    template <class S>
+    inline void mergeStatistics(GreeksStatistics<S>& total, const GreeksStatistics<S>& partial) {
+        mergeStatistics(total.value_, partial.value_);
+        mergeStatistics(total.delta_, partial.delta_);
+        mergeStatistics(total.gamma_, partial.gamma_);
+        mergeStatistics(total.vega_, partial.vega_);
+    }
+
+
+    //! derivatives of the nodes of a ConstantBlackScholesProcess path
+    /*! The node at time \f$ t \f$ is
+        \f[
+            S_t = S_0 \exp\left((r - q - \sigma^2/2)\,t + \sigma W_t\right),
+        \f]
+        so that \f$ \partial S_t / \partial S_0 = S_t / S_0 \f$ and
+        \f$ \partial S_t / \partial \sigma = S_t (W_t - \sigma t) \f$,
+        with \f$ W_t \f$ recovered from the node.
+    */
+    class ConstantPathDerivatives {
+      public:
+        explicit ConstantPathDerivatives(const ConstantBlackScholesProcess& process)
+        : x0_(process.x0()), sigma_(process.volatility()),
+          drift_(process.riskFreeRate() - process.dividend()
+                 - 0.5 * process.volatility() * process.volatility()) {}
+        Real x0() const { return x0_; }
+        Volatility volatility() const { return sigma_; }
+        //! Brownian motion at time t leading to the node value x
+        Real brownian(Real x, Time t) const {
+            return (std::log(x / x0_) - drift_ * t) / sigma_;
+        }
+        //! standard normal variate of the step from x to y over dt
+        Real variate(Real x, Real y, Time dt) const {
+            return (std::log(y / x) - drift_ * dt) / (sigma_ * std::sqrt(dt));
+        }
+        Real delta(Real x) const { return x / x0_; }
+        Real vega(Real x, Time t) const { return x * (brownian(x, t) - sigma_ * t); }
+        /*! mixed pathwise/likelihood-ratio gamma from a pathwise delta
+            of a payoff depending on the nodes from time t on, where x
+            is the node at time t: the derivative of the pathwise delta
+            at fixed nodes is added to its product with the score of
+            the density of x.
+        */
+        Real gamma(Real pathwiseDelta, Real x, Time t) const {
+            return pathwiseDelta * (brownian(x, t) / (sigma_ * t) - 1.0) / x0_;
+        }
+      private:
+        Real x0_;
+        Volatility sigma_;
+        Real drift_;
+    };
+
+
+    namespace detail {
+
+        // stores mean and error estimate into the engine results
+        template <class S, class Results>
+        inline void storeResults(const S& stats, Results& results, bool errorEstimate) {
+            results.value = stats.mean();
+            if (errorEstimate)
+                results.errorEstimate = stats.errorEstimate();
+        }
+
+        // also stores the Greeks and their error estimates
+        template <class S, class Results>
+        inline void storeResults(const GreeksStatistics<S>& stats, Results& results,
+                                 bool errorEstimate) {
+            results.value = stats.value().mean();
+            results.delta = stats.delta().mean();
+            results.gamma = stats.gamma().mean();
+            results.vega = stats.vega().mean();
+            if (errorEstimate) {
+                results.errorEstimate = stats.value().errorEstimate();
+                results.additionalResults["deltaErrorEstimate"] = stats.delta().errorEstimate();
+                results.additionalResults["gammaErrorEstimate"] = stats.gamma().errorEstimate();
+                results.additionalResults["vegaErrorEstimate"] = stats.vega().errorEstimate();
+            }
+        }
+
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,209 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file mcinstrumentation.hpp
+    \brief Phase timers and counters of the Monte Carlo hot paths
+
+    The instrumentation is compiled only if
+    \c MONTECARLO_ENABLE_INSTRUMENTATION is defined; otherwise the
+    macros below expand to nothing and the hot paths are the same
+    as without them.
+*/
+
+#ifndef montecarlo_mc_instrumentation_hpp
+#define montecarlo_mc_instrumentation_hpp
+
+#ifdef MONTECARLO_ENABLE_INSTRUMENTATION
+
+#include <ql/patterns/singleton.hpp>
+#include <ql/types.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+
+namespace QuantLib {
+
+    //! cumulative phase timers and counters of the Monte Carlo simulations
+    /*! The timers and counters are global and updated atomically, so
+        that the paths simulated by all the threads of a simulation
+        are accounted for; the timers sum the time spent by each
+        thread.  Engines reset them when their calculation starts and
+        store them in their additional results when it ends (see
+        McInstrumentationScope); the figures of engines calculating
+        concurrently are therefore mixed.
+
+        The phases are exclusive: the time spent in a phase nested in
+        another one (e.g., the drawing of the variates of a control
+        variate path while the payoffs are computed) is accounted for
+        by the inner phase only.
+    */
+    class McInstrumentation : public Singleton<McInstrumentation> {
+        friend class Singleton<McInstrumentation>;
+      private:
+        McInstrumentation() { reset(); }
+      public:
+        enum Phase {
+            Parameters,    /*!< extraction of the simulated process */
+            Rng,           /*!< drawing and Brownian-bridge transform of the variates */
+            Path,          /*!< evolution of the paths; in fused models,
+                                also the computation of the payoffs */
+            Payoff,        /*!< computation of the payoffs of stored paths */
+            Statistics,    /*!< accumulation of the samples */
+            Phases
+        };
+        enum Counter {
+            Paths,               /*!< generated paths, antithetic ones included */
+            RngDraws,            /*!< drawn variates */
+            TermStructureCalls,  /*!< term-structure queries of the parameter extraction */
+            ProcessEvaluations,  /*!< steps evolved by the original process */
+            Counters
+        };
+        void reset();
+        void add(Counter counter, std::uint64_t n) {
+            counters_[counter].fetch_add(n, std::memory_order_relaxed);
+        }
+        void addTime(Phase phase, std::chrono::steady_clock::duration elapsed) {
+            times_[phase].fetch_add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                std::memory_order_relaxed);
+        }
+        std::uint64_t count(Counter counter) const {
+            return counters_[counter].load(std::memory_order_relaxed);
+        }
+        //! cumulative time spent in the phase, in seconds
+        Real time(Phase phase) const {
+            return times_[phase].load(std::memory_order_relaxed) * 1.0e-9;
+        }
+        /*! stores the counters as "paths", "rngDraws",
+            "termStructureCalls" and "processEvaluations", and the
+            times in seconds as "parametersTime", "rngTime",
+            "pathTime", "payoffTime" and "statisticsTime".
+        */
+        template <class Results>
+        void store(Results& additionalResults) const;
+      private:
+        std::atomic<std::uint64_t> counters_[Counters];
+        std::atomic<std::int64_t> times_[Phases];
+    };
+
+
+    //! adds the time spent in its scope to a phase of McInstrumentation
+    /*! While a timer is alive, the timer of the enclosing phase on the
+        same thread, if any, is paused.
+    */
+    class McPhaseTimer {
+      public:
+        explicit McPhaseTimer(McInstrumentation::Phase phase)
+        : phase_(phase), outer_(current()), start_(std::chrono::steady_clock::now()) {
+            if (outer_ != nullptr)
+                outer_->stop(start_);
+            current() = this;
+        }
+        ~McPhaseTimer() {
+            std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+            stop(end);
+            current() = outer_;
+            if (outer_ != nullptr)
+                outer_->start_ = end;
+        }
+        McPhaseTimer(const McPhaseTimer&) = delete;
+        McPhaseTimer& operator=(const McPhaseTimer&) = delete;
+      private:
+        void stop(std::chrono::steady_clock::time_point end) {
+            McInstrumentation::instance().addTime(phase_, end - start_);
+        }
+        static McPhaseTimer*& current() {
+            static thread_local McPhaseTimer* timer = nullptr;
+            return timer;
+        }
+        McInstrumentation::Phase phase_;
+        McPhaseTimer* outer_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+
+    //! resets McInstrumentation and stores it into the results when leaving its scope
+    template <class Results>
+    class McInstrumentationScope {
+      public:
+        explicit McInstrumentationScope(Results& additionalResults)
+        : additionalResults_(additionalResults) {
+            McInstrumentation::instance().reset();
+        }
+        ~McInstrumentationScope() {
+            McInstrumentation::instance().store(additionalResults_);
+        }
+        McInstrumentationScope(const McInstrumentationScope&) = delete;
+        McInstrumentationScope& operator=(const McInstrumentationScope&) = delete;
+      private:
+        Results& additionalResults_;
+    };
+
+
+    // inline definitions
+
+    inline void McInstrumentation::reset() {
+        for (auto& c : counters_)
+            c.store(0, std::memory_order_relaxed);
+        for (auto& t : times_)
+            t.store(0, std::memory_order_relaxed);
+    }
+
+    template <class Results>
+    inline void McInstrumentation::store(Results& additionalResults) const {
+        additionalResults["paths"] = Size(count(Paths));
+        additionalResults["rngDraws"] = Size(count(RngDraws));
+        additionalResults["termStructureCalls"] = Size(count(TermStructureCalls));
+        additionalResults["processEvaluations"] = Size(count(ProcessEvaluations));
+        additionalResults["parametersTime"] = time(Parameters);
+        additionalResults["rngTime"] = time(Rng);
+        additionalResults["pathTime"] = time(Path);
+        additionalResults["payoffTime"] = time(Payoff);
+        additionalResults["statisticsTime"] = time(Statistics);
+    }
+
+}
+
+#define MONTECARLO_INSTRUMENTATION_CAT_(a, b) a##b
+#define MONTECARLO_INSTRUMENTATION_CAT(a, b) MONTECARLO_INSTRUMENTATION_CAT_(a, b)
+
+/*! times the rest of the enclosing scope as the given phase */
+#define MONTECARLO_PHASE(phase) \
+    QuantLib::McPhaseTimer MONTECARLO_INSTRUMENTATION_CAT(mc_phase_timer_, __LINE__)( \
+        QuantLib::McInstrumentation::phase)
+
+/*! adds n to the given counter */
+#define MONTECARLO_COUNT(counter, n) \
+    QuantLib::McInstrumentation::instance().add(QuantLib::McInstrumentation::counter, (n))
+
+/*! resets the instrumentation, and stores it into the given
+    additional results at the end of the enclosing scope */
+#define MONTECARLO_INSTRUMENT(additionalResults) \
+    QuantLib::McInstrumentationScope<typename std::decay<decltype(additionalResults)>::type> \
+        mc_instrumentation_scope_(additionalResults)
+
+#else
+
+#define MONTECARLO_PHASE(phase)
+#define MONTECARLO_COUNT(counter, n)
+#define MONTECARLO_INSTRUMENT(additionalResults)
+
+#endif
+
+
+#endif
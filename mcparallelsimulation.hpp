@@ -0,0 +1,291 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file mcparallelsimulation.hpp
+    \brief Reproducible multi-threaded Monte Carlo simulation
+*/
+
+#ifndef montecarlo_parallel_simulation_hpp
+#define montecarlo_parallel_simulation_hpp
+
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include "montecarlomodel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace QuantLib {
+
+    //! seed of the i-th independent substream derived from a given seed
+    /*! The result is a pure function of its arguments (a SplitMix64
+        hash of the pair) so that any substream can be set up without
+        drawing the ones before it.  It is never zero, since a null
+        seed would make the generators pick a random one.
+
+        All 64 bits of the hash are kept, so that the keys of
+        counter-based generators such as PhiloxUniformRsg do not
+        collide among the tens of thousands of chunks of a long run;
+        the Mersenne twister only uses their lower 32 bits.
+    */
+    inline BigNatural substreamSeed(BigNatural seed, Size i) {
+        std::uint64_t z = static_cast<std::uint64_t>(seed)
+                        + 0x9e3779b97f4a7c15ULL * (static_cast<std::uint64_t>(i) + 1);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        z ^= z >> 31;
+        BigNatural result = static_cast<BigNatural>(z);
+        return result != 0 ? result : 1;
+    }
+
+
+    //! default number of samples of the chunks of ParallelMcSimulation
+    const Size defaultMcChunkSize = 16384;
+
+
+    //! adds the samples collected by a partial accumulator to a total one
+    /*! This works for accumulators storing their samples, such as
+        the ones based on GeneralStatistics; other accumulators can
+        provide an overload (see, e.g., StreamingStatistics).
+    */
+    template <class S>
+    inline void mergeStatistics(S& total, const S& partial) {
+        for (const auto& sample : partial.data())
+            total.add(sample.first, sample.second);
+    }
+
+
+    namespace detail {
+
+        /* Calls f(i) for i in [0, n) on up to the given number of
+           threads, including the calling one.  Exceptions are caught
+           on the workers and the one with the lowest index, if any, is
+           rethrown once all calls are done. */
+        template <class F>
+        inline void forEachInParallel(Size n, Size threads, const F& f) {
+            std::atomic<Size> next(0);
+            std::vector<std::exception_ptr> errors(n);
+            auto work = [&]() {
+                for (Size i = next++; i < n; i = next++) {
+                    try {
+                        f(i);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                }
+            };
+            std::vector<std::thread> workers;
+            for (Size i=1; i<std::min(threads, n); ++i)
+                workers.emplace_back(work);
+            work();
+            for (auto& t : workers)
+                t.join();
+            for (Size i=0; i<n; ++i) {
+                if (errors[i])
+                    std::rethrow_exception(errors[i]);
+            }
+        }
+
+    }
+
+
+    //! Multi-threaded Monte Carlo simulation in reproducible chunks
+    /*! Samples are split into chunks of fixed size.  Chunk \f$ k \f$
+        is simulated by its own model, built with the seed of the
+        \f$ k \f$-th substream of the engine seed; the accumulators of
+        the chunks are then merged in chunk order.  Neither the
+        random numbers nor the order of the samples depend on the
+        number of threads, and neither does the result.
+
+        Models are built on the calling thread, so that the factory
+        can safely query term structures; only the path generation
+        and pricing run on the worker threads.
+
+        Any model providing addSamples() and sampleAccumulator(), such
+        as BatchMonteCarloModel, can be used instead of MonteCarloModel_2.
+
+        The simulation can start at a sample other than the first,
+        provided it is the first of a chunk; it then simulates the
+        same samples as a simulation started at the first one would
+        from there on.  A run can thus be split in blocks of samples
+        simulated by separate processes, whose accumulators are
+        merged afterwards (see mcpartialresults.hpp).
+    */
+    template <template <class> class MC, class RNG, class S,
+              class Model = MonteCarloModel_2<MC,RNG,S> >
+    class ParallelMcSimulation {
+      public:
+        typedef Model model_type;
+        typedef typename model_type::stats_type stats_type;
+        //! builds a model drawing from the stream with the given seed
+        typedef std::function<ext::shared_ptr<model_type>(BigNatural)> model_factory;
+
+        /*! \pre \c firstSample is a multiple of \c chunkSize */
+        ParallelMcSimulation(model_factory factory,
+                             Size threads,
+                             BigNatural seed,
+                             Size firstSample = 0,
+                             Size chunkSize = defaultMcChunkSize);
+        //! adds samples until the required tolerance is reached
+        void value(Real tolerance,
+                   Size maxSamples = QL_MAX_INTEGER,
+                   Size minSamples = 1023) const;
+        //! adds samples until the required number is reached
+        void valueWithSamples(Size samples) const;
+        //! adds samples until the time budget or the tolerance is exhausted
+        void valueWithinBudget(std::chrono::microseconds budget,
+                               Real tolerance = Null<Real>(),
+                               Size maxSamples = QL_MAX_INTEGER) const;
+        //! same interface as SequentialMcSimulation::calculate
+        void calculate(Real requiredTolerance,
+                       Size requiredSamples,
+                       Size maxSamples,
+                       std::chrono::microseconds timeBudget =
+                                         std::chrono::microseconds::zero()) const;
+        const stats_type& sampleAccumulator() const { return stats_; }
+        //! number of simulated paths
+        Size samples() const { return stats_.samples(); }
+      private:
+        void addSamples(Size samples) const;
+        model_factory factory_;
+        Size threads_, chunkSize_;
+        BigNatural seed_;
+        mutable Size chunks_ = 0;
+        mutable stats_type stats_;
+    };
+
+
+    // inline definitions
+
+    template <template <class> class MC, class RNG, class S, class Model>
+    inline ParallelMcSimulation<MC,RNG,S,Model>::ParallelMcSimulation(model_factory factory,
+                                                                      Size threads,
+                                                                      BigNatural seed,
+                                                                      Size firstSample,
+                                                                      Size chunkSize)
+    : factory_(std::move(factory)), threads_(threads), chunkSize_(chunkSize),
+      seed_(seed != 0 ? seed : SeedGenerator::instance().get()) {
+        QL_REQUIRE(threads_ > 0, "at least one thread is required");
+        QL_REQUIRE(chunkSize_ > 0, "chunk size must be positive");
+        QL_REQUIRE(firstSample % chunkSize_ == 0,
+                   "first sample (" << firstSample
+                   << ") is not the first of a chunk of " << chunkSize_ << " samples");
+        chunks_ = firstSample / chunkSize_;
+    }
+
+    template <template <class> class MC, class RNG, class S, class Model>
+    inline void ParallelMcSimulation<MC,RNG,S,Model>::addSamples(Size samples) const {
+        Size n = (samples + chunkSize_ - 1) / chunkSize_;
+        std::vector<ext::shared_ptr<model_type> > models(n);
+        std::vector<Size> sizes(n, chunkSize_);
+        for (Size i=0; i<n; ++i)
+            models[i] = factory_(substreamSeed(seed_, chunks_ + i));
+        if (n > 0)
+            sizes.back() = samples - (n-1)*chunkSize_;
+
+        detail::forEachInParallel(n, threads_, [&](Size i) {
+            models[i]->addSamples(sizes[i]);
+        });
+
+        for (Size i=0; i<n; ++i)
+            mergeStatistics(stats_, models[i]->sampleAccumulator());
+        chunks_ += n;
+    }
+
+    template <template <class> class MC, class RNG, class S, class Model>
+    inline void ParallelMcSimulation<MC,RNG,S,Model>::value(Real tolerance,
+                                                            Size maxSamples,
+                                                            Size minSamples) const {
+        // same strategy as McSimulation::value
+        Size sampleNumber = stats_.samples();
+        if (sampleNumber < minSamples) {
+            addSamples(minSamples - sampleNumber);
+            sampleNumber = stats_.samples();
+        }
+
+        Real error = stats_.errorEstimate();
+        while (error > tolerance) {
+            QL_REQUIRE(sampleNumber < maxSamples,
+                       "max number of samples (" << maxSamples
+                       << ") reached, while error (" << error
+                       << ") is still above tolerance (" << tolerance << ")");
+
+            // conservative estimate of how many samples are needed
+            Real order = error*error/tolerance/tolerance;
+            Size nextBatch =
+                Size(std::max<Real>(static_cast<Real>(sampleNumber)*order*0.8
+                                    - static_cast<Real>(sampleNumber),
+                                    static_cast<Real>(minSamples)));
+
+            // do not exceed maxSamples
+            nextBatch = std::min(nextBatch, maxSamples - sampleNumber);
+            sampleNumber += nextBatch;
+            addSamples(nextBatch);
+            error = stats_.errorEstimate();
+        }
+    }
+
+    template <template <class> class MC, class RNG, class S, class Model>
+    inline void ParallelMcSimulation<MC,RNG,S,Model>::valueWithSamples(Size samples) const {
+        Size sampleNumber = stats_.samples();
+        QL_REQUIRE(samples >= sampleNumber,
+                   "number of already simulated samples (" << sampleNumber
+                   << ") greater than requested samples (" << samples << ")");
+        addSamples(samples - sampleNumber);
+    }
+
+    template <template <class> class MC, class RNG, class S, class Model>
+    inline void ParallelMcSimulation<MC,RNG,S,Model>::valueWithinBudget(
+                                                 std::chrono::microseconds budget,
+                                                 Real tolerance,
+                                                 Size maxSamples) const {
+        detail::addSamplesWithinBudget(
+            [this](Size samples) { addSamples(samples); },
+            stats_, budget, tolerance, maxSamples);
+    }
+
+    template <template <class> class MC, class RNG, class S, class Model>
+    inline void ParallelMcSimulation<MC,RNG,S,Model>::calculate(
+                                          Real requiredTolerance,
+                                          Size requiredSamples,
+                                          Size maxSamples,
+                                          std::chrono::microseconds timeBudget) const {
+        if (timeBudget > std::chrono::microseconds::zero()) {
+            valueWithinBudget(timeBudget, requiredTolerance,
+                              detail::sampleLimit(requiredSamples, maxSamples));
+            return;
+        }
+        QL_REQUIRE(requiredTolerance != Null<Real>() ||
+                   requiredSamples != Null<Size>(),
+                   "neither tolerance nor number of samples set");
+        if (requiredTolerance != Null<Real>()) {
+            if (maxSamples != Null<Size>())
+                value(requiredTolerance, maxSamples);
+            else
+                value(requiredTolerance);
+        } else {
+            valueWithSamples(requiredSamples);
+        }
+    }
+
+}
+
+#endif
@@ -0,0 +1,195 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file mcpartialresults.hpp
+    \brief Monte Carlo runs split in blocks of samples simulated separately
+*/
+
+#ifndef montecarlo_partial_results_hpp
+#define montecarlo_partial_results_hpp
+
+#include <ql/utilities/null.hpp>
+#include "rqmcsimulation.hpp"
+#include "streamingstatistics.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace QuantLib {
+
+    //! accumulator of a block of samples of a Monte Carlo run
+    /*! The samples from \c firstSample() on, in the numbering of a
+        ParallelMcSimulation with the given seed, are summarized by
+        their accumulator.  Engines asked for a block of samples (e.g.,
+        MakeMCEuropeanEngine_2::withSampleBlock) return it, serialized,
+        as the "partialResult" additional result, so that blocks can
+        be simulated by separate processes or hosts and merged by
+        mergePartialResults().
+
+        The serialized result is a compact binary string of fixed
+        size that does not depend on the platform.
+    */
+    class McPartialResult {
+      public:
+        McPartialResult(BigNatural seed, Size firstSample, StreamingStatistics statistics)
+        : seed_(seed), firstSample_(firstSample), statistics_(std::move(statistics)) {}
+        //! \name Inspectors
+        //@{
+        BigNatural seed() const { return seed_; }
+        Size firstSample() const { return firstSample_; }
+        Size samples() const { return statistics_.samples(); }
+        const StreamingStatistics& statistics() const { return statistics_; }
+        //@}
+        //! \name Serialization
+        //@{
+        std::string serialize() const;
+        static McPartialResult deserialize(const std::string& blob);
+        //@}
+      private:
+        BigNatural seed_;
+        Size firstSample_;
+        StreamingStatistics statistics_;
+    };
+
+
+    //! accumulator of the whole run from the ones of its blocks
+    /*! The blocks can be given in any order; they are merged in the
+        order of their samples, so that the result does not depend on
+        which process finished first.  They must come from the same
+        seed and be contiguous.
+
+        The mean and error estimate of the result, i.e., the value and
+        error estimate of the engine, are the ones of the same engine
+        given \c withThreads(...) instead of the blocks, with the same
+        seed and the total number of samples, up to the rounding of
+        the merge.  They differ from the ones of a sequential run,
+        which draws all the samples from a single stream.
+    */
+    StreamingStatistics mergePartialResults(std::vector<McPartialResult> results);
+
+    //! \overload
+    StreamingStatistics mergePartialResults(const std::vector<std::string>& blobs);
+
+
+    namespace detail {
+
+        // first four bytes and version of the serialized results
+        const char partialResultTag[] = "MCPR";
+        const std::uint64_t partialResultVersion = 1;
+
+        /* Checks that an engine can simulate a block of samples, i.e.,
+           that it is not adaptive and uses pseudo-random substreams
+           that a later process can reproduce. */
+        template <class S, class RNG>
+        inline void checkSampleBlock(Size requiredSamples,
+                                     Real requiredTolerance,
+                                     std::chrono::microseconds timeBudget,
+                                     BigNatural seed) {
+            QL_REQUIRE((std::is_same<S, StreamingStatistics>::value),
+                       "blocks of samples require StreamingStatistics as accumulator");
+            QL_REQUIRE(QmcRandomizations<RNG>::value == 0,
+                       "blocks of samples not available with randomized QMC");
+            QL_REQUIRE(requiredSamples != Null<Size>() &&
+                       requiredTolerance == Null<Real>() &&
+                       timeBudget == std::chrono::microseconds::zero(),
+                       "blocks of samples require a fixed number of samples");
+            QL_REQUIRE(seed != 0, "blocks of samples require a given seed");
+        }
+
+        /* Stores the serialized partial result of a block among the
+           additional results; other accumulators are rejected by
+           checkSampleBlock before simulating. */
+        template <class S, class Results>
+        inline void storePartialResult(const S&, BigNatural, Size, Results&) {
+            QL_FAIL("blocks of samples require StreamingStatistics as accumulator");
+        }
+
+        template <class Results>
+        inline void storePartialResult(const StreamingStatistics& stats,
+                                       BigNatural seed,
+                                       Size firstSample,
+                                       Results& results) {
+            results.additionalResults["partialResult"] =
+                McPartialResult(seed, firstSample, stats).serialize();
+        }
+
+    }
+
+
+    // inline definitions
+
+    inline std::string McPartialResult::serialize() const {
+        std::string blob(detail::partialResultTag, 4);
+        detail::writeBinary(blob, detail::partialResultVersion);
+        detail::writeBinary(blob, static_cast<std::uint64_t>(seed_));
+        detail::writeBinary(blob, static_cast<std::uint64_t>(firstSample_));
+        statistics_.serialize(blob);
+        return blob;
+    }
+
+    inline McPartialResult McPartialResult::deserialize(const std::string& blob) {
+        QL_REQUIRE(blob.compare(0, 4, detail::partialResultTag, 4) == 0,
+                   "not a Monte Carlo partial result");
+        std::size_t position = 4;
+        std::uint64_t version = detail::readBinaryInteger(blob, position);
+        QL_REQUIRE(version == detail::partialResultVersion,
+                   "unsupported partial result version (" << version << ")");
+        BigNatural seed = static_cast<BigNatural>(detail::readBinaryInteger(blob, position));
+        Size firstSample = static_cast<Size>(detail::readBinaryInteger(blob, position));
+        StreamingStatistics statistics = StreamingStatistics::deserialize(blob, position);
+        QL_REQUIRE(position == blob.size(), "trailing data after partial result");
+        return McPartialResult(seed, firstSample, statistics);
+    }
+
+
+    inline StreamingStatistics mergePartialResults(std::vector<McPartialResult> results) {
+        QL_REQUIRE(!results.empty(), "no partial results given");
+        std::sort(results.begin(), results.end(),
+                  [](const McPartialResult& a, const McPartialResult& b) {
+                      return a.firstSample() < b.firstSample();
+                  });
+        StreamingStatistics total = results[0].statistics();
+        for (Size i=1; i<results.size(); ++i) {
+            const McPartialResult& previous = results[i-1];
+            QL_REQUIRE(results[i].seed() == previous.seed(),
+                       "partial results from different seeds ("
+                       << previous.seed() << " and " << results[i].seed() << ")");
+            QL_REQUIRE(results[i].firstSample() == previous.firstSample() + previous.samples(),
+                       "partial results are not contiguous: block starting at sample "
+                       << previous.firstSample() << " has " << previous.samples()
+                       << " samples, next block starts at " << results[i].firstSample());
+            mergeStatistics(total, results[i].statistics());
+        }
+        return total;
+    }
+
+    inline StreamingStatistics mergePartialResults(const std::vector<std::string>& blobs) {
+        std::vector<McPartialResult> results;
+        results.reserve(blobs.size());
+        for (const std::string& blob : blobs)
+            results.push_back(McPartialResult::deserialize(blob));
+        return mergePartialResults(std::move(results));
+    }
+
+}
+
+
+#endif
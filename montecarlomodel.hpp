@@ -0,0 +1,329 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ Copyright (C) 2000, 2001, 2002, 2003 RiskMap srl
+ Copyright (C) 2003 Ferdinando Ametrano
+ Copyright (C) 2007 StatPro Italia srl
+
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file montecarlomodel.hpp
+    \brief General-purpose Monte Carlo model without per-sample allocations
+*/
+
+#ifndef montecarlo_montecarlo_model_2_hpp
+#define montecarlo_montecarlo_model_2_hpp
+
+#include <ql/methods/montecarlo/montecarlomodel.hpp>
+#include "mcinstrumentation.hpp"
+#include "streamingstatistics.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace QuantLib {
+
+    namespace detail {
+
+        /* Adds samples in batches until the time budget is spent, the
+           tolerance (if given) is reached, or maxSamples are simulated.
+           After a small first batch, each batch is sized from the
+           observed sampling rate to take about half of the remaining
+           time, so that the deadline is overrun by a fraction of the
+           last batch only; with a tolerance, batches are also capped
+           by the estimate of the samples still needed, but not below
+           a tenth of the samples already drawn. */
+        template <class AddSamples, class Stats>
+        inline void addSamplesWithinBudget(const AddSamples& addSamples,
+                                           const Stats& stats,
+                                           std::chrono::microseconds budget,
+                                           Real tolerance,
+                                           Size maxSamples) {
+            typedef std::chrono::steady_clock clock;
+            clock::time_point start = clock::now();
+            clock::time_point deadline = start + budget;
+            Size initialSamples = stats.samples();
+            Size sampleNumber = initialSamples;
+            Size nextBatch = 128;
+            while (sampleNumber < maxSamples) {
+                addSamples(std::min(nextBatch, maxSamples - sampleNumber));
+                sampleNumber = stats.samples();
+                if (tolerance != Null<Real>() && sampleNumber > 1 &&
+                    stats.errorEstimate() <= tolerance)
+                    break;
+                clock::time_point now = clock::now();
+                if (now >= deadline)
+                    break;
+                Real elapsed = std::chrono::duration<Real>(now - start).count();
+                if (elapsed <= 0.0) {
+                    // too fast to measure: no rate to extrapolate from
+                    nextBatch *= 2;
+                    continue;
+                }
+                Real remaining = std::chrono::duration<Real>(deadline - now).count();
+                Real rate = (sampleNumber - initialSamples) / elapsed;
+                Real batch = 0.5 * rate * remaining;
+                if (tolerance != Null<Real>() && sampleNumber > 1) {
+                    // as in McSimulation::value, do not overshoot the
+                    // tolerance; close to it, the estimate goes to zero,
+                    // so that batches of at least a tenth of the samples
+                    // are added instead of single samples
+                    Real order = stats.errorEstimate() / tolerance;
+                    Real needed = std::max((order * order * 0.8 - 1.0) * sampleNumber,
+                                           std::max(0.1 * sampleNumber, 128.0));
+                    batch = std::min(batch, needed);
+                }
+                nextBatch = Size(std::max<Real>(batch, 1.0));
+            }
+        }
+
+        // at most the required samples and at most maxSamples, if given
+        inline Size sampleLimit(Size requiredSamples, Size maxSamples) {
+            Size limit = QL_MAX_INTEGER;
+            if (requiredSamples != Null<Size>())
+                limit = std::min(limit, requiredSamples);
+            if (maxSamples != Null<Size>())
+                limit = std::min(limit, maxSamples);
+            return limit;
+        }
+
+    }
+
+
+    //! General-purpose Monte Carlo model for path samples
+    /*! Same as MonteCarloModel, including antithetic and control
+        variates, except that the model owns the storage of its paths:
+        the buffers are allocated once per run and passed by reference
+        to the path generator, which fills them in place, and to the
+        path pricer.  MonteCarloModel copies every sample instead,
+        which allocates a time grid and an array per path.
+
+        The path generator must provide next(sample_type&) and
+        antithetic(sample_type&), as PathGenerator_2 does.
+
+        \ingroup mcarlo
+    */
+    template <template <class> class MC, class RNG, class S = StreamingStatistics>
+    class MonteCarloModel_2 {
+      public:
+        typedef MC<RNG> mc_traits;
+        typedef RNG rng_traits;
+        typedef typename MC<RNG>::path_generator_type path_generator_type;
+        typedef typename MC<RNG>::path_pricer_type path_pricer_type;
+        typedef typename path_generator_type::sample_type sample_type;
+        typedef typename path_pricer_type::result_type result_type;
+        typedef S stats_type;
+        // constructor
+        MonteCarloModel_2(
+                  const ext::shared_ptr<path_generator_type>& pathGenerator,
+                  ext::shared_ptr<path_pricer_type> pathPricer,
+                  stats_type sampleAccumulator,
+                  bool antitheticVariate,
+                  ext::shared_ptr<path_pricer_type> cvPathPricer =
+                                     ext::shared_ptr<path_pricer_type>(),
+                  result_type cvOptionValue = result_type(),
+                  const ext::shared_ptr<path_generator_type>& cvPathGenerator =
+                                     ext::shared_ptr<path_generator_type>())
+        : pathGenerator_(pathGenerator), pathPricer_(std::move(pathPricer)),
+          sampleAccumulator_(std::move(sampleAccumulator)),
+          isAntitheticVariate_(antitheticVariate),
+          cvPathPricer_(std::move(cvPathPricer)), cvOptionValue_(cvOptionValue),
+          cvPathGenerator_(cvPathGenerator),
+          path_(typename sample_type::value_type(pathGenerator_->timeGrid()), 1.0),
+          cvPath_(path_) {
+            isControlVariate_ = static_cast<bool>(cvPathPricer_);
+            if (cvPathGenerator_)
+                cvPath_ = sample_type(
+                    typename sample_type::value_type(cvPathGenerator_->timeGrid()), 1.0);
+        }
+        void addSamples(Size samples);
+        const stats_type& sampleAccumulator() const { return sampleAccumulator_; }
+      private:
+        ext::shared_ptr<path_generator_type> pathGenerator_;
+        ext::shared_ptr<path_pricer_type> pathPricer_;
+        stats_type sampleAccumulator_;
+        bool isAntitheticVariate_;
+        ext::shared_ptr<path_pricer_type> cvPathPricer_;
+        result_type cvOptionValue_;
+        bool isControlVariate_;
+        ext::shared_ptr<path_generator_type> cvPathGenerator_;
+        // path storage reused for the whole run
+        sample_type path_, cvPath_;
+    };
+
+
+    //! Monte Carlo simulation driving a single model
+    /*! Same sampling strategy as McSimulation, for any model providing
+        addSamples() and sampleAccumulator() such as MonteCarloModel_2.
+        The model draws a single random stream, so that the samples are
+        the same as those of McSimulation with the same seed.
+    */
+    template <class Model>
+    class SequentialMcSimulation {
+      public:
+        typedef Model model_type;
+        typedef typename model_type::stats_type stats_type;
+        explicit SequentialMcSimulation(ext::shared_ptr<model_type> model)
+        : model_(std::move(model)) {}
+        //! adds samples until the required tolerance is reached
+        void value(Real tolerance,
+                   Size maxSamples = QL_MAX_INTEGER,
+                   Size minSamples = 1023) const;
+        //! adds samples until the required number is reached
+        void valueWithSamples(Size samples) const;
+        //! adds samples until the time budget or the tolerance is exhausted
+        void valueWithinBudget(std::chrono::microseconds budget,
+                               Real tolerance = Null<Real>(),
+                               Size maxSamples = QL_MAX_INTEGER) const;
+        /*! same interface as McSimulation::calculate; with a positive
+            time budget, the tolerance and the number of samples are
+            optional and stop the simulation early if reached.
+        */
+        void calculate(Real requiredTolerance,
+                       Size requiredSamples,
+                       Size maxSamples,
+                       std::chrono::microseconds timeBudget =
+                                         std::chrono::microseconds::zero()) const;
+        const stats_type& sampleAccumulator() const {
+            return model_->sampleAccumulator();
+        }
+        //! number of simulated paths
+        Size samples() const { return model_->sampleAccumulator().samples(); }
+      private:
+        ext::shared_ptr<model_type> model_;
+    };
+
+
+    // inline definitions
+
+    template <template <class> class MC, class RNG, class S>
+    inline void MonteCarloModel_2<MC,RNG,S>::addSamples(Size samples) {
+        for (Size j = 1; j <= samples; j++) {
+            // the generators time their own phases
+            MONTECARLO_PHASE(Payoff);
+
+            pathGenerator_->next(path_);
+            result_type price = (*pathPricer_)(path_.value);
+
+            if (isControlVariate_) {
+                if (!cvPathGenerator_) {
+                    price += cvOptionValue_-(*cvPathPricer_)(path_.value);
+                } else {
+                    cvPathGenerator_->next(cvPath_);
+                    price += cvOptionValue_-(*cvPathPricer_)(cvPath_.value);
+                }
+            }
+
+            if (isAntitheticVariate_) {
+                pathGenerator_->antithetic(path_);
+                result_type price2 = (*pathPricer_)(path_.value);
+                if (isControlVariate_) {
+                    if (!cvPathGenerator_) {
+                        price2 += cvOptionValue_-(*cvPathPricer_)(path_.value);
+                    } else {
+                        cvPathGenerator_->antithetic(cvPath_);
+                        price2 += cvOptionValue_-(*cvPathPricer_)(cvPath_.value);
+                    }
+                }
+
+                MONTECARLO_PHASE(Statistics);
+                sampleAccumulator_.add((price+price2)/2.0, path_.weight);
+            } else {
+                MONTECARLO_PHASE(Statistics);
+                sampleAccumulator_.add(price, path_.weight);
+            }
+        }
+    }
+
+
+    template <class Model>
+    inline void SequentialMcSimulation<Model>::value(Real tolerance,
+                                                     Size maxSamples,
+                                                     Size minSamples) const {
+        // same strategy as McSimulation::value
+        Size sampleNumber = model_->sampleAccumulator().samples();
+        if (sampleNumber < minSamples) {
+            model_->addSamples(minSamples - sampleNumber);
+            sampleNumber = model_->sampleAccumulator().samples();
+        }
+
+        Real error = model_->sampleAccumulator().errorEstimate();
+        while (error > tolerance) {
+            QL_REQUIRE(sampleNumber < maxSamples,
+                       "max number of samples (" << maxSamples
+                       << ") reached, while error (" << error
+                       << ") is still above tolerance (" << tolerance << ")");
+
+            // conservative estimate of how many samples are needed
+            Real order = error*error/tolerance/tolerance;
+            Size nextBatch =
+                Size(std::max<Real>(static_cast<Real>(sampleNumber)*order*0.8
+                                    - static_cast<Real>(sampleNumber),
+                                    static_cast<Real>(minSamples)));
+
+            // do not exceed maxSamples
+            nextBatch = std::min(nextBatch, maxSamples - sampleNumber);
+            sampleNumber += nextBatch;
+            model_->addSamples(nextBatch);
+            error = model_->sampleAccumulator().errorEstimate();
+        }
+    }
+
+    template <class Model>
+    inline void SequentialMcSimulation<Model>::valueWithSamples(Size samples) const {
+        Size sampleNumber = model_->sampleAccumulator().samples();
+        QL_REQUIRE(samples >= sampleNumber,
+                   "number of already simulated samples (" << sampleNumber
+                   << ") greater than requested samples (" << samples << ")");
+        model_->addSamples(samples - sampleNumber);
+    }
+
+    template <class Model>
+    inline void SequentialMcSimulation<Model>::valueWithinBudget(
+                                                 std::chrono::microseconds budget,
+                                                 Real tolerance,
+                                                 Size maxSamples) const {
+        detail::addSamplesWithinBudget(
+            [this](Size samples) { model_->addSamples(samples); },
+            model_->sampleAccumulator(), budget, tolerance, maxSamples);
+    }
+
+    template <class Model>
+    inline void SequentialMcSimulation<Model>::calculate(
+                                          Real requiredTolerance,
+                                          Size requiredSamples,
+                                          Size maxSamples,
+                                          std::chrono::microseconds timeBudget) const {
+        if (timeBudget > std::chrono::microseconds::zero()) {
+            valueWithinBudget(timeBudget, requiredTolerance,
+                              detail::sampleLimit(requiredSamples, maxSamples));
+            return;
+        }
+        QL_REQUIRE(requiredTolerance != Null<Real>() ||
+                   requiredSamples != Null<Size>(),
+                   "neither tolerance nor number of samples set");
+        if (requiredTolerance != Null<Real>()) {
+            if (maxSamples != Null<Size>())
+                value(requiredTolerance, maxSamples);
+            else
+                value(requiredTolerance);
+        } else {
+            valueWithSamples(requiredSamples);
+        }
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,328 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file multiinstrumentsimulation.hpp
+    \brief Monte Carlo pricing of several instruments on the same paths
+*/
+
+#ifndef montecarlo_multi_instrument_simulation_hpp
+#define montecarlo_multi_instrument_simulation_hpp
+
+#include <ql/instrument.hpp>
+#include <ql/math/comparison.hpp>
+#include "mcparallelsimulation.hpp"
+#include "pathgenerator.hpp"
+#include "processparameters.hpp"
+
+namespace QuantLib {
+
+    //! interface of the engines whose paths can be shared among instruments
+    /*! The methods use the arguments currently set into the engine,
+        which must have been filled by the instrument.
+    */
+    template <class RNG>
+    class SharedPathEngine_2 {
+      public:
+        typedef typename SingleVariate_2<RNG>::path_generator_type path_generator_type;
+        typedef typename SingleVariate_2<RNG>::path_pricer_type path_pricer_type;
+        virtual ~SharedPathEngine_2() = default;
+        //! process given to the engine
+        virtual ext::shared_ptr<GeneralizedBlackScholesProcess> sharedProcess() const = 0;
+        //! parameter mode of the simulated process
+        virtual ProcessParameters::Mode sharedParameterMode() const = 0;
+        //! seed of the engine
+        virtual BigNatural sharedSeed() const = 0;
+        //! strike at which the volatility of the simulated process is read
+        /*! Null if the simulated paths do not depend on the strike. */
+        virtual Real sharedStrike() const = 0;
+        //! time grid of the simulated paths
+        virtual TimeGrid sharedTimeGrid() const = 0;
+        //! path generator drawing from the stream with the given seed
+        /*! It is called on the thread setting up the simulation and
+            may be used afterwards on a worker thread.
+        */
+        virtual ext::shared_ptr<path_generator_type>
+        sharedPathGenerator(BigNatural seed) const = 0;
+        //! path pricer for the paths drawn with the given seed
+        /*! \c singleStream tells whether the paths are the ones of a
+            sequential simulation with the engine seed, rather than
+            the ones of a chunk of a multi-threaded simulation.
+        */
+        virtual ext::shared_ptr<path_pricer_type>
+        sharedPathPricer(BigNatural seed, bool singleStream) const = 0;
+    };
+
+
+    //! one accumulator per instrument
+    /*! Provides what the simulations need from an accumulator: the
+        number of samples, which is the same for all instruments, and
+        an error estimate, which is the largest among the instruments
+        so that a required tolerance applies to each of them.
+    */
+    template <class S>
+    class MultiStatistics {
+      public:
+        explicit MultiStatistics(Size instruments = 0) : stats_(instruments) {}
+        Size size() const { return stats_.size(); }
+        S& operator[](Size i) { return stats_[i]; }
+        const S& operator[](Size i) const { return stats_[i]; }
+        Size samples() const { return stats_.empty() ? 0 : stats_.front().samples(); }
+        Real errorEstimate() const {
+            Real error = 0.0;
+            for (const S& s : stats_)
+                error = std::max(error, s.errorEstimate());
+            return error;
+        }
+      private:
+        std::vector<S> stats_;
+    };
+
+    template <class S>
+    inline void mergeStatistics(MultiStatistics<S>& total, const MultiStatistics<S>& partial) {
+        if (total.size() == 0)
+            total = MultiStatistics<S>(partial.size());
+        QL_REQUIRE(total.size() == partial.size(),
+                   "cannot merge statistics of " << partial.size()
+                   << " instruments into statistics of " << total.size());
+        for (Size i=0; i<total.size(); ++i)
+            mergeStatistics(total[i], partial[i]);
+    }
+
+
+    //! Monte Carlo model pricing several instruments on each path
+    /*! Same as MonteCarloModel_2 without control variates, except
+        that every path is priced by each of the path pricers and each
+        price goes to the accumulator of its instrument.
+    */
+    template <class RNG, class S = StreamingStatistics>
+    class MultiPathMonteCarloModel {
+      public:
+        typedef typename SingleVariate_2<RNG>::path_generator_type path_generator_type;
+        typedef typename SingleVariate_2<RNG>::path_pricer_type path_pricer_type;
+        typedef typename path_generator_type::sample_type sample_type;
+        typedef MultiStatistics<S> stats_type;
+        MultiPathMonteCarloModel(ext::shared_ptr<path_generator_type> pathGenerator,
+                                 std::vector<ext::shared_ptr<path_pricer_type> > pathPricers,
+                                 bool antitheticVariate)
+        : pathGenerator_(std::move(pathGenerator)), pathPricers_(std::move(pathPricers)),
+          isAntitheticVariate_(antitheticVariate), sampleAccumulator_(pathPricers_.size()),
+          path_(typename sample_type::value_type(pathGenerator_->timeGrid()), 1.0),
+          prices_(pathPricers_.size()) {}
+        void addSamples(Size samples);
+        const stats_type& sampleAccumulator() const { return sampleAccumulator_; }
+      private:
+        ext::shared_ptr<path_generator_type> pathGenerator_;
+        std::vector<ext::shared_ptr<path_pricer_type> > pathPricers_;
+        bool isAntitheticVariate_;
+        stats_type sampleAccumulator_;
+        sample_type path_;
+        std::vector<Real> prices_;
+    };
+
+
+    //! Monte Carlo pricing of several instruments on the same paths
+    /*! Each path is generated once and priced for every instrument,
+        so that the cost is about the one of a single simulation plus
+        one payoff evaluation per instrument and path.
+
+        Each instrument comes with the _2 engine that would price it
+        on its own; the engines must use the same RNG traits, process,
+        parameter mode and time grid, and the seed of the simulation.
+        When the simulated process depends on the strike, as with
+        constant or piecewise-constant parameters, the strikes can
+        differ only if the volatility does not depend on the strike at
+        the times of the grid.  The paths are drawn by the engine of
+        the first instrument; the other engines provide their path
+        pricers only.  With the same number of threads, the results
+        for each instrument are then the ones of its engine when it
+        simulates the same number of paths.
+
+        Samples are added as in SequentialMcSimulation, or as in
+        ParallelMcSimulation if a number of threads is given; a
+        required tolerance applies to each of the instruments.
+    */
+    template <class RNG = PseudoRandom, class S = StreamingStatistics>
+    class MultiInstrumentMcSimulation_2 {
+      public:
+        typedef MultiPathMonteCarloModel<RNG,S> model_type;
+        typedef typename model_type::stats_type stats_type;
+        MultiInstrumentMcSimulation_2(
+                         std::vector<ext::shared_ptr<Instrument> > instruments,
+                         const std::vector<ext::shared_ptr<PricingEngine> >& engines,
+                         bool antitheticVariate,
+                         BigNatural seed,
+                         Size threads = Null<Size>());
+        //! same interface as SequentialMcSimulation::calculate
+        void calculate(Real requiredTolerance,
+                       Size requiredSamples,
+                       Size maxSamples,
+                       std::chrono::microseconds timeBudget =
+                                         std::chrono::microseconds::zero()) const;
+        //! one accumulator per instrument, in the given order
+        const stats_type& sampleAccumulator() const { return stats_; }
+        //! number of simulated paths
+        Size samples() const { return stats_.samples(); }
+      private:
+        // fills the arguments of the i-th engine from its instrument
+        void setupArguments(Size i) const;
+        ext::shared_ptr<model_type> model(BigNatural seed, bool singleStream) const;
+        std::vector<ext::shared_ptr<Instrument> > instruments_;
+        std::vector<ext::shared_ptr<PricingEngine> > engines_;
+        std::vector<ext::shared_ptr<SharedPathEngine_2<RNG> > > sharedEngines_;
+        bool antitheticVariate_;
+        BigNatural seed_;
+        Size threads_;
+        mutable stats_type stats_;
+    };
+
+
+    // inline definitions
+
+    template <class RNG, class S>
+    inline void MultiPathMonteCarloModel<RNG,S>::addSamples(Size samples) {
+        const Size n = pathPricers_.size();
+        for (Size j = 1; j <= samples; j++) {
+            // the generator times its own phases
+            MONTECARLO_PHASE(Payoff);
+
+            pathGenerator_->next(path_);
+            for (Size i=0; i<n; ++i)
+                prices_[i] = (*pathPricers_[i])(path_.value);
+
+            if (isAntitheticVariate_) {
+                pathGenerator_->antithetic(path_);
+                for (Size i=0; i<n; ++i) {
+                    Real price2 = (*pathPricers_[i])(path_.value);
+                    MONTECARLO_PHASE(Statistics);
+                    sampleAccumulator_[i].add((prices_[i]+price2)/2.0, path_.weight);
+                }
+            } else {
+                MONTECARLO_PHASE(Statistics);
+                for (Size i=0; i<n; ++i)
+                    sampleAccumulator_[i].add(prices_[i], path_.weight);
+            }
+        }
+    }
+
+
+    template <class RNG, class S>
+    inline MultiInstrumentMcSimulation_2<RNG,S>::MultiInstrumentMcSimulation_2(
+                         std::vector<ext::shared_ptr<Instrument> > instruments,
+                         const std::vector<ext::shared_ptr<PricingEngine> >& engines,
+                         bool antitheticVariate,
+                         BigNatural seed,
+                         Size threads)
+    : instruments_(std::move(instruments)), engines_(engines),
+      antitheticVariate_(antitheticVariate),
+      seed_(seed != 0 ? seed : SeedGenerator::instance().get()), threads_(threads) {
+        QL_REQUIRE(!instruments_.empty(), "no instruments given");
+        QL_REQUIRE(instruments_.size() == engines_.size(),
+                   instruments_.size() << " instruments and "
+                   << engines_.size() << " engines given");
+        for (const auto& engine : engines_) {
+            sharedEngines_.push_back(
+                ext::dynamic_pointer_cast<SharedPathEngine_2<RNG> >(engine));
+            QL_REQUIRE(sharedEngines_.back(),
+                       "engine cannot share paths with the given traits");
+        }
+        for (Size i=0; i<sharedEngines_.size(); ++i) {
+            const SharedPathEngine_2<RNG>& engine = *sharedEngines_[i];
+            QL_REQUIRE(engine.sharedSeed() == seed,
+                       "the seed of engine " << i << " (" << engine.sharedSeed()
+                       << ") differs from the one of the simulation (" << seed << ")");
+            QL_REQUIRE(engine.sharedProcess() == sharedEngines_[0]->sharedProcess(),
+                       "the process of engine " << i
+                       << " differs from the one of the first engine");
+            QL_REQUIRE(engine.sharedParameterMode() ==
+                       sharedEngines_[0]->sharedParameterMode(),
+                       "the parameter mode of engine " << i
+                       << " differs from the one of the first engine");
+        }
+    }
+
+    template <class RNG, class S>
+    inline void MultiInstrumentMcSimulation_2<RNG,S>::setupArguments(Size i) const {
+        engines_[i]->reset();
+        instruments_[i]->setupArguments(engines_[i]->getArguments());
+        engines_[i]->getArguments()->validate();
+    }
+
+    template <class RNG, class S>
+    inline ext::shared_ptr<typename MultiInstrumentMcSimulation_2<RNG,S>::model_type>
+    MultiInstrumentMcSimulation_2<RNG,S>::model(BigNatural seed, bool singleStream) const {
+        // the arguments are set again for each model, since an
+        // engine might be shared among instruments
+        ext::shared_ptr<typename model_type::path_generator_type> generator;
+        std::vector<ext::shared_ptr<typename model_type::path_pricer_type> > pricers;
+        for (Size i=0; i<instruments_.size(); ++i) {
+            setupArguments(i);
+            if (i == 0)
+                generator = sharedEngines_[0]->sharedPathGenerator(seed);
+            pricers.push_back(sharedEngines_[i]->sharedPathPricer(seed, singleStream));
+        }
+        return ext::make_shared<model_type>(generator, pricers, antitheticVariate_);
+    }
+
+    template <class RNG, class S>
+    inline void MultiInstrumentMcSimulation_2<RNG,S>::calculate(
+                                          Real requiredTolerance,
+                                          Size requiredSamples,
+                                          Size maxSamples,
+                                          std::chrono::microseconds timeBudget) const {
+        setupArguments(0);
+        TimeGrid grid = sharedEngines_[0]->sharedTimeGrid();
+        Real strike = sharedEngines_[0]->sharedStrike();
+        ext::shared_ptr<BlackVolTermStructure> volatility =
+            sharedEngines_[0]->sharedProcess()->blackVolatility().currentLink();
+        for (Size i=1; i<instruments_.size(); ++i) {
+            setupArguments(i);
+            TimeGrid other = sharedEngines_[i]->sharedTimeGrid();
+            bool sameGrid = (other.size() == grid.size());
+            for (Size j=0; sameGrid && j<grid.size(); ++j)
+                sameGrid = close_enough(other[j], grid[j]);
+            QL_REQUIRE(sameGrid,
+                       "the time grid of instrument " << i
+                       << " differs from the one of the first instrument");
+            // the paths are drawn with the volatility at the first strike
+            Real otherStrike = sharedEngines_[i]->sharedStrike();
+            if (otherStrike != strike) {
+                bool flat = (strike != Null<Real>() && otherStrike != Null<Real>());
+                for (Size j=1; flat && j<grid.size(); ++j)
+                    flat = volatility->blackVol(grid[j], strike, true) ==
+                           volatility->blackVol(grid[j], otherStrike, true);
+                QL_REQUIRE(flat,
+                           "the volatility at the strike of instrument " << i
+                           << " differs from the one at the strike of the first instrument");
+            }
+        }
+
+        if (threads_ == Null<Size>()) {
+            SequentialMcSimulation<model_type> simulation(model(seed_, true));
+            simulation.calculate(requiredTolerance, requiredSamples, maxSamples, timeBudget);
+            stats_ = simulation.sampleAccumulator();
+        } else {
+            ParallelMcSimulation<SingleVariate_2,RNG,S,model_type> simulation(
+                [this](BigNatural seed) { return model(seed, false); }, threads_, seed_);
+            simulation.calculate(requiredTolerance, requiredSamples, maxSamples, timeBudget);
+            stats_ = simulation.sampleAccumulator();
+        }
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,308 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file multilevelmontecarlo.hpp
+    \brief Multilevel Monte Carlo on successively halved time grids
+*/
+
+#ifndef montecarlo_multilevel_montecarlo_hpp
+#define montecarlo_multilevel_montecarlo_hpp
+
+#include <ql/methods/montecarlo/mctraits.hpp>
+#include <ql/timegrid.hpp>
+#include "fusedmontecarlomodel.hpp"
+#include "mcinstrumentation.hpp"
+#include <cmath>
+#include <vector>
+
+namespace QuantLib {
+
+    //! grid with every other node of the given one, and its last node
+    inline TimeGrid coarseTimeGrid(const TimeGrid& grid) {
+        Size n = grid.size() - 1;
+        QL_REQUIRE(n > 1, "at least two steps required to coarsen a time grid");
+        std::vector<Time> times;
+        for (Size i=2; i<=n; i+=2)
+            times.push_back(grid[i]);
+        if (n % 2 != 0)
+            times.push_back(grid[n]);
+        return TimeGrid(times.begin(), times.end());
+    }
+
+
+    //! one level of a multilevel Monte Carlo simulation
+    /*! Each sample is the difference between the payoffs of a path on
+        the fine grid and of the path on the coarse grid (see
+        coarseTimeGrid) driven by the same Brownian increments, i.e.,
+        whose steps are the sums of the fine log-increments.  On the
+        coarsest level there is no coarse path and the sample is the
+        payoff on the fine grid.
+
+        As in FusedMonteCarloModel, the paths are evolved with the
+        deterministic parameters of the process and never stored; the
+        payoffs are computed by kernels with the same interface, built
+        on the fine and on the coarse grid respectively.
+    */
+    template <class GSG, class Kernel, class S>
+    class MultilevelMonteCarloModel {
+      public:
+        typedef Kernel kernel_type;
+        typedef S stats_type;
+        /*! the coarse kernel must be null on the coarsest level */
+        MultilevelMonteCarloModel(const ext::shared_ptr<StochasticProcess>& process,
+                                  const TimeGrid& fineGrid,
+                                  GSG generator,
+                                  kernel_type fineKernel,
+                                  ext::shared_ptr<kernel_type> coarseKernel,
+                                  stats_type sampleAccumulator,
+                                  bool antitheticVariate);
+        void addSamples(Size samples);
+        const stats_type& sampleAccumulator() const { return sampleAccumulator_; }
+        //! cost of a sample, in simulated steps
+        Real cost() const;
+      private:
+        Real value(const std::vector<Real>& variates, Real sign) const;
+        GSG generator_;
+        kernel_type fineKernel_;
+        ext::shared_ptr<kernel_type> coarseKernel_;
+        stats_type sampleAccumulator_;
+        bool isAntitheticVariate_;
+        Real x0_;
+        std::vector<Real> drift_, diffusion_;
+    };
+
+
+    //! multilevel Monte Carlo simulation
+    /*! Given the models of the levels, from the coarsest to the
+        finest, the estimate is the sum of the means of their samples;
+        its expectation is the one of a simulation on the finest grid.
+        After a pilot run on each level, the number of samples of
+        level \f$ l \f$ is set to
+        \f[
+            N_l = \varepsilon^{-2} \sqrt{V_l / C_l}
+                  \sum_k \sqrt{V_k C_k},
+        \f]
+        where \f$ V_l \f$ and \f$ C_l \f$ are the estimated variance
+        and the cost of its samples, which minimizes the total cost
+        for an error estimate \f$ \varepsilon \f$; samples are added
+        and the variances updated until all levels have enough.
+
+        See M.B. Giles, <i>Multilevel Monte Carlo path simulation</i>,
+        Operations Research 56(3), 2008.
+    */
+    template <class Model>
+    class MultilevelMcSimulation {
+      public:
+        typedef Model model_type;
+        typedef typename model_type::stats_type stats_type;
+        explicit MultilevelMcSimulation(std::vector<ext::shared_ptr<model_type> > levels);
+        //! adds samples until the error estimate is below the tolerance
+        /*! \pre no level needs more than \c maxSamples samples for
+                 the tolerance; otherwise an error is raised once all
+                 the levels have \c maxSamples samples.
+        */
+        void value(Real tolerance,
+                   Size maxSamples = QL_MAX_INTEGER,
+                   Size pilotSamples = 1000) const;
+        Real mean() const;
+        Real errorEstimate() const;
+        //! number of samples over all levels
+        Size samples() const;
+        Size levels() const { return levels_.size(); }
+        const stats_type& levelStatistics(Size l) const {
+            return levels_[l]->sampleAccumulator();
+        }
+        Real levelCost(Size l) const { return levels_[l]->cost(); }
+      private:
+        std::vector<ext::shared_ptr<model_type> > levels_;
+    };
+
+
+    // inline definitions
+
+    template <class GSG, class Kernel, class S>
+    inline MultilevelMonteCarloModel<GSG,Kernel,S>::MultilevelMonteCarloModel(
+                                      const ext::shared_ptr<StochasticProcess>& process,
+                                      const TimeGrid& fineGrid,
+                                      GSG generator,
+                                      kernel_type fineKernel,
+                                      ext::shared_ptr<kernel_type> coarseKernel,
+                                      stats_type sampleAccumulator,
+                                      bool antitheticVariate)
+    : generator_(std::move(generator)), fineKernel_(std::move(fineKernel)),
+      coarseKernel_(std::move(coarseKernel)),
+      sampleAccumulator_(std::move(sampleAccumulator)),
+      isAntitheticVariate_(antitheticVariate) {
+        QL_REQUIRE(generator_.dimension() == fineGrid.size() - 1,
+                   "sequence generator dimensionality (" << generator_.dimension()
+                   << ") != timeSteps (" << fineGrid.size() - 1 << ")");
+        ext::shared_ptr<StochasticProcess1D> process1D =
+            ext::dynamic_pointer_cast<StochasticProcess1D>(process);
+        QL_REQUIRE(process1D, "1-D process required");
+        x0_ = process1D->x0();
+        QL_REQUIRE(detail::logNormalSteps(process, fineGrid, drift_, diffusion_),
+                   "process with deterministic parameters required");
+    }
+
+    template <class GSG, class Kernel, class S>
+    inline Real MultilevelMonteCarloModel<GSG,Kernel,S>::cost() const {
+        Size n = drift_.size();
+        Real steps = coarseKernel_ ? n + (n + 1) / 2 : n;
+        return isAntitheticVariate_ ? 2.0 * steps : steps;
+    }
+
+    template <class GSG, class Kernel, class S>
+    inline Real MultilevelMonteCarloModel<GSG,Kernel,S>::value(
+                                    const std::vector<Real>& variates, Real sign) const {
+        typedef typename kernel_type::state_type state_type;
+        const Size n = drift_.size();
+        state_type fine = fineKernel_.initialState(x0_);
+        Real x = x0_;
+        if (!coarseKernel_) {
+            for (Size i=0; i<n; ++i) {
+                x *= std::exp(drift_[i] + diffusion_[i] * (sign * variates[i]));
+                if (!fineKernel_.update(fine, i+1, x))
+                    break;
+            }
+            return fineKernel_.value(fine);
+        }
+
+        state_type coarse = coarseKernel_->initialState(x0_);
+        Real y = x0_, increment = 0.0;
+        bool fineActive = true, coarseActive = true;
+        for (Size i=0; i<n && (fineActive || coarseActive); ++i) {
+            Real step = drift_[i] + diffusion_[i] * (sign * variates[i]);
+            if (fineActive) {
+                x *= std::exp(step);
+                fineActive = fineKernel_.update(fine, i+1, x);
+            }
+            increment += step;
+            // the coarse nodes are the even fine nodes and the last one
+            if ((i+1) % 2 == 0 || i+1 == n) {
+                if (coarseActive) {
+                    y *= std::exp(increment);
+                    coarseActive = coarseKernel_->update(coarse, (i+2)/2, y);
+                }
+                increment = 0.0;
+            }
+        }
+        return fineKernel_.value(fine) - coarseKernel_->value(coarse);
+    }
+
+    template <class GSG, class Kernel, class S>
+    inline void MultilevelMonteCarloModel<GSG,Kernel,S>::addSamples(Size samples) {
+        for (Size j = 1; j <= samples; j++) {
+            MONTECARLO_PHASE(Rng);
+            const typename GSG::sample_type& sequence = generator_.nextSequence();
+            MONTECARLO_COUNT(RngDraws, sequence.value.size());
+            Real price, price2 = 0.0;
+            {
+                MONTECARLO_PHASE(Path);
+                MONTECARLO_COUNT(Paths, isAntitheticVariate_ ? 2 : 1);
+                price = value(sequence.value, 1.0);
+                if (isAntitheticVariate_)
+                    price2 = value(sequence.value, -1.0);
+            }
+            MONTECARLO_PHASE(Statistics);
+            if (isAntitheticVariate_)
+                sampleAccumulator_.add((price+price2)/2.0, sequence.weight);
+            else
+                sampleAccumulator_.add(price, sequence.weight);
+        }
+    }
+
+
+    template <class Model>
+    inline MultilevelMcSimulation<Model>::MultilevelMcSimulation(
+                                       std::vector<ext::shared_ptr<model_type> > levels)
+    : levels_(std::move(levels)) {
+        QL_REQUIRE(!levels_.empty(), "no levels given");
+    }
+
+    template <class Model>
+    inline void MultilevelMcSimulation<Model>::value(Real tolerance,
+                                                     Size maxSamples,
+                                                     Size pilotSamples) const {
+        QL_REQUIRE(tolerance > 0.0, "positive tolerance required");
+        QL_REQUIRE(pilotSamples > 1, "at least two pilot samples required");
+        const Size L = levels_.size();
+        for (Size l=0; l<L; ++l) {
+            Size samples = levels_[l]->sampleAccumulator().samples();
+            if (samples < pilotSamples)
+                levels_[l]->addSamples(pilotSamples - samples);
+        }
+
+        for (;;) {
+            Real sum = 0.0;
+            std::vector<Real> variances(L);
+            for (Size l=0; l<L; ++l) {
+                variances[l] = levels_[l]->sampleAccumulator().variance();
+                sum += std::sqrt(variances[l] * levels_[l]->cost());
+            }
+            bool done = true;
+            for (Size l=0; l<L; ++l) {
+                Real optimal = std::ceil(std::sqrt(variances[l] / levels_[l]->cost())
+                                         * sum / (tolerance * tolerance));
+                Size target = optimal < static_cast<Real>(maxSamples)
+                                  ? static_cast<Size>(optimal) : maxSamples;
+                Size samples = levels_[l]->sampleAccumulator().samples();
+                if (target > samples) {
+                    levels_[l]->addSamples(target - samples);
+                    done = false;
+                }
+            }
+            if (done)
+                break;
+        }
+        // the loop also stops when the levels are capped at maxSamples
+        Real error = errorEstimate();
+        QL_REQUIRE(error <= tolerance,
+                   "max number of samples (" << maxSamples
+                   << ") reached, while error (" << error
+                   << ") is still above tolerance (" << tolerance << ")");
+    }
+
+    template <class Model>
+    inline Real MultilevelMcSimulation<Model>::mean() const {
+        Real result = 0.0;
+        for (const auto& level : levels_)
+            result += level->sampleAccumulator().mean();
+        return result;
+    }
+
+    template <class Model>
+    inline Real MultilevelMcSimulation<Model>::errorEstimate() const {
+        Real variance = 0.0;
+        for (const auto& level : levels_) {
+            Real error = level->sampleAccumulator().errorEstimate();
+            variance += error * error;
+        }
+        return std::sqrt(variance);
+    }
+
+    template <class Model>
+    inline Size MultilevelMcSimulation<Model>::samples() const {
+        Size result = 0;
+        for (const auto& level : levels_)
+            result += level->sampleAccumulator().samples();
+        return result;
+    }
+
+}
+
+
+#endif
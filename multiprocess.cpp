@@ -0,0 +1,316 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*  Monte Carlo runs split among local processes.
+
+    The samples of each option are split in contiguous blocks of
+    whole chunks, one per process.  Each process prices its blocks
+    with the modified engines and constant parameters and sends their
+    serialized accumulators back through a pipe; the accumulators are
+    merged (see mergePartialResults) and compared with the ones of a
+    withThreads(1) run simulating all the samples with the same seed.
+
+    Usage:
+
+        multiprocess [--processes=4] [--samples=1000000]
+                     [--steps=10] [--seed=42]
+
+    The processes are created with fork(), so the program only runs
+    on POSIX systems.  Hosts of a cluster would price their blocks in
+    the same way and exchange the serialized results as files.
+*/
+
+#include <ql/qldefines.hpp>
+#include "mceuropeanengine.hpp"
+#include "mc_discr_arith_av_strike.hpp"
+#include "mcbarrierengine.hpp"
+#include "mcpartialresults.hpp"
+#include <ql/instruments/europeanoption.hpp>
+#include <ql/instruments/asianoption.hpp>
+#include <ql/instruments/barrieroption.hpp>
+#include <ql/instruments/payoffs.hpp>
+#include <ql/exercise.hpp>
+#include <ql/termstructures/yield/zerocurve.hpp>
+#include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace QuantLib;
+
+
+namespace {
+
+    struct DriverSettings {
+        Size processes = 4;
+        Size samples = 1000000;
+        Size steps = 10;
+        BigNatural seed = 42;
+    };
+
+    DriverSettings parseArguments(int argc, char* argv[]) {
+        DriverSettings settings;
+        for (int i=1; i<argc; ++i) {
+            std::string arg = argv[i];
+            std::string::size_type eq = arg.find('=');
+            QL_REQUIRE(arg.compare(0, 2, "--") == 0 && eq != std::string::npos,
+                       "unrecognized argument: " << arg);
+            std::string key = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+            if (key == "processes") {
+                settings.processes = std::stoul(value);
+            } else if (key == "samples") {
+                settings.samples = std::stoul(value);
+            } else if (key == "steps") {
+                settings.steps = std::stoul(value);
+            } else if (key == "seed") {
+                settings.seed = std::stoul(value);
+            } else {
+                QL_FAIL("unrecognized argument: " << arg);
+            }
+        }
+        QL_REQUIRE(settings.processes > 0, "at least one process required");
+        QL_REQUIRE(settings.samples > 0, "at least one sample required");
+        QL_REQUIRE(settings.seed != 0, "a non-null seed is required");
+        return settings;
+    }
+
+
+    // first sample and number of samples of the i-th of n blocks of whole chunks
+    std::pair<Size, Size> block(Size i, Size n, Size samples) {
+        Size chunks = (samples + defaultMcChunkSize - 1) / defaultMcChunkSize;
+        Size first = std::min(i * chunks / n * defaultMcChunkSize, samples);
+        Size last = std::min((i + 1) * chunks / n * defaultMcChunkSize, samples);
+        return std::make_pair(first, last - first);
+    }
+
+
+    // length-prefixed messages on a pipe
+
+    void writeAll(int fd, const char* data, std::size_t size) {
+        while (size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            QL_REQUIRE(written > 0, "cannot write to pipe");
+            data += written;
+            size -= written;
+        }
+    }
+
+    bool readAll(int fd, char* data, std::size_t size) {
+        while (size > 0) {
+            ssize_t read = ::read(fd, data, size);
+            if (read <= 0)
+                return false;
+            data += read;
+            size -= read;
+        }
+        return true;
+    }
+
+    void sendMessage(int fd, const std::string& message) {
+        std::uint64_t size = message.size();
+        writeAll(fd, reinterpret_cast<const char*>(&size), sizeof(size));
+        writeAll(fd, message.data(), message.size());
+    }
+
+    std::string receiveMessage(int fd) {
+        std::uint64_t size;
+        QL_REQUIRE(readAll(fd, reinterpret_cast<char*>(&size), sizeof(size)),
+                   "worker process failed");
+        std::string message(size, '\0');
+        QL_REQUIRE(readAll(fd, &message[0], size), "worker process failed");
+        return message;
+    }
+
+
+    struct Case {
+        std::string name;
+        Instrument* option;
+        // engine pricing the given block of samples, or all of them if null
+        std::function<ext::shared_ptr<PricingEngine>(Size, Size)> engine;
+    };
+
+}
+
+
+int main(int argc, char* argv[]) {
+
+    try {
+
+        DriverSettings settings = parseArguments(argc, argv);
+
+        // same market and options as in main.cpp
+
+        Date today = Date(24, February, 2022);
+        Settings::instance().evaluationDate() = today;
+
+        Real underlying = 36;
+
+        Handle<Quote> underlyingH(ext::make_shared<SimpleQuote>(underlying));
+
+        DayCounter dayCounter = Actual365Fixed();
+        Handle<YieldTermStructure> riskFreeRate(
+            ext::make_shared<ZeroCurve>(std::vector<Date>{today, today + 6*Months},
+                                        std::vector<Rate>{0.01, 0.015},
+                                        dayCounter));
+        Handle<BlackVolTermStructure> volatility(
+            ext::make_shared<BlackVarianceCurve>(today,
+                                                 std::vector<Date>{today+3*Months, today+6*Months},
+                                                 std::vector<Volatility>{0.20, 0.25},
+                                                 dayCounter));
+
+        auto bsmProcess = ext::make_shared<BlackScholesProcess>(underlyingH, riskFreeRate, volatility);
+
+        Real strike = 40;
+        Date maturity(24, May, 2022);
+
+        Option::Type type(Option::Put);
+        auto exercise = ext::make_shared<EuropeanExercise>(maturity);
+        auto payoff = ext::make_shared<PlainVanillaPayoff>(type, strike);
+
+        EuropeanOption europeanOption(payoff, exercise);
+
+        DiscreteAveragingAsianOption asianOption(Average::Arithmetic,
+                                                 {
+                                                     Date(4, March, 2022), Date(14, March, 2022), Date(24, March, 2022),
+                                                     Date(4, April, 2022), Date(14, April, 2022), Date(24, April, 2022),
+                                                     Date(4, May, 2022), Date(14, May, 2022), Date(24, May, 2022)
+                                                 },
+                                                 payoff, exercise);
+
+        BarrierOption barrierOption(Barrier::UpIn, 40, 0, payoff, exercise);
+
+        Size steps = settings.steps;
+        BigNatural seed = settings.seed;
+        std::vector<Case> cases = {
+            {"European", &europeanOption, [&](Size first, Size samples) {
+                 MakeMCEuropeanEngine_2<PseudoRandom> engine(bsmProcess);
+                 engine.withSteps(steps).withSeed(seed).withConstantParameters(true);
+                 if (first != Null<Size>())
+                     engine.withSampleBlock(first, samples);
+                 else
+                     engine.withSamples(samples).withThreads(1);
+                 return ext::shared_ptr<PricingEngine>(engine);
+             }},
+            {"Asian", &asianOption, [&](Size first, Size samples) {
+                 MakeMCDiscreteArithmeticASEngine_2<PseudoRandom> engine(bsmProcess);
+                 engine.withSeed(seed).withConstantParameters(true);
+                 if (first != Null<Size>())
+                     engine.withSampleBlock(first, samples);
+                 else
+                     engine.withSamples(samples).withThreads(1);
+                 return ext::shared_ptr<PricingEngine>(engine);
+             }},
+            {"Barrier", &barrierOption, [&](Size first, Size samples) {
+                 MakeMCBarrierEngine_2<PseudoRandom> engine(bsmProcess);
+                 engine.withSteps(steps).withSeed(seed).withConstantParameters(true);
+                 if (first != Null<Size>())
+                     engine.withSampleBlock(first, samples);
+                 else
+                     engine.withSamples(samples).withThreads(1);
+                 return ext::shared_ptr<PricingEngine>(engine);
+             }}
+        };
+
+        // workers: each one prices its block of every option
+
+        Size n = settings.processes;
+        std::vector<pid_t> workers(n);
+        std::vector<int> pipes(n);
+        for (Size i=0; i<n; ++i) {
+            int fd[2];
+            QL_REQUIRE(::pipe(fd) == 0, "cannot create pipe");
+            pid_t pid = ::fork();
+            QL_REQUIRE(pid >= 0, "cannot create process");
+            if (pid == 0) {
+                ::close(fd[0]);
+                int status = 0;
+                try {
+                    std::pair<Size, Size> b = block(i, n, settings.samples);
+                    for (const Case& c : cases) {
+                        std::string result;
+                        if (b.second > 0) {
+                            c.option->setPricingEngine(c.engine(b.first, b.second));
+                            result = c.option->result<std::string>("partialResult");
+                        }
+                        sendMessage(fd[1], result);
+                    }
+                } catch (std::exception& e) {
+                    std::cerr << "process " << i << ": " << e.what() << std::endl;
+                    status = 1;
+                }
+                ::close(fd[1]);
+                ::_exit(status);
+            }
+            ::close(fd[1]);
+            workers[i] = pid;
+            pipes[i] = fd[0];
+        }
+
+        std::vector<std::vector<std::string> > blobs(cases.size());
+        for (Size i=0; i<n; ++i) {
+            for (Size k=0; k<cases.size(); ++k) {
+                std::string blob = receiveMessage(pipes[i]);
+                // processes left without samples send nothing to merge
+                if (!blob.empty())
+                    blobs[k].push_back(blob);
+            }
+            ::close(pipes[i]);
+        }
+        for (Size i=0; i<n; ++i) {
+            int status;
+            ::waitpid(workers[i], &status, 0);
+            QL_REQUIRE(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                       "process " << i << " failed");
+        }
+
+        // merged results against a withThreads(1) run
+
+        Size width = 18;
+        auto spacer = std::setw(width);
+        std::cout << spacer << "kind" << spacer << "processes"
+                  << spacer << "NPV" << spacer << "error"
+                  << spacer << "single NPV" << spacer << "single error"
+                  << spacer << "difference" << std::endl;
+        std::cout << std::string(5, ' ') << std::string(121, '-') << std::endl;
+        for (Size k=0; k<cases.size(); ++k) {
+            const Case& c = cases[k];
+            StreamingStatistics merged = mergePartialResults(blobs[k]);
+            c.option->setPricingEngine(c.engine(Null<Size>(), settings.samples));
+            Real npv = c.option->NPV(), error = c.option->errorEstimate();
+            std::cout << std::setprecision(10)
+                      << spacer << c.name << spacer << blobs[k].size()
+                      << spacer << merged.mean() << spacer << merged.errorEstimate()
+                      << spacer << npv << spacer << error
+                      << spacer << std::fabs(merged.mean() - npv) << std::endl;
+        }
+
+        return 0;
+
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,260 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ Copyright (C) 2003 Ferdinando Ametrano
+ Copyright (C) 2000, 2001, 2002, 2003 RiskMap srl
+ Copyright (C) 2003, 2004, 2005 StatPro Italia srl
+
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file pathgenerator.hpp
+    \brief Path generator with exact stepping for deterministic Black-Scholes processes
+*/
+
+#ifndef montecarlo_path_generator_2_hpp
+#define montecarlo_path_generator_2_hpp
+
+#include <ql/methods/montecarlo/brownianbridge.hpp>
+#include <ql/methods/montecarlo/mctraits.hpp>
+#include <ql/methods/montecarlo/path.hpp>
+#include <ql/methods/montecarlo/sample.hpp>
+#include <ql/stochasticprocess.hpp>
+#include "constantblackscholesprocess.hpp"
+#include "inversecumulativersg.hpp"
+#include "mcinstrumentation.hpp"
+#include "piecewiseconstantblackscholesprocess.hpp"
+#include "tabulatedblackscholesprocess.hpp"
+#include <cmath>
+#include <vector>
+
+namespace QuantLib {
+
+    namespace detail {
+
+        /* Log-drift and log-diffusion of each step of the grid for the
+           processes with deterministic parameters; returns false for
+           any other process. */
+        inline bool logNormalSteps(const ext::shared_ptr<StochasticProcess>& process,
+                                   const TimeGrid& grid,
+                                   std::vector<Real>& drift,
+                                   std::vector<Real>& diffusion) {
+            Size n = grid.size() - 1;
+            if (ext::shared_ptr<ConstantBlackScholesProcess> constantProcess =
+                    ext::dynamic_pointer_cast<ConstantBlackScholesProcess>(process)) {
+                Real sigma = constantProcess->volatility();
+                Real mu = constantProcess->riskFreeRate() - constantProcess->dividend()
+                        - 0.5 * sigma * sigma;
+                drift.resize(n);
+                diffusion.resize(n);
+                for (Size i=0; i<n; ++i) {
+                    Time dt = grid.dt(i);
+                    drift[i] = mu * dt;
+                    diffusion[i] = sigma * std::sqrt(dt);
+                }
+                return true;
+            }
+            if (ext::shared_ptr<PiecewiseConstantBlackScholesProcess> piecewiseProcess =
+                    ext::dynamic_pointer_cast<PiecewiseConstantBlackScholesProcess>(process)) {
+                drift.resize(n);
+                diffusion.resize(n);
+                for (Size i=0; i<n; ++i) {
+                    drift[i] = piecewiseProcess->logDrift(grid[i], grid.dt(i));
+                    diffusion[i] = std::sqrt(piecewiseProcess->logVariance(grid[i], grid.dt(i)));
+                }
+                return true;
+            }
+            if (ext::shared_ptr<TabulatedBlackScholesProcess> tabulatedProcess =
+                    ext::dynamic_pointer_cast<TabulatedBlackScholesProcess>(process)) {
+                drift.resize(n);
+                diffusion.resize(n);
+                for (Size i=0; i<n; ++i) {
+                    drift[i] = tabulatedProcess->logDrift(grid[i], grid.dt(i));
+                    diffusion[i] = std::sqrt(tabulatedProcess->logVariance(grid[i], grid.dt(i)));
+                }
+                return true;
+            }
+            return false;
+        }
+
+    }
+
+
+    //! Generates random paths using a sequence generator
+    /*! Same as PathGenerator, except for ConstantBlackScholesProcess,
+        PiecewiseConstantBlackScholesProcess and
+        TabulatedBlackScholesProcess: since their parameters are
+        deterministic, the log-drift \f$ \mu_i \f$ (e.g.,
+        \f$ (r-q-\sigma^2/2)\Delta t_i \f$) and the log-diffusion
+        \f$ \nu_i \f$ (e.g., \f$ \sigma\sqrt{\Delta t_i} \f$) of each
+        step of the time grid are computed once, and the path is
+        evolved exactly as
+        \f[
+            S_{i+1} = S_i \exp(\mu_i + \nu_i w_i)
+        \f]
+        with one multiply-add and one exponential per step and no
+        virtual calls.  Other processes are evolved through their
+        own discretization, as in PathGenerator.
+
+        Paths can also be generated into storage owned by the caller,
+        which must have been built on the same time grid; this lets a
+        model reuse one buffer for the whole run.
+
+        \ingroup mcarlo
+    */
+    template <class GSG>
+    class PathGenerator_2 {
+      public:
+        typedef Sample<Path> sample_type;
+        // constructor
+        PathGenerator_2(const ext::shared_ptr<StochasticProcess>&,
+                        TimeGrid timeGrid,
+                        GSG generator,
+                        bool brownianBridge);
+        //! \name inspectors
+        //@{
+        const sample_type& next() const;
+        const sample_type& antithetic() const;
+        Size size() const { return dimension_; }
+        const TimeGrid& timeGrid() const { return timeGrid_; }
+        //@}
+        //! \name generation into caller-owned storage
+        //@{
+        void next(sample_type& path) const;
+        void antithetic(sample_type& path) const;
+        //@}
+      private:
+        void next(bool antithetic, sample_type& sample) const;
+        bool brownianBridge_;
+        GSG generator_;
+        Size dimension_;
+        TimeGrid timeGrid_;
+        ext::shared_ptr<StochasticProcess1D> process_;
+        // per-step log-drift and log-diffusion, empty for other processes
+        std::vector<Real> drift_, diffusion_;
+        mutable sample_type next_;
+        mutable std::vector<Real> temp_;
+        BrownianBridge bb_;
+    };
+
+
+    //! default Monte Carlo traits for single-variate models with PathGenerator_2
+    template <class RNG = PseudoRandom>
+    struct SingleVariate_2 {
+        typedef RNG rng_traits;
+        typedef Path path_type;
+        typedef PathPricer<path_type> path_pricer_type;
+        typedef typename SequenceGenerator_2<RNG>::rsg_type rsg_type;
+        typedef PathGenerator_2<rsg_type> path_generator_type;
+        enum { allowsErrorEstimate = RNG::allowsErrorEstimate };
+        static rsg_type make_sequence_generator(Size dimension, BigNatural seed) {
+            return SequenceGenerator_2<RNG>::make(dimension, seed);
+        }
+    };
+
+
+    // template definitions
+
+    template <class GSG>
+    PathGenerator_2<GSG>::PathGenerator_2(const ext::shared_ptr<StochasticProcess>& process,
+                                          TimeGrid timeGrid,
+                                          GSG generator,
+                                          bool brownianBridge)
+    : brownianBridge_(brownianBridge), generator_(std::move(generator)),
+      dimension_(generator_.dimension()), timeGrid_(std::move(timeGrid)),
+      process_(ext::dynamic_pointer_cast<StochasticProcess1D>(process)),
+      next_(Path(timeGrid_), 1.0), temp_(dimension_), bb_(timeGrid_) {
+        QL_REQUIRE(dimension_==timeGrid_.size()-1,
+                   "sequence generator dimensionality (" << dimension_
+                   << ") != timeSteps (" << timeGrid_.size()-1 << ")");
+        QL_REQUIRE(process_, "1-D process required");
+        detail::logNormalSteps(process, timeGrid_, drift_, diffusion_);
+    }
+
+    template <class GSG>
+    const typename PathGenerator_2<GSG>::sample_type&
+    PathGenerator_2<GSG>::next() const {
+        next(false, next_);
+        return next_;
+    }
+
+    template <class GSG>
+    const typename PathGenerator_2<GSG>::sample_type&
+    PathGenerator_2<GSG>::antithetic() const {
+        next(true, next_);
+        return next_;
+    }
+
+    template <class GSG>
+    void PathGenerator_2<GSG>::next(sample_type& path) const {
+        next(false, path);
+    }
+
+    template <class GSG>
+    void PathGenerator_2<GSG>::antithetic(sample_type& path) const {
+        next(true, path);
+    }
+
+    template <class GSG>
+    void PathGenerator_2<GSG>::next(bool antithetic, sample_type& sample) const {
+
+        typedef typename GSG::sample_type sequence_type;
+        {
+            MONTECARLO_PHASE(Rng);
+            const sequence_type& sequence_ =
+                antithetic ? generator_.lastSequence()
+                           : generator_.nextSequence();
+
+            if (brownianBridge_) {
+                bb_.transform(sequence_.value.begin(),
+                              sequence_.value.end(),
+                              temp_.begin());
+            } else {
+                std::copy(sequence_.value.begin(),
+                          sequence_.value.end(),
+                          temp_.begin());
+            }
+
+            sample.weight = sequence_.weight;
+            MONTECARLO_COUNT(RngDraws, antithetic ? 0 : sequence_.value.size());
+        }
+
+        MONTECARLO_PHASE(Path);
+        MONTECARLO_COUNT(Paths, 1);
+        Path& path = sample.value;
+        path.front() = process_->x0();
+
+        if (!drift_.empty()) {
+            Real sign = antithetic ? -1.0 : 1.0;
+            Real x = path.front();
+            for (Size i=1; i<path.length(); i++) {
+                x *= std::exp(drift_[i-1] + diffusion_[i-1] * (sign * temp_[i-1]));
+                path[i] = x;
+            }
+        } else {
+            MONTECARLO_COUNT(ProcessEvaluations, path.length() - 1);
+            for (Size i=1; i<path.length(); i++) {
+                Time t = timeGrid_[i-1];
+                Time dt = timeGrid_.dt(i-1);
+                path[i] = process_->evolve(t, path[i-1], dt,
+                                           antithetic ? -temp_[i-1] :
+                                                         temp_[i-1]);
+            }
+        }
+    }
+
+}
+
+
+#endif
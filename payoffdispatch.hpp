@@ -0,0 +1,106 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file payoffdispatch.hpp
+    \brief Option and barrier types as template arguments of the path pricers
+*/
+
+#ifndef montecarlo_payoff_dispatch_hpp
+#define montecarlo_payoff_dispatch_hpp
+
+#include <ql/errors.hpp>
+#include <ql/instruments/barriertype.hpp>
+#include <ql/option.hpp>
+#include <algorithm>
+#include <type_traits>
+
+namespace QuantLib {
+
+    //! option type known at compile time
+    template <Option::Type Type>
+    using OptionTypeTag = std::integral_constant<Option::Type, Type>;
+
+    //! barrier type known at compile time
+    template <Barrier::Type BarrierType>
+    using BarrierTypeTag = std::integral_constant<Barrier::Type, BarrierType>;
+
+    //! plain-vanilla payoff of the option type \c Type
+    /*! Same as PlainVanillaPayoff, without its switch on the type. */
+    template <Option::Type Type, class T>
+    inline T vanillaPayoff(T price, T strike) {
+        return Type == Option::Call ? std::max(price - strike, T(0))
+                                    : std::max(strike - price, T(0));
+    }
+
+    //! whether \c BarrierType is an up barrier
+    template <Barrier::Type BarrierType>
+    constexpr bool isUpBarrier() {
+        return BarrierType == Barrier::UpIn || BarrierType == Barrier::UpOut;
+    }
+
+    //! whether \c BarrierType is a knock-in barrier
+    template <Barrier::Type BarrierType>
+    constexpr bool isKnockIn() {
+        return BarrierType == Barrier::UpIn || BarrierType == Barrier::DownIn;
+    }
+
+    //! calls \c f with the OptionTypeTag of \c type
+    /*! The engines call it once per calculation, so that the path
+        pricers instantiated by \c f test no types per path.  All the
+        calls of \c f must return the same type.
+    */
+    template <class F>
+    inline auto dispatchOptionType(Option::Type type, F f)
+    -> decltype(f(OptionTypeTag<Option::Call>())) {
+        switch (type) {
+          case Option::Call:
+            return f(OptionTypeTag<Option::Call>());
+          case Option::Put:
+            return f(OptionTypeTag<Option::Put>());
+          default:
+            QL_FAIL("unknown option type");
+        }
+    }
+
+    //! calls \c f with the BarrierTypeTag and OptionTypeTag of the types
+    /*! Same as dispatchOptionType for the eight combinations of
+        barrier and option types.
+    */
+    template <class F>
+    inline auto dispatchBarrierType(Barrier::Type barrierType,
+                                    Option::Type type, F f)
+    -> decltype(f(BarrierTypeTag<Barrier::UpIn>(), OptionTypeTag<Option::Call>())) {
+        return dispatchOptionType(type, [&](auto optionType) {
+            switch (barrierType) {
+              case Barrier::DownIn:
+                return f(BarrierTypeTag<Barrier::DownIn>(), optionType);
+              case Barrier::UpIn:
+                return f(BarrierTypeTag<Barrier::UpIn>(), optionType);
+              case Barrier::DownOut:
+                return f(BarrierTypeTag<Barrier::DownOut>(), optionType);
+              case Barrier::UpOut:
+                return f(BarrierTypeTag<Barrier::UpOut>(), optionType);
+              default:
+                QL_FAIL("unknown barrier type");
+            }
+        });
+    }
+
+}
+
+
+#endif
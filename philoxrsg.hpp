@@ -0,0 +1,213 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file philoxrsg.hpp
+    \brief Counter-based uniform sequences and random-number traits
+*/
+
+#ifndef montecarlo_philox_rsg_hpp
+#define montecarlo_philox_rsg_hpp
+
+#include <ql/math/randomnumbers/seedgenerator.hpp>
+#include "inversecumulativersg.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Philox-4x32-10 counter-based generator
+    /*! Each 128-bit counter is mapped by ten rounds of a bijection
+        keyed by a 64-bit key to four 32-bit random words (J. K.
+        Salmon, M. A. Moraes, R. O. Dror and D. E. Shaw, <i>Parallel
+        random numbers: as easy as 1, 2, 3</i>, 2011).  The words are a
+        pure function of the counter and the key: there is no state to
+        advance, and any of them can be computed directly.
+
+        The counters are given in structure-of-arrays form and
+        transformed in place, a few at a time, so that the loop over
+        them is vectorized by the compiler.
+    */
+    class Philox4x32 {
+      public:
+        explicit Philox4x32(std::uint64_t key)
+        : key0_(static_cast<std::uint32_t>(key)),
+          key1_(static_cast<std::uint32_t>(key >> 32)) {}
+        //! replaces the n counters (c0[i], c1[i], c2[i], c3[i]) by their random words
+        void operator()(Size n,
+                        std::uint32_t* c0, std::uint32_t* c1,
+                        std::uint32_t* c2, std::uint32_t* c3) const;
+      private:
+        std::uint32_t key0_, key1_;
+    };
+
+
+    //! counter-based uniform sequence generator
+    /*! The \f$ j \f$-th uniform of the \f$ i \f$-th sequence depends
+        only on the seed, \f$ i \f$ and \f$ j \f$: with \f$ d \f$ the
+        dimensionality and \f$ w = i d + j \f$, it is word
+        \f$ w \bmod 4 \f$ of the Philox4x32 output for the counter
+        \f$ \lfloor w/4 \rfloor \f$ and the seed as key, mapped to the
+        center of its dyadic interval as in MersenneTwisterUniformRng,
+        so that 0 and 1 are never returned.
+
+        The generator can thus start at any sequence (see skipTo), and
+        sequences drawn with different seeds are independent.  All 64
+        bits of the seed are used as key; the chunks of
+        ParallelMcSimulation are keyed by their 64-bit substream seeds
+        (see substreamSeed), so that the draws of a chunk depend only
+        on the engine seed, the chunk, the path and the step.  The words of a few
+        sequences are computed at a time, so that enough counters are
+        transformed together to fill the vector units.
+
+        \ingroup mcarlo
+    */
+    class PhiloxUniformRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        /*! A null seed is replaced by one from SeedGenerator, as in
+            MersenneTwisterUniformRng. */
+        PhiloxUniformRsg(Size dimensionality, BigNatural seed);
+        const sample_type& nextSequence() const;
+        const sample_type& lastSequence() const { return sequence_; }
+        Size dimension() const { return dimension_; }
+        //! the next sequence returned will be the i-th one
+        void skipTo(std::uint64_t i) { next_ = i; }
+      private:
+        // computes the words of the sequences from the i-th on
+        void fill(std::uint64_t i) const;
+        Philox4x32 philox_;
+        Size dimension_, batchSize_;
+        mutable std::uint64_t next_ = 0;
+        // sequences and first word in the buffer
+        mutable std::uint64_t batchStart_ = 0, batchEnd_ = 0, firstWord_ = 0;
+        mutable std::vector<std::uint32_t> c0_, c1_, c2_, c3_, words_;
+        mutable sample_type sequence_;
+    };
+
+
+    //! counter-based pseudo-random traits
+    /*! Gaussian sequences are obtained from PhiloxUniformRsg by the
+        inverse cumulative \c IC, as in GenericPseudoRandom.  Since the
+        generators of different seeds are independent, the traits
+        allow error estimates and multi-threaded simulations.
+    */
+    template <class IC>
+    struct GenericPhiloxRandom {
+        typedef PhiloxUniformRsg ursg_type;
+        typedef InverseCumulativeRsg_2<ursg_type,IC> rsg_type;
+        enum { allowsErrorEstimate = 1 };
+        static rsg_type make_sequence_generator(Size dimension, BigNatural seed) {
+            return rsg_type(ursg_type(dimension, seed));
+        }
+    };
+
+    //! default counter-based pseudo-random traits
+    typedef GenericPhiloxRandom<InverseCumulativeNormal> PhiloxRandom;
+
+
+    // inline definitions
+
+    inline void Philox4x32::operator()(Size n,
+                                       std::uint32_t* c0, std::uint32_t* c1,
+                                       std::uint32_t* c2, std::uint32_t* c3) const {
+        const std::uint64_t m0 = 0xD2511F53, m1 = 0xCD9E8D57;
+        // tiles of fixed size in local arrays, which the compiler
+        // knows not to alias, so that the rounds are vectorized
+        const Size tile = 16;
+        for (Size start = 0; start < n; start += tile) {
+            Size m = std::min(tile, n - start);
+            std::uint32_t x0[tile] = {}, x1[tile] = {}, x2[tile] = {}, x3[tile] = {};
+            std::copy(c0 + start, c0 + start + m, x0);
+            std::copy(c1 + start, c1 + start + m, x1);
+            std::copy(c2 + start, c2 + start + m, x2);
+            std::copy(c3 + start, c3 + start + m, x3);
+            std::uint32_t k0 = key0_, k1 = key1_;
+            for (int round = 0; round < 10; ++round) {
+                for (Size i = 0; i < tile; ++i) {
+                    std::uint64_t p0 = m0 * x0[i], p1 = m1 * x2[i];
+                    std::uint32_t y0 = static_cast<std::uint32_t>(p1 >> 32) ^ x1[i] ^ k0;
+                    std::uint32_t y2 = static_cast<std::uint32_t>(p0 >> 32) ^ x3[i] ^ k1;
+                    x1[i] = static_cast<std::uint32_t>(p1);
+                    x3[i] = static_cast<std::uint32_t>(p0);
+                    x0[i] = y0;
+                    x2[i] = y2;
+                }
+                k0 += 0x9E3779B9;
+                k1 += 0xBB67AE85;
+            }
+            std::copy(x0, x0 + m, c0 + start);
+            std::copy(x1, x1 + m, c1 + start);
+            std::copy(x2, x2 + m, c2 + start);
+            std::copy(x3, x3 + m, c3 + start);
+        }
+    }
+
+
+    inline PhiloxUniformRsg::PhiloxUniformRsg(Size dimensionality, BigNatural seed)
+    : philox_(static_cast<std::uint64_t>(seed != 0 ? seed : SeedGenerator::instance().get())),
+      dimension_(dimensionality),
+      // at least 256 words per batch
+      batchSize_(dimensionality > 0 ? (256 + dimensionality - 1) / dimensionality : 1),
+      sequence_(std::vector<Real>(dimensionality), 1.0) {
+        QL_REQUIRE(dimensionality > 0, "dimensionality must be greater than 0");
+        // one more counter, since the batch might not start on a multiple of four
+        Size counters = (batchSize_ * dimension_ + 3) / 4 + 1;
+        c0_.resize(counters);
+        c1_.resize(counters);
+        c2_.resize(counters);
+        c3_.resize(counters);
+        words_.resize(4 * counters);
+    }
+
+    inline void PhiloxUniformRsg::fill(std::uint64_t i) const {
+        std::uint64_t first = (i * dimension_) / 4;
+        Size n = c0_.size();
+        for (Size k = 0; k < n; ++k) {
+            c0_[k] = static_cast<std::uint32_t>(first + k);
+            c1_[k] = static_cast<std::uint32_t>((first + k) >> 32);
+            c2_[k] = 0;
+            c3_[k] = 0;
+        }
+        philox_(n, c0_.data(), c1_.data(), c2_.data(), c3_.data());
+        for (Size k = 0; k < n; ++k) {
+            words_[4*k] = c0_[k];
+            words_[4*k+1] = c1_[k];
+            words_[4*k+2] = c2_[k];
+            words_[4*k+3] = c3_[k];
+        }
+        batchStart_ = i;
+        batchEnd_ = i + batchSize_;
+        firstWord_ = 4 * first;
+    }
+
+    inline const PhiloxUniformRsg::sample_type& PhiloxUniformRsg::nextSequence() const {
+        if (next_ < batchStart_ || next_ >= batchEnd_)
+            fill(next_);
+        const Real normalization = 1.0 / 4294967296.0;
+        const std::uint32_t* w = words_.data() + (next_ * dimension_ - firstWord_);
+        Real* x = sequence_.value.data();
+        for (Size j = 0; j < dimension_; ++j)
+            x[j] = (w[j] + 0.5) * normalization;
+        ++next_;
+        return sequence_;
+    }
+
+}
+
+
+#endif
@@ -0,0 +1,125 @@
+#include "piecewiseconstantblackscholesprocess.hpp"
+#include "mcinstrumentation.hpp"
+#include <ql/processes/eulerdiscretization.hpp>
+#include <algorithm>
+
+namespace QuantLib {
+
+    PiecewiseConstantBlackScholesProcess::PiecewiseConstantBlackScholesProcess(
+                                                double underlyingValue,
+                                                std::vector<Time> times,
+                                                std::vector<double> riskFreeRates,
+                                                std::vector<double> volatilities,
+                                                std::vector<double> dividends)
+        : StochasticProcess1D(ext::make_shared<EulerDiscretization>()),
+          underlyingValue_(underlyingValue), times_(std::move(times)),
+          riskFreeRates_(std::move(riskFreeRates)), volatilities_(std::move(volatilities)),
+          dividends_(std::move(dividends))
+    {
+        QL_REQUIRE(times_.size() > 1, "at least two times required");
+        QL_REQUIRE(riskFreeRates_.size() == times_.size()-1 &&
+                   volatilities_.size() == times_.size()-1 &&
+                   dividends_.size() == times_.size()-1,
+                   "one value per interval required");
+        for (Size i=1; i<times_.size(); ++i)
+            QL_REQUIRE(times_[i] > times_[i-1], "times must be increasing");
+        logDrifts_.resize(riskFreeRates_.size());
+        for (Size i=0; i<logDrifts_.size(); ++i)
+            logDrifts_[i] = riskFreeRates_[i] - dividends_[i]
+                          - 0.5 * volatilities_[i] * volatilities_[i];
+    }
+
+    Size PiecewiseConstantBlackScholesProcess::interval(Time t) const {
+        Size i = std::upper_bound(times_.begin(), times_.end(), t) - times_.begin();
+        return std::min<Size>(std::max<Size>(i, 1), times_.size()-1) - 1;
+    }
+
+    Real PiecewiseConstantBlackScholesProcess::x0() const {
+        return underlyingValue_;
+    }
+
+    Real PiecewiseConstantBlackScholesProcess::drift(Time t, Real x) const {
+        return logDrifts_[interval(t)];
+    }
+
+    Real PiecewiseConstantBlackScholesProcess::diffusion(Time t, Real x) const {
+        return volatilities_[interval(t)];
+    }
+
+    Real PiecewiseConstantBlackScholesProcess::apply(Real x0, Real dx) const {
+        return x0 * std::exp(dx);
+    }
+
+    Real PiecewiseConstantBlackScholesProcess::expectation(Time t0, Real x0, Time dt) const {
+        return apply(x0, logDrift(t0, dt));
+    }
+
+    Real PiecewiseConstantBlackScholesProcess::stdDeviation(Time t0, Real x0, Time dt) const {
+        return std::sqrt(variance(t0, x0, dt));
+    }
+
+    Real PiecewiseConstantBlackScholesProcess::variance(Time t0, Real, Time dt) const {
+        return logVariance(t0, dt);
+    }
+
+    Real PiecewiseConstantBlackScholesProcess::logDrift(Time t0, Time dt) const {
+        Real result = 0.0;
+        Time t = t0, t1 = t0 + dt;
+        for (Size i = interval(t0); t < t1; ++i) {
+            Time end = (i+1 < logDrifts_.size()) ? std::min(times_[i+1], t1) : t1;
+            result += logDrifts_[std::min(i, logDrifts_.size()-1)] * (end - t);
+            t = end;
+        }
+        return result;
+    }
+
+    Real PiecewiseConstantBlackScholesProcess::logVariance(Time t0, Time dt) const {
+        Real result = 0.0;
+        Time t = t0, t1 = t0 + dt;
+        for (Size i = interval(t0); t < t1; ++i) {
+            Time end = (i+1 < volatilities_.size()) ? std::min(times_[i+1], t1) : t1;
+            Real sigma = volatilities_[std::min(i, volatilities_.size()-1)];
+            result += sigma * sigma * (end - t);
+            t = end;
+        }
+        return result;
+    }
+
+
+    ext::shared_ptr<PiecewiseConstantBlackScholesProcess>
+    makePiecewiseConstantBlackScholesProcess(
+                  const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+                  const TimeGrid& grid,
+                  Real strike) {
+        QL_REQUIRE(process, "Black-Scholes process required for piecewise parameters");
+        MONTECARLO_PHASE(Parameters);
+        Size n = grid.size() - 1;
+        QL_REQUIRE(n > 0, "empty time grid");
+        MONTECARLO_COUNT(TermStructureCalls, 3 * (n + 1));
+        std::vector<Time> times(grid.begin(), grid.end());
+        std::vector<double> riskFreeRates(n), volatilities(n), dividends(n);
+        DiscountFactor discount = process->riskFreeRate()->discount(times[0]);
+        DiscountFactor dividendDiscount = process->dividendYield()->discount(times[0]);
+        Real variance = process->blackVolatility()->blackVariance(times[0], strike);
+        for (Size i=0; i<n; ++i) {
+            Time dt = times[i+1] - times[i];
+            DiscountFactor nextDiscount = process->riskFreeRate()->discount(times[i+1]);
+            DiscountFactor nextDividendDiscount =
+                process->dividendYield()->discount(times[i+1]);
+            Real nextVariance =
+                process->blackVolatility()->blackVariance(times[i+1], strike);
+            QL_REQUIRE(nextVariance >= variance,
+                       "negative forward variance between t = " << times[i]
+                       << " and t = " << times[i+1]);
+            riskFreeRates[i] = std::log(discount / nextDiscount) / dt;
+            dividends[i] = std::log(dividendDiscount / nextDividendDiscount) / dt;
+            volatilities[i] = std::sqrt((nextVariance - variance) / dt);
+            discount = nextDiscount;
+            dividendDiscount = nextDividendDiscount;
+            variance = nextVariance;
+        }
+        return ext::make_shared<PiecewiseConstantBlackScholesProcess>(
+            process->x0(), times, riskFreeRates, volatilities, dividends);
+    }
+
+}
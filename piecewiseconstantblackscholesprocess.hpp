@@ -0,0 +1,64 @@
+#ifndef PIECEWISECONSTANTBLACKSCHOLESPROCESS_HPP
+#define PIECEWISECONSTANTBLACKSCHOLESPROCESS_HPP
+
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/stochasticprocess.hpp>
+#include <ql/timegrid.hpp>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Black-Scholes process with piecewise-constant parameters.
+    /*! The risk-free rate, dividend yield and volatility are constant
+        on each interval \f$ [t_{i-1}, t_i) \f$ and flat after the last
+        time.  The log of the underlying is evolved exactly over any
+        step.
+    */
+    class PiecewiseConstantBlackScholesProcess : public StochasticProcess1D {
+      public:
+        //! \c times are the nodes t_0 < ... < t_n; the parameters are given per interval.
+        PiecewiseConstantBlackScholesProcess(double underlyingValue,
+                                             std::vector<Time> times,
+                                             std::vector<double> riskFreeRates,
+                                             std::vector<double> volatilities,
+                                             std::vector<double> dividends);
+        Real x0() const override;
+        Real drift(Time t, Real x) const override;
+        Real diffusion(Time t, Real x) const override;
+        Real apply(Real x0, Real dx) const override;
+        Real expectation(Time t0, Real x0, Time dt) const override;
+        Real stdDeviation(Time t0, Real x0, Time dt) const override;
+        Real variance(Time t0, Real x0, Time dt) const override;
+        //! \name Inspectors
+        //@{
+        //! integral of the log-drift over [t0, t0+dt]
+        Real logDrift(Time t0, Time dt) const;
+        //! integral of the variance over [t0, t0+dt]
+        Real logVariance(Time t0, Time dt) const;
+        const std::vector<Time>& times() const { return times_; }
+        //@}
+      private:
+        Size interval(Time t) const;
+        double underlyingValue_;
+        std::vector<Time> times_;
+        std::vector<double> riskFreeRates_;
+        std::vector<double> volatilities_;
+        std::vector<double> dividends_;
+        std::vector<double> logDrifts_;
+    };
+
+    //! piecewise-constant parameters of a process on the intervals of a grid
+    /*! Forward rates and dividend yields are read from the discount
+        factors, and forward variances from the Black variance at the
+        given strike, so that the values at the nodes of the grid are
+        matched exactly.
+    */
+    ext::shared_ptr<PiecewiseConstantBlackScholesProcess>
+    makePiecewiseConstantBlackScholesProcess(
+                  const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+                  const TimeGrid& grid,
+                  Real strike);
+
+}
+
+#endif
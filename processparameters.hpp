@@ -0,0 +1,242 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file processparameters.hpp
+    \brief Choice and extraction of the process simulated by the Monte Carlo engines
+*/
+
+#ifndef montecarlo_process_parameters_hpp
+#define montecarlo_process_parameters_hpp
+
+#include <ql/patterns/observable.hpp>
+#include <ql/patterns/singleton.hpp>
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/quotes/simplequote.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/termstructures/yield/flatforward.hpp>
+#include <ql/time/calendars/nullcalendar.hpp>
+#include "constantblackscholesprocess.hpp"
+#include "mcinstrumentation.hpp"
+#include "piecewiseconstantblackscholesprocess.hpp"
+#include "tabulatedblackscholesprocess.hpp"
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace QuantLib {
+
+    //! parameters of the Black-Scholes process simulated by the _2 engines
+    struct ProcessParameters {
+        enum Mode {
+            Full,      /*!< the original process, queried at every step */
+            Constant,  /*!< constant parameters read at maturity */
+            Piecewise, /*!< parameters read once per interval of the time grid */
+            Tabulated  /*!< the original process, queried once per step of the
+                            time grid; same paths as Full */
+        };
+    };
+
+
+    //! constant Black-Scholes parameters extracted at a given maturity and strike
+    struct ConstantParameters {
+        Real underlying;
+        Rate riskFreeRate;
+        Rate dividendYield;
+        Volatility volatility;
+    };
+
+
+    //! memoized extraction of constant Black-Scholes parameters
+    /*! Extracted parameters are stored by process, maturity and strike,
+        so that engines pricing many options on the same market data
+        query the term structures only once per (maturity, strike).
+
+        The cache observes the quote and term-structure handles of the
+        processes of its entries, and drops all its entries as soon as
+        any of them notifies a change; it then stops observing them at
+        its next use, since an observer cannot unregister while being
+        notified.  The entries of processes that no longer exist are
+        dropped, and their handles unobserved, when a new entry is
+        added, so that the observed handles are only those of live
+        entries.
+
+        Lookups and insertions are serialized, so that engines running
+        in different threads can share the cache; as elsewhere in
+        QuantLib, the market data must not be modified while they run.
+    */
+    class ConstantParametersCache : public Singleton<ConstantParametersCache>,
+                                    public Observer {
+        friend class Singleton<ConstantParametersCache>;
+      private:
+        ConstantParametersCache() = default;
+      public:
+        //! zero rates and Black volatility at the given maturity and strike
+        ConstantParameters parameters(
+                  const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+                  Time maturity,
+                  Real strike);
+        //! \name Observer interface
+        //@{
+        void update() override;
+        //@}
+        //! drops all entries and stops observing the market data
+        void clear();
+        Size size() const;
+      private:
+        typedef std::tuple<const GeneralizedBlackScholesProcess*, Time, Real> key_type;
+        struct entry_type {
+            // guards against a new process allocated at the same address
+            ext::weak_ptr<GeneralizedBlackScholesProcess> process;
+            std::vector<ext::shared_ptr<Observable> > observables;
+            ConstantParameters parameters;
+        };
+        // drops the entries of dead processes and the handles only
+        // they used; to be called with the lock held
+        void prune();
+        std::map<key_type, entry_type> cache_;
+        // whether the handles of dropped entries are still observed
+        bool stale_ = false;
+        // number of notifications received
+        unsigned long generation_ = 0;
+        mutable std::mutex mutex_;
+    };
+
+
+    // inline definitions
+
+    inline ConstantParameters ConstantParametersCache::parameters(
+                  const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+                  Time maturity,
+                  Real strike) {
+        QL_REQUIRE(process, "Black-Scholes process required for constant parameters");
+        MONTECARLO_PHASE(Parameters);
+        key_type key(process.get(), maturity, strike);
+        unsigned long generation;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation = generation_;
+            if (stale_) {
+                unregisterWithAll();
+                stale_ = false;
+            }
+            auto i = cache_.find(key);
+            if (i != cache_.end() && i->second.process.lock() == process)
+                return i->second.parameters;
+        }
+
+        // the term structures are queried without holding the lock
+        entry_type entry;
+        entry.process = process;
+        entry.observables = { process->stateVariable(), process->riskFreeRate(),
+                              process->dividendYield(), process->blackVolatility() };
+        entry.parameters.underlying = process->x0();
+        entry.parameters.riskFreeRate =
+            process->riskFreeRate()->zeroRate(maturity, Continuous);
+        entry.parameters.dividendYield =
+            process->dividendYield()->zeroRate(maturity, Continuous);
+        entry.parameters.volatility =
+            process->blackVolatility()->blackVol(maturity, strike);
+        MONTECARLO_COUNT(TermStructureCalls, 3);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        // the market data changed while they were read
+        if (generation != generation_)
+            return entry.parameters;
+        prune();
+        for (const auto& observable : entry.observables)
+            registerWith(observable);
+        return (cache_[key] = std::move(entry)).parameters;
+    }
+
+    inline void ConstantParametersCache::prune() {
+        bool pruned = false;
+        for (auto i = cache_.begin(); i != cache_.end(); ) {
+            if (i->second.process.expired()) {
+                i = cache_.erase(i);
+                pruned = true;
+            } else {
+                ++i;
+            }
+        }
+        // the handles can be shared with the processes still cached
+        if (pruned) {
+            unregisterWithAll();
+            for (const auto& i : cache_)
+                for (const auto& observable : i.second.observables)
+                    registerWith(observable);
+        }
+    }
+
+    inline void ConstantParametersCache::update() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_.clear();
+        stale_ = true;
+        ++generation_;
+    }
+
+    inline void ConstantParametersCache::clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cache_.clear();
+        unregisterWithAll();
+        stale_ = false;
+    }
+
+    inline Size ConstantParametersCache::size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cache_.size();
+    }
+
+
+    //! constant process built from the cached parameters
+    inline ext::shared_ptr<ConstantBlackScholesProcess>
+    makeConstantBlackScholesProcess(
+                  const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+                  Time maturity,
+                  Real strike) {
+        ConstantParameters p =
+            ConstantParametersCache::instance().parameters(process, maturity, strike);
+        return ext::make_shared<ConstantBlackScholesProcess>(
+            p.underlying, p.riskFreeRate, p.volatility, p.dividendYield);
+    }
+
+
+    //! Black-Scholes process with flat term structures and the given constant parameters
+    /*! Dates are converted into times as in the given process, so that
+        analytic engines using the returned process price options under
+        the same dynamics as the constant process.
+    */
+    inline ext::shared_ptr<GeneralizedBlackScholesProcess>
+    makeFlatBlackScholesProcess(
+                  const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+                  const ConstantBlackScholesProcess& constantProcess) {
+        QL_REQUIRE(process, "Black-Scholes process required");
+        Date referenceDate = process->riskFreeRate()->referenceDate();
+        DayCounter dayCounter = process->riskFreeRate()->dayCounter();
+        return ext::make_shared<GeneralizedBlackScholesProcess>(
+            Handle<Quote>(ext::make_shared<SimpleQuote>(constantProcess.x0())),
+            Handle<YieldTermStructure>(ext::make_shared<FlatForward>(
+                referenceDate, constantProcess.dividend(), dayCounter)),
+            Handle<YieldTermStructure>(ext::make_shared<FlatForward>(
+                referenceDate, constantProcess.riskFreeRate(), dayCounter)),
+            Handle<BlackVolTermStructure>(ext::make_shared<BlackConstantVol>(
+                referenceDate, NullCalendar(), constantProcess.volatility(), dayCounter)));
+    }
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file randomizedsobolrsg.hpp
+    \brief Digitally shifted Sobol sequences and randomized-QMC traits
+*/
+
+#ifndef montecarlo_randomized_sobol_rsg_hpp
+#define montecarlo_randomized_sobol_rsg_hpp
+
+#include <ql/math/randomnumbers/mt19937uniformrng.hpp>
+#include <ql/math/randomnumbers/sobolrsg.hpp>
+#include "inversecumulativersg.hpp"
+#include <cstdint>
+
+namespace QuantLib {
+
+    //! Sobol sequence with a random digital shift
+    /*! Each point of the Sobol sequence is XOR-ed with a random
+        32-bit shift per dimension, drawn from a Mersenne twister with
+        the given seed.  Every shifted point is uniformly distributed,
+        so that the average over the sequence is an unbiased estimate,
+        while the shifted sequence keeps the net structure of the
+        original one.  Sequences built with different seeds are
+        independent randomizations of the same point set.
+
+        The sequence starts from the origin, i.e., from the first
+        point that SobolRsg skips, so that the first \f$ 2^m \f$
+        points form a full net.
+
+        \ingroup mcarlo
+    */
+    class DigitalShiftSobolRsg {
+      public:
+        typedef Sample<std::vector<Real> > sample_type;
+        explicit DigitalShiftSobolRsg(
+                 Size dimensionality,
+                 BigNatural seed = 0,
+                 SobolRsg::DirectionIntegers directionIntegers = SobolRsg::JoeKuoD7)
+        : sobol_(dimensionality, 1, directionIntegers),
+          shifts_(dimensionality),
+          sequence_(std::vector<Real>(dimensionality), 1.0) {
+            MersenneTwisterUniformRng rng(seed);
+            for (Size i = 0; i < dimensionality; ++i)
+                shifts_[i] = static_cast<std::uint32_t>(rng.nextInt32());
+        }
+        const sample_type& nextSequence() const {
+            // centered in the dyadic interval, so that 0 and 1 are never returned
+            const Real normalization = 1.0 / 4294967296.0;
+            if (firstDraw_) {
+                firstDraw_ = false;
+                for (Size i = 0; i < shifts_.size(); ++i)
+                    sequence_.value[i] = (shifts_[i] + 0.5) * normalization;
+            } else {
+                const std::vector<std::uint32_t>& x = sobol_.nextInt32Sequence();
+                for (Size i = 0; i < shifts_.size(); ++i)
+                    sequence_.value[i] = ((x[i] ^ shifts_[i]) + 0.5) * normalization;
+            }
+            return sequence_;
+        }
+        const sample_type& lastSequence() const { return sequence_; }
+        Size dimension() const { return shifts_.size(); }
+      private:
+        SobolRsg sobol_;
+        std::vector<std::uint32_t> shifts_;
+        mutable bool firstDraw_ = true;
+        mutable sample_type sequence_;
+    };
+
+
+    //! randomized quasi-Monte Carlo traits
+    /*! The seed passed to make_sequence_generator() selects the
+        randomization; the engines run \c Randomizations independent
+        ones and take the dispersion of their averages as the error
+        estimate, which is why these traits allow error estimates.
+    */
+    template <class IC, Size Randomizations = 16>
+    struct GenericRandomizedLowDiscrepancy {
+        typedef DigitalShiftSobolRsg ursg_type;
+        typedef InverseCumulativeRsg<ursg_type,IC> rsg_type;
+        enum { allowsErrorEstimate = 1 };
+        static rsg_type make_sequence_generator(Size dimension, BigNatural seed) {
+            return rsg_type(ursg_type(dimension, seed));
+        }
+    };
+
+    //! default randomized quasi-Monte Carlo traits
+    typedef GenericRandomizedLowDiscrepancy<InverseCumulativeNormal> RandomizedLowDiscrepancy;
+
+
+    //! number of randomizations used by the given RNG traits
+    /*! Zero for the plain Monte Carlo and quasi-Monte Carlo traits. */
+    template <class RNG>
+    struct QmcRandomizations {
+        static const Size value = 0;
+    };
+
+    template <class IC, Size Randomizations>
+    struct QmcRandomizations<GenericRandomizedLowDiscrepancy<IC,Randomizations> > {
+        static const Size value = Randomizations;
+    };
+
+
+    template <class IC, Size Randomizations>
+    struct SequenceGenerator_2<GenericRandomizedLowDiscrepancy<IC,Randomizations> > {
+        typedef DigitalShiftSobolRsg ursg_type;
+        typedef InverseCumulativeRsg_2<ursg_type,IC> rsg_type;
+        static rsg_type make(Size dimension, BigNatural seed) {
+            return rsg_type(ursg_type(dimension, seed));
+        }
+    };
+
+}
+
+
+#endif
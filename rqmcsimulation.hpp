@@ -0,0 +1,222 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file rqmcsimulation.hpp
+    \brief Randomized quasi-Monte Carlo simulation
+*/
+
+#ifndef montecarlo_rqmc_simulation_hpp
+#define montecarlo_rqmc_simulation_hpp
+
+#include "mcparallelsimulation.hpp"
+#include "randomizedsobolrsg.hpp"
+
+namespace QuantLib {
+
+    //! Randomized quasi-Monte Carlo simulation
+    /*! The simulation runs \f$ K \f$ models, the \f$ k \f$-th one
+        drawing from the randomization selected by the \f$ k \f$-th
+        substream of the engine seed, and gives each of them the same
+        number \f$ n \f$ of points.  The averages of the
+        randomizations are independent and unbiased; the returned
+        accumulator holds them, so that its mean is the estimate and
+        its error estimate is the standard error of the estimate.
+        The per-path variance is not used, since the points of a
+        low-discrepancy sequence are not independent.
+
+        With a tolerance, \f$ n \f$ is doubled until the error is
+        reached, which keeps the points of each randomization a full
+        net when \f$ n \f$ starts from a power of two.  A required
+        number of samples is rounded up to a multiple of \f$ K \f$.
+
+        The randomizations are simulated on up to the given number of
+        threads; the result does not depend on it.
+    */
+    template <class Model>
+    class RandomizedQmcSimulation {
+      public:
+        typedef Model model_type;
+        typedef typename model_type::stats_type stats_type;
+        //! builds a model drawing from the randomization with the given seed
+        typedef std::function<ext::shared_ptr<model_type>(BigNatural)> model_factory;
+
+        RandomizedQmcSimulation(model_factory factory,
+                                Size randomizations,
+                                Size threads,
+                                BigNatural seed);
+        //! doubles the points until the required tolerance is reached
+        void value(Real tolerance,
+                   Size maxSamples = QL_MAX_INTEGER,
+                   Size minSamples = 1023) const;
+        //! adds points until the required number of samples is reached
+        void valueWithSamples(Size samples) const;
+        //! adds points until the time budget or the tolerance is exhausted
+        void valueWithinBudget(std::chrono::microseconds budget,
+                               Real tolerance = Null<Real>(),
+                               Size maxSamples = QL_MAX_INTEGER) const;
+        //! same interface as SequentialMcSimulation::calculate
+        void calculate(Real requiredTolerance,
+                       Size requiredSamples,
+                       Size maxSamples,
+                       std::chrono::microseconds timeBudget =
+                                         std::chrono::microseconds::zero()) const;
+        //! accumulator of the averages of the randomizations
+        const stats_type& sampleAccumulator() const { return stats_; }
+        //! number of simulated paths over all randomizations
+        Size samples() const { return randomizations_ * points_; }
+      private:
+        void addPoints(Size points) const;
+        model_factory factory_;
+        Size randomizations_, threads_;
+        BigNatural seed_;
+        mutable std::vector<ext::shared_ptr<model_type> > models_;
+        mutable Size points_ = 0;
+        mutable stats_type stats_;
+    };
+
+
+    // inline definitions
+
+    template <class Model>
+    inline RandomizedQmcSimulation<Model>::RandomizedQmcSimulation(model_factory factory,
+                                                                   Size randomizations,
+                                                                   Size threads,
+                                                                   BigNatural seed)
+    : factory_(std::move(factory)), randomizations_(randomizations), threads_(threads),
+      seed_(seed != 0 ? seed : SeedGenerator::instance().get()) {
+        QL_REQUIRE(randomizations_ > 1,
+                   "at least two randomizations are required for an error estimate");
+        QL_REQUIRE(threads_ > 0, "at least one thread is required");
+    }
+
+    template <class Model>
+    inline void RandomizedQmcSimulation<Model>::addPoints(Size points) const {
+        if (models_.empty()) {
+            // built on the calling thread, as in ParallelMcSimulation
+            models_.resize(randomizations_);
+            for (Size k=0; k<randomizations_; ++k)
+                models_[k] = factory_(substreamSeed(seed_, k));
+        }
+
+        detail::forEachInParallel(randomizations_, threads_, [&](Size k) {
+            models_[k]->addSamples(points);
+        });
+        points_ += points;
+
+        stats_ = stats_type();
+        for (Size k=0; k<randomizations_; ++k)
+            stats_.add(models_[k]->sampleAccumulator().mean());
+    }
+
+    template <class Model>
+    inline void RandomizedQmcSimulation<Model>::value(Real tolerance,
+                                                      Size maxSamples,
+                                                      Size minSamples) const {
+        // start from the smallest power of two giving minSamples
+        Size points = 1;
+        while (points * randomizations_ < minSamples)
+            points *= 2;
+        if (points > points_)
+            addPoints(points - points_);
+
+        Size maxPoints = maxSamples / randomizations_;
+        Real error = stats_.errorEstimate();
+        while (error > tolerance) {
+            QL_REQUIRE(points_ < maxPoints,
+                       "max number of samples (" << maxSamples
+                       << ") reached, while error (" << error
+                       << ") is still above tolerance (" << tolerance << ")");
+            addPoints(std::min(points_, maxPoints - points_));
+            error = stats_.errorEstimate();
+        }
+    }
+
+    template <class Model>
+    inline void RandomizedQmcSimulation<Model>::valueWithSamples(Size samples) const {
+        Size points = (samples + randomizations_ - 1) / randomizations_;
+        QL_REQUIRE(points >= points_,
+                   "number of already simulated samples (" << this->samples()
+                   << ") greater than requested samples (" << samples << ")");
+        if (points > points_)
+            addPoints(points - points_);
+    }
+
+    template <class Model>
+    inline void RandomizedQmcSimulation<Model>::valueWithinBudget(
+                                                 std::chrono::microseconds budget,
+                                                 Real tolerance,
+                                                 Size maxSamples) const {
+        typedef std::chrono::steady_clock clock;
+        clock::time_point start = clock::now();
+        clock::time_point deadline = start + budget;
+        Size initialPoints = points_;
+        Size maxPoints = std::max<Size>(maxSamples / randomizations_, 1);
+        while (points_ < maxPoints) {
+            // doubling the points keeps full nets...
+            Size nextPoints = std::max<Size>(points_, 8);
+            if (points_ > initialPoints) {
+                // ...unless that would overrun the deadline; in that
+                // case, add the points taking about half the remaining time
+                clock::time_point now = clock::now();
+                Real elapsed = std::chrono::duration<Real>(now - start).count();
+                Real remaining = std::max<Real>(
+                    std::chrono::duration<Real>(deadline - now).count(), 0.0);
+                if (elapsed > 0.0) {
+                    Real affordable = (points_ - initialPoints) / elapsed * remaining;
+                    // the budget is spent
+                    if (0.5 * affordable < 1.0)
+                        break;
+                    if (affordable < nextPoints)
+                        nextPoints = Size(0.5 * affordable);
+                }
+            }
+            addPoints(std::min(nextPoints, maxPoints - points_));
+            if (tolerance != Null<Real>() && stats_.errorEstimate() <= tolerance)
+                break;
+            if (clock::now() >= deadline)
+                break;
+        }
+    }
+
+    template <class Model>
+    inline void RandomizedQmcSimulation<Model>::calculate(
+                                          Real requiredTolerance,
+                                          Size requiredSamples,
+                                          Size maxSamples,
+                                          std::chrono::microseconds timeBudget) const {
+        if (timeBudget > std::chrono::microseconds::zero()) {
+            valueWithinBudget(timeBudget, requiredTolerance,
+                              detail::sampleLimit(requiredSamples, maxSamples));
+            return;
+        }
+        QL_REQUIRE(requiredTolerance != Null<Real>() ||
+                   requiredSamples != Null<Size>(),
+                   "neither tolerance nor number of samples set");
+        if (requiredTolerance != Null<Real>()) {
+            if (maxSamples != Null<Size>())
+                value(requiredTolerance, maxSamples);
+            else
+                value(requiredTolerance);
+        } else {
+            valueWithSamples(requiredSamples);
+        }
+    }
+
+}
+
+
+#endif
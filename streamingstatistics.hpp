@@ -0,0 +1,399 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*! \file streamingstatistics.hpp
+    \brief Sample accumulators with constant memory
+*/
+
+#ifndef montecarlo_streaming_statistics_hpp
+#define montecarlo_streaming_statistics_hpp
+
+#include <ql/errors.hpp>
+#include <ql/mathconstants.hpp>
+#include <ql/types.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace QuantLib {
+
+    //! weighted mean and variance of a stream of samples
+    /*! Unlike GeneralStatistics, the samples are not stored: the mean
+        and the sum of the weighted squared deviations are updated as
+        each sample is added (Welford's algorithm, in the weighted form
+        by West), and both sums are compensated (Kahan) so that their
+        rounding error does not grow with the number of samples.  The
+        memory used is the same whatever the number of samples.
+
+        The mean, variance and error estimate are defined as in
+        GeneralStatistics, so that this class can be used as the
+        statistics accumulator of the Monte Carlo engines.  Partial
+        accumulators can be merged (see mergeStatistics) with the
+        pairwise formulas of Chan, Golub and LeVeque.
+    */
+    class StreamingStatistics {
+      public:
+        //! \name Inspectors
+        //@{
+        //! number of samples collected
+        Size samples() const { return samples_; }
+        //! sum of data weights
+        Real weightSum() const { return weightSum_; }
+        //! weighted mean
+        Real mean() const {
+            QL_REQUIRE(weightSum_ > 0.0, "sampleWeight_=0, unsufficient");
+            return mean_;
+        }
+        /*! unbiased variance, i.e., the weighted mean of the squared
+            deviations times \f$ N/(N-1) \f$ */
+        Real variance() const {
+            QL_REQUIRE(weightSum_ > 0.0, "sampleWeight_=0, unsufficient");
+            QL_REQUIRE(samples_ > 1, "sample number <=1, unsufficient");
+            Real n = static_cast<Real>(samples_);
+            return std::max(m2_, 0.0) / weightSum_ * n / (n - 1.0);
+        }
+        Real standardDeviation() const { return std::sqrt(variance()); }
+        //! error estimate on the mean value, \f$ \sqrt{\sigma^2/N} \f$
+        Real errorEstimate() const {
+            return std::sqrt(variance() / static_cast<Real>(samples_));
+        }
+        Real min() const {
+            QL_REQUIRE(samples_ > 0, "empty sample set");
+            return min_;
+        }
+        Real max() const {
+            QL_REQUIRE(samples_ > 0, "empty sample set");
+            return max_;
+        }
+        //@}
+
+        //! \name Modifiers
+        //@{
+        void add(Real value, Real weight = 1.0);
+        template <class DataIterator>
+        void addSequence(DataIterator begin, DataIterator end) {
+            for (; begin != end; ++begin)
+                add(*begin);
+        }
+        //! adds the samples collected by another accumulator
+        void merge(const StreamingStatistics& other);
+        void reset() { *this = StreamingStatistics(); }
+        //@}
+
+        //! \name Serialization
+        //@{
+        /*! appends the state of the accumulator to a binary blob; the
+            encoding does not depend on the platform, and the state
+            read back by deserialize() is exactly the same. */
+        void serialize(std::string& blob) const;
+        /*! reads the state written by serialize() from the blob,
+            starting at the given position, which is moved past it */
+        static StreamingStatistics deserialize(const std::string& blob,
+                                               std::size_t& position);
+        //@}
+      private:
+        // Kahan summation of x into sum
+        static void compensatedAdd(Real& sum, Real& compensation, Real x) {
+            Real y = x - compensation;
+            Real t = sum + y;
+            compensation = (t - sum) - y;
+            sum = t;
+        }
+        Size samples_ = 0;
+        Real weightSum_ = 0.0;
+        Real mean_ = 0.0, meanCompensation_ = 0.0;
+        Real m2_ = 0.0, m2Compensation_ = 0.0;
+        Real min_ = QL_MAX_REAL, max_ = QL_MIN_REAL;
+    };
+
+
+    //! mergeable quantile sketch of bounded size
+    /*! A merging t-digest (T. Dunning and O. Ertl, <i>Computing
+        extremely accurate quantiles using t-digests</i>, 2019): the
+        samples are summarized by centroids, i.e., weighted means of
+        adjacent samples, whose weight is smaller near the tails, so
+        that extreme quantiles are more accurate.  Samples are
+        buffered and merged into the centroids when the buffer is
+        full.  The number of centroids is bounded by the compression,
+        and the buffer has a fixed size; the memory used is therefore
+        the same whatever the number of samples.
+    */
+    class QuantileSketch {
+      public:
+        explicit QuantileSketch(Size compression = 100);
+        void add(Real value, Real weight = 1.0);
+        //! adds the samples summarized by another sketch
+        void merge(const QuantileSketch& other);
+        //! estimated \f$ y \f$-th quantile of the weighted samples
+        Real quantile(Real y) const;
+      private:
+        typedef std::pair<Real, Real> centroid;  // (mean, weight)
+        void compress() const;
+        Real compression_;
+        Size bufferSize_;
+        Real min_ = QL_MAX_REAL, max_ = QL_MIN_REAL;
+        mutable std::vector<centroid> centroids_, buffer_, merged_;
+    };
+
+
+    //! streaming statistics with a quantile sketch of the samples
+    /*! Same as StreamingStatistics, with estimated percentiles; see
+        QuantileSketch for the meaning of the compression.
+    */
+    template <Size Compression = 100>
+    class StreamingPercentileStatistics : public StreamingStatistics {
+      public:
+        StreamingPercentileStatistics() : sketch_(Compression) {}
+        void add(Real value, Real weight = 1.0) {
+            StreamingStatistics::add(value, weight);
+            sketch_.add(value, weight);
+        }
+        template <class DataIterator>
+        void addSequence(DataIterator begin, DataIterator end) {
+            for (; begin != end; ++begin)
+                add(*begin);
+        }
+        void merge(const StreamingPercentileStatistics& other) {
+            StreamingStatistics::merge(other);
+            sketch_.merge(other.sketch_);
+        }
+        void reset() { *this = StreamingPercentileStatistics(); }
+        /*! estimated \f$ y \f$-th percentile, \f$ y \in (0, 1] \f$,
+            as in GeneralStatistics */
+        Real percentile(Real y) const {
+            QL_REQUIRE(y > 0.0 && y <= 1.0, "percentile (" << y << ") must be in (0.0, 1.0]");
+            QL_REQUIRE(weightSum() > 0.0, "empty sample set");
+            return sketch_.quantile(y);
+        }
+      private:
+        QuantileSketch sketch_;
+    };
+
+
+    //! adds the samples collected by a partial accumulator to a total one
+    inline void mergeStatistics(StreamingStatistics& total,
+                                const StreamingStatistics& partial) {
+        total.merge(partial);
+    }
+
+    template <Size Compression>
+    inline void mergeStatistics(StreamingPercentileStatistics<Compression>& total,
+                                const StreamingPercentileStatistics<Compression>& partial) {
+        total.merge(partial);
+    }
+
+
+    namespace detail {
+
+        // fixed-size little-endian encoding of integers and doubles
+
+        inline void writeBinary(std::string& blob, std::uint64_t x) {
+            for (int i=0; i<8; ++i)
+                blob.push_back(static_cast<char>((x >> (8*i)) & 0xff));
+        }
+
+        inline void writeBinary(std::string& blob, double x) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &x, sizeof(bits));
+            writeBinary(blob, bits);
+        }
+
+        inline std::uint64_t readBinaryInteger(const std::string& blob,
+                                               std::size_t& position) {
+            QL_REQUIRE(position + 8 <= blob.size(), "truncated binary data");
+            std::uint64_t x = 0;
+            for (int i=0; i<8; ++i)
+                x |= static_cast<std::uint64_t>(
+                         static_cast<unsigned char>(blob[position + i])) << (8*i);
+            position += 8;
+            return x;
+        }
+
+        inline double readBinaryReal(const std::string& blob, std::size_t& position) {
+            std::uint64_t bits = readBinaryInteger(blob, position);
+            double x;
+            std::memcpy(&x, &bits, sizeof(x));
+            return x;
+        }
+
+    }
+
+
+    // inline definitions
+
+    inline void StreamingStatistics::add(Real value, Real weight) {
+        QL_REQUIRE(weight >= 0.0, "negative weight (" << weight << ") not allowed");
+        ++samples_;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+        if (weight == 0.0)
+            return;
+        weightSum_ += weight;
+        Real delta = value - mean_;
+        compensatedAdd(mean_, meanCompensation_, delta * (weight / weightSum_));
+        compensatedAdd(m2_, m2Compensation_, weight * delta * (value - mean_));
+    }
+
+    inline void StreamingStatistics::merge(const StreamingStatistics& other) {
+        samples_ += other.samples_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+        if (other.weightSum_ == 0.0)
+            return;
+        Real total = weightSum_ + other.weightSum_;
+        Real delta = other.mean_ - mean_;
+        Real w = other.weightSum_ / total;
+        compensatedAdd(mean_, meanCompensation_, delta * w);
+        compensatedAdd(m2_, m2Compensation_, other.m2_);
+        compensatedAdd(m2_, m2Compensation_, delta * delta * weightSum_ * w);
+        weightSum_ = total;
+    }
+
+
+    inline void StreamingStatistics::serialize(std::string& blob) const {
+        detail::writeBinary(blob, static_cast<std::uint64_t>(samples_));
+        detail::writeBinary(blob, weightSum_);
+        detail::writeBinary(blob, mean_);
+        detail::writeBinary(blob, meanCompensation_);
+        detail::writeBinary(blob, m2_);
+        detail::writeBinary(blob, m2Compensation_);
+        detail::writeBinary(blob, min_);
+        detail::writeBinary(blob, max_);
+    }
+
+    inline StreamingStatistics StreamingStatistics::deserialize(const std::string& blob,
+                                                                std::size_t& position) {
+        StreamingStatistics result;
+        result.samples_ = static_cast<Size>(detail::readBinaryInteger(blob, position));
+        result.weightSum_ = detail::readBinaryReal(blob, position);
+        result.mean_ = detail::readBinaryReal(blob, position);
+        result.meanCompensation_ = detail::readBinaryReal(blob, position);
+        result.m2_ = detail::readBinaryReal(blob, position);
+        result.m2Compensation_ = detail::readBinaryReal(blob, position);
+        result.min_ = detail::readBinaryReal(blob, position);
+        result.max_ = detail::readBinaryReal(blob, position);
+        return result;
+    }
+
+
+    inline QuantileSketch::QuantileSketch(Size compression)
+    : compression_(static_cast<Real>(compression)), bufferSize_(5 * compression) {
+        QL_REQUIRE(compression > 0, "positive compression required");
+        // reserved once, so that adding samples does not allocate
+        centroids_.reserve(2 * compression + 1);
+        buffer_.reserve(bufferSize_);
+        merged_.reserve(2 * compression + 1 + bufferSize_);
+    }
+
+    inline void QuantileSketch::add(Real value, Real weight) {
+        if (weight == 0.0)
+            return;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+        buffer_.emplace_back(value, weight);
+        if (buffer_.size() >= bufferSize_)
+            compress();
+    }
+
+    inline void QuantileSketch::merge(const QuantileSketch& other) {
+        other.compress();
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+        for (const centroid& c : other.centroids_) {
+            buffer_.push_back(c);
+            if (buffer_.size() >= bufferSize_)
+                compress();
+        }
+    }
+
+    inline void QuantileSketch::compress() const {
+        if (buffer_.empty())
+            return;
+        merged_.assign(centroids_.begin(), centroids_.end());
+        merged_.insert(merged_.end(), buffer_.begin(), buffer_.end());
+        buffer_.clear();
+        std::sort(merged_.begin(), merged_.end());
+
+        Real total = 0.0;
+        for (const centroid& c : merged_)
+            total += c.second;
+
+        // scale function k(q) = compression/(2 pi) asin(2q-1): a
+        // centroid can grow as long as it spans at most a unit of k
+        const Real factor = compression_ / (2.0 * M_PI);
+        auto k = [factor](Real q) {
+            return factor * std::asin(std::min(std::max(2.0 * q - 1.0, -1.0), 1.0));
+        };
+
+        centroids_.clear();
+        centroid current = merged_.front();
+        Real before = 0.0, kBefore = k(0.0);
+        for (Size i=1; i<merged_.size(); ++i) {
+            const centroid& next = merged_[i];
+            Real weight = current.second + next.second;
+            if (k((before + weight) / total) - kBefore <= 1.0) {
+                current.first += (next.first - current.first) * next.second / weight;
+                current.second = weight;
+            } else {
+                centroids_.push_back(current);
+                before += current.second;
+                kBefore = k(before / total);
+                current = next;
+            }
+        }
+        centroids_.push_back(current);
+    }
+
+    inline Real QuantileSketch::quantile(Real y) const {
+        compress();
+        QL_REQUIRE(!centroids_.empty(), "empty sample set");
+        Real total = 0.0;
+        for (const centroid& c : centroids_)
+            total += c.second;
+        Real target = y * total;
+
+        // centroids are taken at the middle of their weight, and the
+        // quantile is interpolated linearly between their means and
+        // the extreme samples
+        Real before = 0.0, previousPosition = 0.0, previousValue = min_;
+        for (const centroid& c : centroids_) {
+            Real position = before + 0.5 * c.second;
+            if (target <= position) {
+                if (position == previousPosition)
+                    return c.first;
+                return previousValue + (c.first - previousValue)
+                                     * (target - previousPosition)
+                                     / (position - previousPosition);
+            }
+            before += c.second;
+            previousPosition = position;
+            previousValue = c.first;
+        }
+        if (total == previousPosition)
+            return max_;
+        return previousValue + (max_ - previousValue)
+                             * (target - previousPosition) / (total - previousPosition);
+    }
+
+}
+
+
+#endif
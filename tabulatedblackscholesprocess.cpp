@@ -0,0 +1,128 @@
+#include "tabulatedblackscholesprocess.hpp"
+#include "mcinstrumentation.hpp"
+#include <ql/math/comparison.hpp>
+#include <ql/processes/eulerdiscretization.hpp>
+#include <ql/termstructures/volatility/equityfx/blackconstantvol.hpp>
+#include <ql/termstructures/volatility/equityfx/blackvariancecurve.hpp>
+#include <algorithm>
+
+namespace QuantLib {
+
+    TabulatedBlackScholesProcess::TabulatedBlackScholesProcess(
+                                                double underlyingValue,
+                                                std::vector<Time> times,
+                                                std::vector<Real> logDrifts,
+                                                std::vector<Real> variances,
+                                                std::vector<Volatility> diffusions)
+        : StochasticProcess1D(ext::make_shared<EulerDiscretization>()),
+          underlyingValue_(underlyingValue), times_(std::move(times)),
+          logDrifts_(std::move(logDrifts)), variances_(std::move(variances)),
+          diffusions_(std::move(diffusions))
+    {
+        QL_REQUIRE(times_.size() > 1, "at least two times required");
+        QL_REQUIRE(logDrifts_.size() == times_.size()-1 &&
+                   variances_.size() == times_.size()-1,
+                   "one log-drift and variance per step required");
+        QL_REQUIRE(diffusions_.size() == times_.size(), "one diffusion per node required");
+        for (Size i=1; i<times_.size(); ++i)
+            QL_REQUIRE(times_[i] > times_[i-1], "times must be increasing");
+    }
+
+    Size TabulatedBlackScholesProcess::node(Time t) const {
+        Size i = std::upper_bound(times_.begin(), times_.end(), t) - times_.begin();
+        // t might be slightly below its node
+        if (i < times_.size() && close_enough(times_[i], t))
+            return i;
+        QL_REQUIRE(i > 0 && close_enough(times_[i-1], t),
+                   "t = " << t << " is not a node of the tabulated grid");
+        return i-1;
+    }
+
+    Real TabulatedBlackScholesProcess::x0() const {
+        return underlyingValue_;
+    }
+
+    Real TabulatedBlackScholesProcess::drift(Time t, Real) const {
+        Size i = std::min(node(t), logDrifts_.size()-1);
+        return logDrifts_[i] / (times_[i+1] - times_[i]);
+    }
+
+    Real TabulatedBlackScholesProcess::diffusion(Time t, Real) const {
+        return diffusions_[node(t)];
+    }
+
+    Real TabulatedBlackScholesProcess::apply(Real x0, Real dx) const {
+        return x0 * std::exp(dx);
+    }
+
+    Real TabulatedBlackScholesProcess::expectation(Time t0, Real x0, Time dt) const {
+        return apply(x0, logDrift(t0, dt));
+    }
+
+    Real TabulatedBlackScholesProcess::stdDeviation(Time t0, Real x0, Time dt) const {
+        return std::sqrt(variance(t0, x0, dt));
+    }
+
+    Real TabulatedBlackScholesProcess::variance(Time t0, Real, Time dt) const {
+        return logVariance(t0, dt);
+    }
+
+    Real TabulatedBlackScholesProcess::evolve(Time t0, Real x0, Time dt, Real dw) const {
+        // same arithmetic as GeneralizedBlackScholesProcess::evolve
+        return apply(x0, std::sqrt(logVariance(t0, dt)) * dw + logDrift(t0, dt));
+    }
+
+    Real TabulatedBlackScholesProcess::logDrift(Time t0, Time dt) const {
+        Size i = node(t0), j = node(t0 + dt);
+        QL_REQUIRE(j > i, "steps between nodes of the tabulated grid required");
+        Real result = logDrifts_[i];
+        for (Size k=i+1; k<j; ++k)
+            result += logDrifts_[k];
+        return result;
+    }
+
+    Real TabulatedBlackScholesProcess::logVariance(Time t0, Time dt) const {
+        Size i = node(t0), j = node(t0 + dt);
+        QL_REQUIRE(j > i, "steps between nodes of the tabulated grid required");
+        Real result = variances_[i];
+        for (Size k=i+1; k<j; ++k)
+            result += variances_[k];
+        return result;
+    }
+
+
+    ext::shared_ptr<TabulatedBlackScholesProcess>
+    makeTabulatedBlackScholesProcess(
+                  const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+                  const TimeGrid& grid) {
+        QL_REQUIRE(process, "Black-Scholes process required for tabulated parameters");
+        QL_REQUIRE(ext::dynamic_pointer_cast<BlackConstantVol>(*process->blackVolatility()) ||
+                   ext::dynamic_pointer_cast<BlackVarianceCurve>(*process->blackVolatility()),
+                   "strike-independent volatility required for tabulated parameters");
+        MONTECARLO_PHASE(Parameters);
+        Size n = grid.size() - 1;
+        QL_REQUIRE(n > 0, "empty time grid");
+        Real x0 = process->x0();
+        std::vector<Time> times(grid.begin(), grid.end());
+        std::vector<Real> logDrifts(n), variances(n);
+        std::vector<Volatility> diffusions(n+1);
+        for (Size i=0; i<n; ++i) {
+            // same formulas as GeneralizedBlackScholesProcess::evolve
+            Time t0 = grid[i], dt = grid.dt(i);
+            Real var = process->variance(t0, x0, dt);
+            logDrifts[i] =
+                (process->riskFreeRate()->forwardRate(t0, t0 + dt, Continuous,
+                                                      NoFrequency, true).rate() -
+                 process->dividendYield()->forwardRate(t0, t0 + dt, Continuous,
+                                                       NoFrequency, true).rate()) * dt
+                - 0.5 * var;
+            variances[i] = var;
+        }
+        for (Size i=0; i<=n; ++i)
+            diffusions[i] = process->diffusion(grid[i], x0);
+        MONTECARLO_COUNT(TermStructureCalls, 5 * n + 1);
+        return ext::make_shared<TabulatedBlackScholesProcess>(
+            x0, times, logDrifts, variances, diffusions);
+    }
+
+}
@@ -0,0 +1,72 @@
+#ifndef TABULATEDBLACKSCHOLESPROCESS_HPP
+#define TABULATEDBLACKSCHOLESPROCESS_HPP
+
+#include <ql/processes/blackscholesprocess.hpp>
+#include <ql/stochasticprocess.hpp>
+#include <ql/timegrid.hpp>
+#include <vector>
+
+namespace QuantLib {
+
+    //! Black-Scholes process tabulated on the nodes of a time grid.
+    /*! Stores, for each step of the grid, the log-drift and the
+        variance with which a GeneralizedBlackScholesProcess with
+        strike-independent volatility evolves the underlying over the
+        step, and its diffusion at each node.  Steps between nodes of
+        the grid are then evolved as by the original process, without
+        querying its term structures.
+
+        Only steps starting and ending on nodes of the grid are
+        supported; the drift is the average log-drift over the step
+        starting at the given time.
+    */
+    class TabulatedBlackScholesProcess : public StochasticProcess1D {
+      public:
+        //! \c times are the nodes t_0 < ... < t_n; log-drifts and variances are given per step.
+        TabulatedBlackScholesProcess(double underlyingValue,
+                                     std::vector<Time> times,
+                                     std::vector<Real> logDrifts,
+                                     std::vector<Real> variances,
+                                     std::vector<Volatility> diffusions);
+        Real x0() const override;
+        Real drift(Time t, Real x) const override;
+        Real diffusion(Time t, Real x) const override;
+        Real apply(Real x0, Real dx) const override;
+        Real expectation(Time t0, Real x0, Time dt) const override;
+        Real stdDeviation(Time t0, Real x0, Time dt) const override;
+        Real variance(Time t0, Real x0, Time dt) const override;
+        Real evolve(Time t0, Real x0, Time dt, Real dw) const override;
+        //! \name Inspectors
+        //@{
+        //! log-drift over [t0, t0+dt]
+        Real logDrift(Time t0, Time dt) const;
+        //! variance over [t0, t0+dt]
+        Real logVariance(Time t0, Time dt) const;
+        const std::vector<Time>& times() const { return times_; }
+        //@}
+      private:
+        // index of the node at time t
+        Size node(Time t) const;
+        double underlyingValue_;
+        std::vector<Time> times_;
+        std::vector<Real> logDrifts_;
+        std::vector<Real> variances_;
+        std::vector<Volatility> diffusions_;
+    };
+
+    //! drift and diffusion of a process tabulated on the steps of a grid
+    /*! The process is queried once per step and node of the grid, with
+        the same formulas it uses when evolving a path, so that the
+        paths of the tabulated process are the same as the ones of the
+        original process.  The volatility must be independent of the
+        strike, i.e., a BlackConstantVol or a BlackVarianceCurve, and
+        the process must not force its discretization.
+    */
+    ext::shared_ptr<TabulatedBlackScholesProcess>
+    makeTabulatedBlackScholesProcess(
+                  const ext::shared_ptr<GeneralizedBlackScholesProcess>& process,
+                  const TimeGrid& grid);
+
+}
+
+#endif
@@ -0,0 +1,279 @@
+/* -*- mode: c++; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*
+ This file is part of QuantLib, a free-software/open-source library
+ for financial quantitative analysts and developers - http://quantlib.org/
+
+ QuantLib is free software: you can redistribute it and/or modify it
+ under the terms of the QuantLib license.  You should have received a
+ copy of the license along with this program; if not, please email
+ <quantlib-dev@lists.sf.net>. The license is also available online at
+ <http://quantlib.org/license.shtml>.
+
+ This program is distributed in the hope that it will be useful, but WITHOUT
+ ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ FOR A PARTICULAR PURPOSE.  See the license for more details.
+*/
+
+/*  Checks of the random-number generators of the modified engines.
+
+    Philox4x32 is checked against the known-answer vectors of the
+    reference implementation (Random123, philox4x32_10), and the
+    sequences of PhiloxUniformRsg against the words of Philox4x32 and
+    against the sequences of a generator moved around by skipTo, for
+    a few dimensionalities and for indices across its batches.
+
+    BulkInverseCumulativeNormal is compared with the scalar
+    InverseCumulativeNormal over a grid of the central region, over
+    logarithmic grids of both tails, at the boundaries between them
+    and on Mersenne-Twister uniforms; the arrays are transformed in
+    blocks of varying length, so that partial tiles are also checked.
+
+    Each check reports the number of values, how many of them are
+    bit-identical and the largest difference, relative to max(1, |z|)
+    for the Gaussian variates; the Philox checks require all values to
+    be identical, the others a difference below 1e-14.  The program returns a non-zero status if any check fails.
+
+    Usage:
+
+        verify [--uniforms=10000000] [--seed=42]
+*/
+
+#include <ql/qldefines.hpp>
+#ifdef BOOST_MSVC
+#  include <ql/auto_link.hpp>
+#endif
+#include "bulknormalrsg.hpp"
+#include "philoxrsg.hpp"
+#include <ql/math/randomnumbers/mt19937uniformrng.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace QuantLib;
+
+
+namespace {
+
+    struct VerifySettings {
+        Size uniforms = 10000000;
+        BigNatural seed = 42;
+    };
+
+    VerifySettings parseArguments(int argc, char* argv[]) {
+        VerifySettings settings;
+        for (int i=1; i<argc; ++i) {
+            std::string arg = argv[i];
+            std::string::size_type eq = arg.find('=');
+            QL_REQUIRE(arg.compare(0, 2, "--") == 0 && eq != std::string::npos,
+                       "unrecognized argument: " << arg);
+            std::string key = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+            if (key == "uniforms") {
+                settings.uniforms = std::stoul(value);
+            } else if (key == "seed") {
+                settings.seed = std::stoul(value);
+            } else {
+                QL_FAIL("unrecognized argument: " << arg);
+            }
+        }
+        return settings;
+    }
+
+
+    struct Check {
+        std::string name;
+        Size values = 0;
+        Size identical = 0;
+        // largest difference, relative to max(1, |z|) for the normals
+        Real difference = 0.0;
+        bool passed = false;
+    };
+
+    void compareValue(Check& check, Real value, Real expected) {
+        ++check.values;
+        if (value == expected)
+            ++check.identical;
+        check.difference = std::max(check.difference, std::fabs(value - expected));
+    }
+
+    std::vector<Check> checkPhilox(const VerifySettings& settings) {
+        std::vector<Check> checks;
+
+        // counter, key (low and high word) and words of philox4x32_10
+        const std::uint32_t vectors[][10] = {
+            { 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+              0x00000000, 0x00000000,
+              0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 },
+            { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff,
+              0xffffffff, 0xffffffff,
+              0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd },
+            { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344,
+              0xa4093822, 0x299f31d0,
+              0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 }
+        };
+        Check known;
+        known.name = "philox, known answers";
+        for (const auto& v : vectors) {
+            Philox4x32 philox(v[4] | (std::uint64_t(v[5]) << 32));
+            std::uint32_t c[4] = { v[0], v[1], v[2], v[3] };
+            philox(1, &c[0], &c[1], &c[2], &c[3]);
+            for (Size k=0; k<4; ++k)
+                compareValue(known, c[k], v[6+k]);
+        }
+        known.passed = known.identical == known.values;
+        checks.push_back(known);
+
+        Check words, skip;
+        words.name = "philox, sequences";
+        skip.name = "philox, skipTo";
+        Philox4x32 philox(settings.seed);
+        for (Size dimension : {1, 3, 7, 256, 300}) {
+            // as in PhiloxUniformRsg, and a few batches of sequences
+            Size batch = (256 + dimension - 1) / dimension;
+            Size sequences = 3 * batch + 2;
+
+            PhiloxUniformRsg rsg(dimension, settings.seed);
+            std::vector<std::vector<Real> > drawn;
+            for (Size i=0; i<sequences; ++i) {
+                drawn.push_back(rsg.nextSequence().value);
+                for (Size j=0; j<dimension; ++j) {
+                    std::uint64_t w = std::uint64_t(i) * dimension + j;
+                    std::uint32_t c[4] = { static_cast<std::uint32_t>(w / 4),
+                                           static_cast<std::uint32_t>((w / 4) >> 32),
+                                           0, 0 };
+                    philox(1, &c[0], &c[1], &c[2], &c[3]);
+                    compareValue(words, drawn[i][j], (c[w % 4] + 0.5) / 4294967296.0);
+                }
+            }
+
+            // forwards and backwards, inside and across the batches
+            PhiloxUniformRsg moved(dimension, settings.seed);
+            for (Size i : {batch + 1, Size(0), 2 * batch - 1, batch - 1,
+                           sequences - 2, Size(1), 2 * batch, batch}) {
+                moved.skipTo(i);
+                // the following sequence, too, to check that it goes on from there
+                for (Size k=i; k<i+2; ++k) {
+                    const std::vector<Real>& value = moved.nextSequence().value;
+                    for (Size j=0; j<dimension; ++j)
+                        compareValue(skip, value[j], drawn[k][j]);
+                }
+            }
+        }
+        words.passed = words.identical == words.values;
+        skip.passed = skip.identical == skip.values;
+        checks.push_back(words);
+        checks.push_back(skip);
+
+        return checks;
+    }
+
+
+    // rounding of the vectorized arithmetic of the central region
+    const Real bulkNormalTolerance = 1.0e-14;
+
+    Check compareNormals(const std::string& name, const std::vector<Real>& x) {
+        Check check;
+        check.name = name;
+        check.values = x.size();
+        std::vector<Real> z(x.size());
+        // blocks of 1 to 40 values, so that the tiles are also partial
+        Size block = 1;
+        for (Size start = 0; start < x.size(); start += block, block = block % 40 + 1)
+            BulkInverseCumulativeNormal::apply(&x[start], &z[start],
+                                               std::min(block, x.size() - start));
+        InverseCumulativeNormal scalar;
+        for (Size i=0; i<x.size(); ++i) {
+            Real expected = scalar(x[i]);
+            if (z[i] == expected)
+                ++check.identical;
+            check.difference = std::max(check.difference,
+                                        std::fabs(z[i] - expected)
+                                        / std::max(1.0, std::fabs(expected)));
+        }
+        check.passed = check.difference <= bulkNormalTolerance;
+        return check;
+    }
+
+    std::vector<Check> checkBulkNormal(const VerifySettings& settings) {
+        const Real xLow = 0.02425, xHigh = 1.0 - xLow;
+        std::vector<Check> checks;
+
+        std::vector<Real> x;
+        const Size n = 1000000;
+        for (Size i=0; i<n; ++i)
+            x.push_back(xLow + (xHigh - xLow) * (i + 0.5) / n);
+        checks.push_back(compareNormals("bulk normal, central region", x));
+
+        // logarithmic grids down to 1e-300, and 1e-15 for the upper tail
+        x.clear();
+        for (Size i=0; i<=n/10; ++i)
+            x.push_back(std::pow(10.0, -300.0 + (300.0 + std::log10(xLow)) * i / (n/10)));
+        checks.push_back(compareNormals("bulk normal, lower tail", x));
+
+        x.clear();
+        for (Size i=0; i<=n/10; ++i)
+            x.push_back(1.0 - std::pow(10.0, -15.0 + (15.0 + std::log10(xLow)) * i / (n/10)));
+        checks.push_back(compareNormals("bulk normal, upper tail", x));
+
+        x.clear();
+        for (Real b : {xLow, xHigh}) {
+            x.push_back(std::nextafter(b, 0.0));
+            x.push_back(b);
+            x.push_back(std::nextafter(b, 1.0));
+        }
+        checks.push_back(compareNormals("bulk normal, boundaries", x));
+
+        MersenneTwisterUniformRng rng(settings.seed);
+        x.resize(settings.uniforms);
+        for (Real& u : x)
+            u = rng.nextReal();
+        checks.push_back(compareNormals("bulk normal, uniforms", x));
+
+        return checks;
+    }
+
+}
+
+
+int main(int argc, char* argv[]) {
+
+    try {
+
+        VerifySettings settings = parseArguments(argc, argv);
+
+        std::vector<Check> checks = checkPhilox(settings);
+        std::vector<Check> normals = checkBulkNormal(settings);
+        checks.insert(checks.end(), normals.begin(), normals.end());
+
+        Size width = 16;
+        std::cout << std::setw(32) << std::left << "check" << std::right
+                  << std::setw(width) << "values"
+                  << std::setw(width) << "identical"
+                  << std::setw(width) << "difference"
+                  << std::setw(width) << "result" << std::endl;
+        std::cout << std::string(96, '-') << std::endl;
+        bool passed = true;
+        for (const Check& c : checks) {
+            std::cout << std::setw(32) << std::left << c.name << std::right
+                      << std::setw(width) << c.values
+                      << std::setw(width) << c.identical
+                      << std::setw(width) << std::setprecision(3) << c.difference
+                      << std::setw(width) << (c.passed ? "passed" : "FAILED")
+                      << std::endl;
+            passed = passed && c.passed;
+        }
+
+        return passed ? 0 : 1;
+
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}